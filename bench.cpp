@@ -0,0 +1,143 @@
+// Non-standard raylib libraries
+#include <raylib.h>
+#include <raymath.h>
+
+// Standard libraries
+#include <string.h>
+#include <iostream>
+
+// Benchmarks (all headless, no window is opened)
+#include "bench/CollisionBench.cpp"
+#include "bench/CapsuleBench.cpp"
+#include "bench/MapLoadBench.cpp"
+#include "bench/ObjectBench.cpp"
+#include "bench/JobBench.cpp"
+#include "bench/LightBench.cpp"
+#include "bench/BakeBench.cpp"
+#include "bench/FrustumBench.cpp"
+#include "bench/InstanceBench.cpp"
+#include "bench/OcclusionBench.cpp"
+#include "bench/ReloadBench.cpp"
+#include "bench/ProfilerBench.cpp"
+#include "bench/RegressionBench.cpp"
+#include "bench/DemoBench.cpp"
+#include "bench/ResolutionBench.cpp"
+#include "bench/SimThreadBench.cpp"
+#include "bench/Results.cpp"
+
+using namespace std;
+
+// Run a map benchmark on the map given after the suite, or on hub.map and test.map
+template<typename Run>
+bool OnMaps(int argc, char ** argv, Run run) {
+    if(argc > 2)
+        return run(argv[2]);
+    bool passed = run("resources/world/hub.map");
+    passed &= run("resources/world/test.map");
+    return passed;
+}
+
+int main(int argc, char ** argv) {
+    // --json <path> writes the regression results, it can come anywhere after the suite
+    const char * json_path = NULL;
+    for(int i = 1; i + 1 < argc; ++i) {
+        if(!strcmp(argv[i], "--json")) {
+            json_path = argv[i + 1];
+            for(int j = i; j + 2 <= argc; ++j)
+                argv[j] = argv[j + 2];
+            argc -= 2;
+            break;
+        }
+    }
+
+    const char * suite = argc > 1 ? argv[1] : "all";
+    bool passed = true;
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "collision")) {
+        if(argc > 2)
+            passed &= Bench::CollisionFan(argv[2]);
+        else {
+            passed &= Bench::CollisionFan("resources/models/start_room.obj");
+            passed &= Bench::CollisionFan("resources/models/testzone.obj");
+        }
+    }
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "capsule")) {
+        // Spawn and model offset match hub.map
+        passed &= Bench::CapsuleDrop("resources/models/start_room.obj", {0, -5, 0}, {0, 10, 0.1});
+        passed &= Bench::CapsuleDrop("resources/models/start_room.obj", {0, -5, 0}, {0, 10, 0.1}, 400);
+    }
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "mapload"))
+        passed &= OnMaps(argc, argv, [](const char * map) { return Bench::MapLoad(map); });
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "objects")) {
+        for(int count : {100, 1000, 10000})
+            passed &= Bench::ObjectCollision(count);
+    }
+
+    // Optional thread count to scale up to, every core by default
+    if(!strcmp(suite, "all") || !strcmp(suite, "jobs")) {
+        for(int count : {1000, 10000})
+            passed &= Bench::JobScaling(count, argc > 2 ? atoi(argv[2]) : 0);
+    }
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "lights")) {
+        for(int count : {8, 64, 255})
+            passed &= Bench::ClusterCulling(count);
+    }
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "bake"))
+        passed &= OnMaps(argc, argv, [](const char * map) { return Bench::LightBake(map); });
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "frustum"))
+        passed &= OnMaps(argc, argv, [](const char * map) { return Bench::FrustumCulling(map); });
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "instancing")) {
+        for(int count : {100, 1000, 10000})
+            passed &= Bench::Instancing(count);
+    }
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "occlusion"))
+        passed &= OnMaps(argc, argv, [](const char * map) { return Bench::OcclusionCulling(map); });
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "reload"))
+        passed &= Bench::HotReload("resources/models/start_room.obj");
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "profiler")) {
+        for(int threads : {1, 4})
+            passed &= Bench::ProfilerZones(threads);
+    }
+
+    // scripts.map is test.map with a scripted object, the suites below register the scripts
+    if(!strcmp(suite, "all") || !strcmp(suite, "demo"))
+        passed &= Bench::DemoReplay("resources/world/scripts.map");
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "resolution")) {
+        for(bool vsync : {false, true})
+            passed &= Bench::DynamicScaling(vsync);
+    }
+
+    if(!strcmp(suite, "all") || !strcmp(suite, "simthread")) {
+        passed &= Bench::SimThreadTicks("resources/world/scripts.map");
+        passed &= Bench::SimThreadOverlap("resources/world/scripts.map");
+    }
+
+    // Timings of the hot paths with min, median and p99, diff the --json output between commits
+    if(!strcmp(suite, "all") || !strcmp(suite, "perf")) {
+        for(const char * model : {"resources/models/start_room.obj", "resources/models/testzone.obj"})
+            passed &= Bench::RegressCollision(model);
+        for(const char * map : {"resources/world/hub.map", "resources/world/test.map", "resources/world/template.map"})
+            passed &= Bench::RegressMapLoad(map);
+        for(int count : {100, 1000, 10000}) {
+            for(int level : {NO_COLLISION, PLAYER_COLLISION, PARTNER_COLLISION, GLOBAL_COLLISION})
+                passed &= Bench::RegressObjects(count, level);
+        }
+        passed &= Bench::RegressLights(MAX_LIGHTS);
+    }
+
+    if(json_path != NULL)
+        passed &= Bench::WriteResults(json_path);
+
+    return passed ? 0 : 1;
+}
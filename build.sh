@@ -1 +1,2 @@
-g++ main.cpp -o main -lraylib -lpthread -ldl -I/$(pwd)/src
\ No newline at end of file
+g++ main.cpp -o main -lraylib -llua5.4 -lpthread -ldl -I/usr/include/lua5.4 -I/$(pwd)/src
+g++ -O2 bench.cpp -o bench -lraylib -llua5.4 -lpthread -ldl -I/usr/include/lua5.4 -I/$(pwd)/src
@@ -4,15 +4,20 @@
 
 // Standard libraries
 #include <math.h>
+#include <string.h>
+#include <chrono>
 #include <vector>
 
 // Limit GLSL version to 100
 #define GLSL_VERSION 100
 
 // Shader locations constants
-#define SHADER_COUNT 2
+#define SHADER_COUNT 4
 #define WORLD_SHADER 0
 #define MODEL_SHADER 1
+// Variants for instanced draws (see render/InstanceBatcher.cpp)
+#define WORLD_INSTANCED_SHADER 2
+#define MODEL_INSTANCED_SHADER 3
 
 // Local imports
 #include "render/Renderer.cpp"
@@ -22,12 +27,33 @@
 #include "world/World.cpp"
 #include "world/Editor.cpp"
 #include "world/Console.cpp"
+#include "world/Demo.cpp"
+#include "world/SimThread.cpp"
+#include "world/HotReload.cpp"
+#include "world/Timestep.cpp"
+#include "world/Headless.cpp"
+#include "world/PvsStats.cpp"
+#include "render/AssetCache.cpp"
+#include "system/JobSystem.cpp"
+#include "system/Profiler.cpp"
 
 // Global shader values
 Vector3 fog_color = {0.7f, 0.5f, 0.5f};
 float fog_amount = 0;
 
-int main(void) {
+int main(int argc, char ** argv) {
+    // Run the simulation without a window
+    if(argc > 1 && !strcmp(argv[1], "--headless"))
+        return Headless::Run(argc - 2, argv + 2);
+
+    // Bake a text map into a .cmap
+    if(argc > 2 && !strcmp(argv[1], "--bake"))
+        return BakedMap::Bake(argv[2], argc > 3 ? argv[3] : BakedMap::PathFor(argv[2]).c_str()) ? 0 : 1;
+
+    // Print the visibility statistics of a map
+    if(argc > 2 && !strcmp(argv[1], "--pvs"))
+        return PvsStats::Run(argv[2]);
+
     // Initialise the renderer
     Renderer renderer = Renderer(
         {0, 0},
@@ -41,22 +67,43 @@ int main(void) {
     // Initialise the player
     Player player = Player({0, 10, 0.1});
     
+    // Every model, texture and shader is loaded through the asset cache
+    AssetCache assets;
+
     // Load the world texture map
-    Texture2D texmap = LoadTexture("resources/textures/texmap.png");
+    Texture2D texmap;
+    assets.AcquireTexture("resources/textures/texmap.png", &texmap);
 
     // Setup the shaders
-    renderer.InitShader(WORLD_SHADER, "resources/shaders/base.vs", "resources/shaders/world.fs");
-    renderer.InitShader(MODEL_SHADER, "resources/shaders/base.vs", "resources/shaders/model.fs");
+    Shader shader;
+    assets.AcquireShader("resources/shaders/base.vs", "resources/shaders/world.fs", &shader);
+    renderer.InitShader(WORLD_SHADER, shader);
+    assets.AcquireShader("resources/shaders/base.vs", "resources/shaders/model.fs", &shader);
+    renderer.InitShader(MODEL_SHADER, shader);
+    assets.AcquireShader("resources/shaders/base.vs", "resources/shaders/world.fs", &shader, "#define INSTANCED");
+    renderer.InitShader(WORLD_INSTANCED_SHADER, shader);
+    assets.AcquireShader("resources/shaders/base.vs", "resources/shaders/model.fs", &shader, "#define INSTANCED");
+    renderer.InitShader(MODEL_INSTANCED_SHADER, shader);
 
-    // Set the inbuilt shader locations
+    // Set the inbuilt shader locations, instanced draws take the model matrix as an attribute
     renderer.shaders[WORLD_SHADER].SetInbuiltLoc(SHADER_LOC_MATRIX_MODEL, "matModel");
     renderer.shaders[MODEL_SHADER].SetInbuiltLoc(SHADER_LOC_MATRIX_MODEL, "matModel");
+    renderer.shaders[WORLD_INSTANCED_SHADER].SetInbuiltAttrib(SHADER_LOC_MATRIX_MODEL, "instanceTransform");
+    renderer.shaders[MODEL_INSTANCED_SHADER].SetInbuiltAttrib(SHADER_LOC_MATRIX_MODEL, "instanceTransform");
     
     // All shader values
-    float texsize = 31 / (float)texmap.width;
-    float gridsize = 32 / (float)texmap.width;
+    float texsize, gridsize, pixscale;
     float texscale = 3;
-    float pixscale = (float)texmap.width / texscale;
+    // The tiling values follow the texture map's size, set again when it is reloaded
+    auto set_tiling = [&]() {
+        texsize = 31 / (float)texmap.width;
+        gridsize = 32 / (float)texmap.width;
+        pixscale = (float)texmap.width / texscale;
+        renderer.SetAllShaderVal(UNIFORM_TEXSIZE, &texsize);
+        renderer.SetAllShaderVal(UNIFORM_GRIDSIZE, &gridsize);
+        renderer.SetAllShaderVal(UNIFORM_TEXSCALE, &texscale);
+        renderer.SetAllShaderVal(UNIFORM_PIXSCALE, &pixscale);
+    };
     Vector3 tint = {
         100,
         82,
@@ -72,62 +119,191 @@ int main(void) {
     tint.y *= 3.0/total;
     tint.z *= 3.0/total;
 
-    // Initial shader value set
-    renderer.shaders[WORLD_SHADER]("texsize", &texsize, SHADER_UNIFORM_FLOAT);
-    renderer.shaders[WORLD_SHADER]("gridsize", &gridsize, SHADER_UNIFORM_FLOAT);
-    renderer.shaders[WORLD_SHADER]("texscale", &texscale, SHADER_UNIFORM_FLOAT);
-    renderer.shaders[WORLD_SHADER]("fogColor", &fog_color, SHADER_UNIFORM_VEC3);
-    renderer.shaders[MODEL_SHADER]("fogColor", &fog_color, SHADER_UNIFORM_VEC3);
-    renderer.shaders[WORLD_SHADER]("fogAmount", &fog_amount, SHADER_UNIFORM_FLOAT);
-    renderer.shaders[MODEL_SHADER]("fogAmount", &fog_amount, SHADER_UNIFORM_FLOAT);
-    renderer.shaders[WORLD_SHADER]("pixscale", &pixscale, SHADER_UNIFORM_FLOAT);
-    renderer.SetAllShaderVal("tint", &tint, SHADER_UNIFORM_VEC3);
+    // Initial shader value set, the tiling values only reach the world shaders
+    set_tiling();
+    renderer.SetAllShaderVal(UNIFORM_FOG_COLOR, &fog_color);
+    renderer.SetAllShaderVal(UNIFORM_FOG_AMOUNT, &fog_amount);
+    renderer.SetAllShaderVal(UNIFORM_TINT, &tint);
+
+    // Worker threads for the simulation, one per core
+    JobSystem jobs;
+    // And for baking the lights of loaded maps, kept apart so a bake in the background never holds up a tick
+    JobSystem bake_jobs;
 
     // Init the first map
-    World world = World(&renderer, &player);
+    World world = World(&renderer, &player, &assets);
+    world.object_manager.jobs = &jobs;
+    world.bake_jobs = &bake_jobs;
     world.texmap = texmap;
     world.world_shader = WORLD_SHADER;
+    world.batcher.Pair(renderer.shaders[WORLD_SHADER].shader, renderer.shaders[WORLD_INSTANCED_SHADER].shader);
+    world.batcher.Pair(renderer.shaders[MODEL_SHADER].shader, renderer.shaders[MODEL_INSTANCED_SHADER].shader);
+    world.object_manager.RegisterScripts("resources/scripts");
+    // Objects draw their models like the player's weapon
+    world.object_manager.AcquireModels(&assets, [&](Model * model) {
+        for(int i = 0; i < model->materialCount; ++i)
+            model->materials[i].shader = renderer.shaders[MODEL_SHADER].shader;
+    });
     world.Load("resources/world/hub.map");
 
-    Model gun = LoadModel("resources/models/rifle.obj");
+    Model gun;
+    assets.AcquireModel("resources/models/rifle.obj", &gun);
     gun.materials[0].shader = renderer.shaders[MODEL_SHADER].shader;
 
-    // Set the console's world pointer
+    // The simulation runs at a fixed rate however fast frames are drawn
+    Timestep timestep = Timestep(60);
+
+    // The simulation ticks on its own thread, the frames draw the snapshots it publishes with the
+    // view's own copy of the player
+    SimThread sim = SimThread(&world, &player, &timestep);
+    Player view = player;
+    vector<ObjectInstance> no_objects;
+
+    // Set the console's world and clock pointers
     Console::world = &world;
+    Console::timestep = &timestep;
+    Console::assets = &assets;
+    Console::renderer = &renderer;
+    Console::sim = &sim;
+
+    // Maps loaded from the console stream in while the current one keeps running
+    MapLoader loader = MapLoader(&assets, true);
+    loader.jobs = &bake_jobs;
+    Console::loader = &loader;
+
+    // Demos record and replay the ticks' input, their messages and commands go through the console
+    Demo::world = &world;
+    Demo::player = &player;
+    Demo::timestep = &timestep;
+    Demo::loader = &loader;
+    // Replayed commands and messages of a tick run on the main thread, the tick waits for them
+    Demo::print = [&](const string & message) {
+        sim.Call([&]() { Console::Out(message); });
+    };
+    Demo::exec = [&](string line) {
+        bool found = false;
+        sim.Call([&]() { found = Console::Exec(line); });
+        return found;
+    };
+
+    // Assets edited under resources/ are reloaded in place
+    HotReload::world = &world;
+    HotReload::renderer = &renderer;
+    HotReload::assets = &assets;
+    HotReload::loader = &loader;
+    HotReload::sim = &sim;
+    HotReload::AddShader(WORLD_SHADER, "resources/shaders/base.vs", "resources/shaders/world.fs");
+    HotReload::AddShader(MODEL_SHADER, "resources/shaders/base.vs", "resources/shaders/model.fs");
+    HotReload::AddShader(WORLD_INSTANCED_SHADER, "resources/shaders/base.vs", "resources/shaders/world.fs", "#define INSTANCED");
+    HotReload::AddShader(MODEL_INSTANCED_SHADER, "resources/shaders/base.vs", "resources/shaders/model.fs", "#define INSTANCED");
+    HotReload::on_reload = [&](const string & path, const Model * old) {
+        const Asset & asset = assets.assets.at(path);
+        if(path == "resources/textures/texmap.png") {
+            texmap = world.texmap = asset.texture;
+            set_tiling();
+        }
+        else if(old != NULL && gun.meshes == old->meshes) {
+            gun.meshCount = asset.model.meshCount;
+            gun.meshes = asset.model.meshes;
+            gun.meshMaterial = asset.model.meshMaterial;
+        }
+    };
+    HotReload::Start("resources");
+    sim.Start();
 
     while(!WindowShouldClose()) {
         float deltat = GetFrameTime();
 
-        renderer.shaders[WORLD_SHADER]("view", &player.position, SHADER_UNIFORM_VEC3);
-        renderer.shaders[MODEL_SHADER]("view", &player.position, SHADER_UNIFORM_VEC3);
+        // Sample input once per frame, the ticks take it from the simulation
+        if(IsKeyPressed(KEY_GRAVE)) {
+            Console::open = !Console::open;
+            view.input = PlayerInput();
+            sim.ClearInput();
+        }
+        else if(Console::open) {
+            int key = GetKeyPressed();
+            if(key == KEY_ESCAPE)
+                Console::open = false;
+            else if(key)
+                Console::AddInput(key);
+        }
+        else if(!Demo::Playing()) {
+            view.PollInput();
+            sim.Input(view.input);
+            view.input.look = {0, 0};
+        }
+
+        // Swap in a map once it finished loading in the background
+        {
+            PROFILE_ZONE("Loading");
+            sim.Service();
+            Console::Update();
+            HotReload::Update();
+            if(Demo::ended) {
+                SimPause pause(&sim);
+                Demo::Stop();
+            }
+        }
+
+        // Timed demos run one tick per frame however long the frame took, alongside drawing it
+        bool timing = Demo::mode == DEMO_TIMING;
+        sim.SetLockstep(timing);
+        auto render_start = chrono::steady_clock::now();
+        if(timing)
+            sim.Step();
+        else
+            sim.Advance(deltat);
+
+        // Draw the newest tick the simulation finished, between it and the one before
+        sim.snapshots.Acquire();
+        const RenderSnapshot & snapshot = sim.snapshots.Front();
+        view.Follow(snapshot.player);
+        view.Interpolate(timing ? 1 : Clamp((SimThread::Now() - snapshot.time) / snapshot.step, 0, 1), deltat);
+
+        // Only what the camera's cell can see is lit and drawn
+        world.pvs.SetViewpoint(view.camera.position);
+
+        // Render below full resolution when frames run over budget
+        renderer.AdaptResolution(deltat * 1000);
+
+        // Only the lights reaching each part of the view are summed by the shaders
+        world.light_manager.Cull(view.camera, {(float)renderer.render.texture.width, (float)renderer.render.texture.height}, &world.pvs);
+        // Lights changed since the last frame go up in one batch
+        world.light_manager.Flush(GetTime());
+
+        renderer.SetAllShaderVal(UNIFORM_VIEW, &view.view_position);
+
+        // Everything set this frame goes up before drawing
+        {
+            PROFILE_ZONE("Renderer::FlushShaders");
+            renderer.FlushShaders();
+        }
 
         renderer.BeginRender();
         {
-            BeginMode3D(player.camera); 
+            BeginMode3D(view.camera); 
             {
-                gun.transform = MatrixRotateXYZ((Vector3){0, player.gun_rotation.x - player.input_axis.x / 20, player.gun_rotation.y - 0.1f});
+                gun.transform = MatrixRotateXYZ((Vector3){0, view.gun_rotation.x - view.input_axis.x / 20, view.gun_rotation.y - 0.1f});
 
                 // Check if in edit mode
                 if(world.edit) {
                     DrawGrid(5, 2);
                     Ray cameraLook = {
-                        player.camera.position,
-                        player.look
+                        view.camera.position,
+                        view.look
                     };
 
                     RayCollision finalCollide = GetRayCollisionBox(
                         cameraLook, 
                         {
-                            {player.position.x - 100, 0, player.position.y - 100},
-                            {player.position.x + 100, 0, player.position.y + 100}
+                            {view.position.x - 100, 0, view.position.y - 100},
+                            {view.position.x + 100, 0, view.position.y + 100}
                         }
                     );
 
-                    for(Model model : world.models) {
-                        RayCollision cameraCollide = GetRayCollisionMesh(cameraLook, model.meshes[0], model.transform);
-                        if(cameraCollide.hit && cameraCollide.distance < finalCollide.distance)
-                            finalCollide = cameraCollide;
-                    }
+                    RayCollision cameraCollide = world.collision.CastRay(cameraLook);
+                    if(cameraCollide.hit && cameraCollide.distance < finalCollide.distance)
+                        finalCollide = cameraCollide;
 
                     if(IsKeyDown(KEY_LEFT_CONTROL)) {
                         Vector3 pos = {
@@ -142,9 +318,11 @@ int main(void) {
                 }
                 // Only draw player weapon if not in edit mode
                 else
-                    DrawModel(gun, player.gun_position, 0.1, WHITE);
+                    DrawModel(gun, view.gun_position, 0.1, WHITE);
 
-                world.Render();
+                // Objects of a snapshot from before the models or objects were last replaced are gone
+                world.Render(view.camera, renderer.render.texture.width / (float)renderer.render.texture.height,
+                    snapshot.revision == world.object_manager.revision ? &snapshot.objects : &no_objects);
             }
             EndMode3D();
 
@@ -154,7 +332,7 @@ int main(void) {
             DrawFPS(3, 3);
 
             DrawText(
-                (to_string(int(player.position.x*100)) + ", " + to_string(int(player.position.y*100)) + ", " + to_string(int(player.position.z*100))).c_str(),
+                (to_string(int(view.position.x*100)) + ", " + to_string(int(view.position.y*100)) + ", " + to_string(int(view.position.z*100))).c_str(),
                 3,
                 28,
                 20,
@@ -162,38 +340,36 @@ int main(void) {
             );
 
             DrawText(
-                player.grounded ? "grounded" : "!grounded",
+                view.grounded ? "grounded" : "!grounded",
                 3,
                 53,
                 20,
                 WHITE
             );
-        }
-        renderer.StopRender();
 
-        if(!world.edit) {
-            for(Model model : world.models)
-                player.CheckCollision(model);
-        }
-        else {
-            player.grounded = true; 
+            if(Profiler::overlay)
+                Profiler::Render(3, 78, renderer.width / 3, 16);
         }
-
-        if(IsKeyPressed(KEY_GRAVE)) {
-            Console::open = !Console::open;
-            continue;
+        {
+            // Includes waiting for vsync
+            PROFILE_ZONE("Renderer::StopRender");
+            renderer.StopRender();
         }
+        double render_us = chrono::duration<double, micro>(chrono::steady_clock::now() - render_start).count();
 
-        if(Console::open) {
-            int key = GetKeyPressed();
-            if(key == KEY_ESCAPE)
-                Console::open = false;
-            else if(key)
-                Console::AddInput(key);
-        }
-        else
-            player.Update();
+        // A timed demo's tick has to finish before the next frame starts another
+        if(timing)
+            sim.WaitStep();
+        Demo::Frame(sim.TakeSimTime(), render_us);
+        Profiler::EndFrame();
     }
 
+    // GPU assets have to go before the window does
+    sim.Stop();
+    loader.Finish();
+    world.Reset();
+    world.object_manager.ReleaseModels();
+    world.light_manager.Unload();
+    assets.Clear();
     renderer.Close();
 }
\ No newline at end of file
@@ -0,0 +1,36 @@
+-- Floats up and down around where it was placed and turns to face the player
+local Bobber = {
+    collision_level = 1,
+    bounds = {-0.25, -0.25, -0.25, 0.25, 0.25, 0.25},
+    model = "resources/models/rifle.obj",
+    model_scale = 0.1,
+}
+
+local base = {}
+-- Offset into the bob from where it was placed, the batch order changes as objects are deleted
+local phase = {}
+local time = 0
+
+function Bobber.start(h)
+    local x, y, z = objects.position(h)
+    base[h] = y
+    phase[h] = x + y + z
+end
+
+function Bobber.update(handles, count, dt)
+    time = time + dt
+    local px, py, pz = objects.player()
+    for i = 1, count do
+        local h = handles[i]
+        local x, y, z = objects.position(h)
+        objects.set_position(h, x, base[h] + math.sin(time * 2 + phase[h]) * 0.25, z)
+        objects.set_rotation(h, 0, math.atan(px - x, pz - z), 0)
+    end
+end
+
+function Bobber.delete(h)
+    base[h] = nil
+    phase[h] = nil
+end
+
+return Bobber
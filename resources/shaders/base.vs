@@ -1,5 +1,8 @@
 #version 100
 
+// INSTANCED is defined for instanced draws (see render/InstanceBatcher.cpp), which take the model
+// matrix as an attribute
+
 // Input vertex attributes
 attribute vec3 vertexPosition;
 attribute vec2 vertexTexCoord;
@@ -8,12 +11,23 @@ attribute vec4 vertexColor;
 
 // Input uniform v alues
 uniform mat4 mvp;
+#ifdef INSTANCED
+// Model matrix of the instance, mvp is only the view and projection then
+attribute mat4 instanceTransform;
+#define MODEL_MATRIX instanceTransform
+#else
 uniform mat4 matModel;
+#define MODEL_MATRIX matModel
+#endif
 
 // Output vertex attributes (to fragment shader)
 varying vec2 fragTexCoord;
 varying vec2 fixedTexCoord;
 varying vec3 fragPosition;
+varying float fragBakedLight;
+
+// Range of the baked light, matches LIGHT_BAKE_RANGE in world/LightBaker.cpp
+#define BAKE_RANGE 4.0
 
 // NOTE: Add here your custom variables
 
@@ -32,9 +46,19 @@ void main() {
         );
     }
 
-    fragPosition = vec3(matModel * vec4(vertexPosition, 1.0));;
+    fragPosition = vec3(MODEL_MATRIX * vec4(vertexPosition, 1.0));
     fragTexCoord = vertexTexCoord;
 
+    // Baked static light is 16 bits over the red and green channels, alpha 0 marks baked vertices
+    // (meshes without colours get white)
+    fragBakedLight = 0.0;
+    if(vertexColor.a < 0.5)
+        fragBakedLight = ((vertexColor.r * 65280.0 + vertexColor.g * 255.0) / 65535.0 * 2.0 - 1.0) * BAKE_RANGE;
+
     // Calculate final vertex position
+#ifdef INSTANCED
+    gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);
+#else
     gl_Position = mvp * vec4(vertexPosition, 1.0);
+#endif
 }
\ No newline at end of file
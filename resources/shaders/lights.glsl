@@ -0,0 +1,72 @@
+// Clustered lighting shared by world.fs and model.fs, inserted where they #include it when the
+// shaders load (render/AssetCache.cpp). Define SKIP_BAKED_LIGHTS first where the baked lights are
+// already in the vertex colours.
+
+// Lights, packed by render/LightManager.cpp. Row 0 holds position and brightness, 0 when the light
+// is off. Row 1 holds the animation (0 steady, 1 pulse, 2 flicker, plus 4 when baked), speed,
+// amount and phase. A texture rather than a uniform array, GLSL 100 only indexes those by constants.
+#define LIGHT_TEXTURE_WIDTH 256.0
+uniform mediump sampler2D lightTexture;
+uniform float lightTime;
+
+// Clustered lighting, the grid matches render/LightClusters.cpp
+#define CLUSTER_X 16.0
+#define CLUSTER_Y 9.0
+#define CLUSTER_Z 24.0
+#define CLUSTER_TEXELS 8
+
+// Light indices per cluster, 255 ends a list
+uniform sampler2D lightClusters;
+uniform vec3 clusterEye;
+uniform vec3 clusterForward;
+// Screen width and height, end of the first slice, slices per log depth
+uniform vec4 clusterParams;
+
+// Brightness of a light at the current time, animations dim it by up to their amount
+float LightBrightness(vec4 data, vec4 animation) {
+    float mode = mod(animation.x, 4.0);
+    float dim = 0.0;
+    if(mode > 1.5)
+        dim = fract(sin(floor(lightTime * animation.y) + animation.w) * 43758.5453);
+    else if(mode > 0.5)
+        dim = 0.5 + 0.5 * sin(lightTime * animation.y + animation.w);
+#ifdef SKIP_BAKED_LIGHTS
+    // Only the dimming of baked lights is added
+    float base = animation.x > 3.5 ? 0.0 : 1.0;
+#else
+    // Moving models are not baked, baked lights count in full
+    float base = 1.0;
+#endif
+    return data.w * (base - animation.z * dim);
+}
+
+// Sum of the lights listed for the fragment's cluster
+float ClusterLight(vec3 position) {
+    float depth = dot(position - clusterEye, clusterForward);
+    float slice = 0.0;
+    if(depth > clusterParams.z)
+        slice = min(CLUSTER_Z - 1.0, 1.0 + floor(log(depth / clusterParams.z) * clusterParams.w));
+    vec2 tile = min(floor(gl_FragCoord.xy / clusterParams.xy * vec2(CLUSTER_X, CLUSTER_Y)), vec2(CLUSTER_X - 1.0, CLUSTER_Y - 1.0));
+
+    vec2 size = vec2(CLUSTER_X * float(CLUSTER_TEXELS), CLUSTER_Y * CLUSTER_Z);
+    vec2 first = vec2(tile.x * float(CLUSTER_TEXELS), tile.y + slice * CLUSTER_Y) + 0.5;
+
+    float light = 0.0;
+    for(int i = 0; i < CLUSTER_TEXELS; ++i) {
+        vec4 indices = floor(texture2D(lightClusters, (first + vec2(float(i), 0.0)) / size) * 255.0 + 0.5);
+        for(int j = 0; j < 4; ++j) {
+            if(indices[j] > 254.0)
+                return light;
+            float u = (indices[j] + 0.5) / LIGHT_TEXTURE_WIDTH;
+            vec4 animation = texture2D(lightTexture, vec2(u, 0.75));
+#ifdef SKIP_BAKED_LIGHTS
+            // Steady baked lights come last in every list and add nothing here
+            if(animation.x == 4.0)
+                return light;
+#endif
+            vec4 data = texture2D(lightTexture, vec2(u, 0.25));
+            light += (1.0 / distance(position, data.xyz)) * LightBrightness(data, animation);
+        }
+    }
+    return light;
+}
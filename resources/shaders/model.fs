@@ -15,26 +15,14 @@ uniform vec3 view;
 uniform vec3 fogColor;
 uniform float fogAmount;
 
-// Define the light struct
-struct Light {
-    float active;
-    float brightness;
-    vec3 position;
-};
-
-// Lighting uniforms
-uniform Light lights[255];
-uniform int lightc;
-
 // Other uniforms
 uniform vec3 tint;
 
+#include "lights.glsl"
+
 void main() {
     // Lighting
-    float light = 0.0;
-    for(int i = 0; i < lightc; ++i) {
-        light += (1.0 / distance(fragPosition, lights[i].position)) * lights[i].brightness * lights[i].active;
-    }
+    float light = ClusterLight(fragPosition);
     if(light >= 1.0) {
         light = 1.0;
     }
@@ -6,6 +6,7 @@ precision mediump float;
 varying vec2 fixedTexCoord;
 varying vec2 fragTexCoord;
 varying vec3 fragPosition;
+varying float fragBakedLight;
 
 // Uniform texture samples
 uniform sampler2D texture0;
@@ -22,29 +23,19 @@ uniform vec3 view;
 uniform vec3 fogColor;
 uniform float fogAmount;
 
-// Define the light struct
-struct Light {
-    float active;
-    float brightness;
-    vec3 position;
-};
-
-// Lighting uniforms
-uniform Light lights[255];
-uniform int lightc;
-
 // Other uniforms
 uniform vec3 tint;
 
+// Baked lights are already in fragBakedLight
+#define SKIP_BAKED_LIGHTS
+#include "lights.glsl"
+
 void main() {
     // Snap fragpos to grid
     vec3 gridPosition = floor(fragPosition*pixscale)/pixscale;
 
     // Lighting
-    float light = 0.0;
-    for(int i = 0; i < lightc; ++i) {
-        light += (1.0 / distance(gridPosition, lights[i].position)) * lights[i].brightness * lights[i].active;
-    }
+    float light = fragBakedLight + ClusterLight(gridPosition);
 
     // Texture map
     vec2 coord = mod(fixedTexCoord / texscale, texsize) 
@@ -0,0 +1,98 @@
+#pragma once
+
+// Times baking a map's static lights on one thread and on every core, checks both give the same
+// vertex colours, and that the disk cache hands the same bake back
+#include <raylib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "render/AssetCache.cpp"
+#include "world/LightBaker.cpp"
+#include "world/MapLoader.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // A baker for the models and lights of a loaded map
+    void BakeSetup(MapLoader & loader, LightBaker * baker) {
+        baker->collision = &loader.collision;
+        for(LoadedLight & light : loader.lights)
+            baker->lights.push_back({light.position.x, light.position.y, light.position.z, light.brightness});
+        for(LoadedModel & loaded : loader.models) {
+            if(loaded.loaded)
+                baker->instances.push_back({vector<Mesh>(loaded.model.meshes, loaded.model.meshes + loaded.model.meshCount), loaded.position});
+        }
+    }
+
+    bool SameColors(LightBaker & a, LightBaker & b) {
+        if(a.instances.size() != b.instances.size())
+            return false;
+        for(unsigned int i = 0; i < a.instances.size(); ++i) {
+            Mesh & first = a.instances[i].lit;
+            Mesh & second = b.instances[i].lit;
+            if(first.vertexCount != second.vertexCount || memcmp(first.colors, second.colors, first.vertexCount * 4)
+                || memcmp(first.vertices, second.vertices, first.vertexCount * 3 * sizeof(float)))
+                return false;
+        }
+        return true;
+    }
+
+    void FreeBake(LightBaker & baker) {
+        for(BakeInstance & instance : baker.instances)
+            LightBaker::Free(instance.lit);
+    }
+
+    bool LightBake(const char * filename) {
+        AssetCache assets = AssetCache(true);
+        MapLoader loader = MapLoader(&assets, false);
+        if(!loader.Load(filename, MAP_TEXT))
+            return false;
+
+        LightBaker serial, parallel, unshadowed, written, read;
+        for(LightBaker * baker : {&serial, &parallel, &unshadowed, &written, &read}) {
+            BakeSetup(loader, baker);
+            baker->cache_dir = "";
+        }
+        serial.threads = 1;
+        parallel.threads = max(4u, thread::hardware_concurrency());
+        unshadowed.collision = NULL;
+        written.cache_dir = read.cache_dir = RUN_DIR "bench/";
+
+        serial.Bake();
+        parallel.Bake();
+        unshadowed.Bake();
+        written.Bake();
+        read.Bake();
+        remove((written.cache_dir + string(TextFormat("%016llx", (unsigned long long)written.hash)) + ".clit").c_str());
+
+        // Vertices some light does not reach
+        size_t shadowed = 0;
+        for(unsigned int i = 0; i < serial.instances.size(); ++i) {
+            Mesh & lit = serial.instances[i].lit;
+            for(int v = 0; v < lit.vertexCount; ++v)
+                shadowed += LightBaker::Decode(&lit.colors[v * 4]) != LightBaker::Decode(&unshadowed.instances[i].lit.colors[v * 4]);
+        }
+
+        bool matches = SameColors(serial, parallel);
+        bool cache_matches = read.cached && SameColors(serial, read);
+
+        cout << "BENCH: light bake '" << filename << "', " << serial.lights.size() << " lights\n";
+        cout << "  vertices:   " << serial.vertex_count << " (" << shadowed << " shadowed)\n";
+        cout << "  1 thread:   " << serial.ms << " ms (" << serial.rays << " shadow rays)\n";
+        cout << "  " << parallel.threads << " threads:  " << parallel.ms << " ms (" << serial.ms / parallel.ms << "x)\n";
+        cout << "  from cache: " << read.ms << " ms\n";
+        cout << "  bakes match: " << (matches ? "yes" : "no") << ", cache matches: " << (cache_matches ? "yes" : "no") << "\n";
+
+        for(LightBaker * baker : {&serial, &parallel, &unshadowed, &written, &read})
+            FreeBake(*baker);
+        loader.Finish();
+        assets.Clear();
+        return matches && cache_matches;
+    }
+};
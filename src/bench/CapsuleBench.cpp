@@ -0,0 +1,80 @@
+#pragma once
+
+// Drops the player capsule onto a map model and walks it around, reporting the controller cost
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+#include "player/Player.cpp"
+#include "world/ObjLoader.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // Returns false if the capsule falls through the floor or never lands
+    bool CapsuleDrop(const char * filename, Vector3 offset, Vector3 spawn, float fall_speed = 60, int ticks = 600) {
+        Mesh mesh;
+        if(!ObjLoader::Load(filename, &mesh)) {
+            cout << "ERROR: BENCH: Could not load '" << filename << "'\n";
+            return false;
+        }
+
+        CollisionWorld world;
+        world.AddMesh(mesh, MatrixTranslate(offset.x, offset.y, offset.z));
+        world.Build();
+        ObjLoader::Unload(mesh);
+
+        // The floor the capsule should come to rest on
+        RayCollision floor = world.CastRay({spawn, {0, -1, 0}});
+        if(!floor.hit) {
+            cout << "ERROR: BENCH: No floor below the spawn point\n";
+            return false;
+        }
+
+        Player player = Player(spawn);
+        player.velocity = {0, -fall_speed, 0};
+        float deltat = 1 / 60.0f;
+
+        int total_queries = 0, max_queries = 0, landed_tick = -1;
+        double total_us = 0, max_us = 0;
+        float lowest = spawn.y;
+
+        for(int tick = 0; tick < ticks; ++tick) {
+            // Second half of the run walks back and forth across the spawn point
+            if(tick >= ticks / 2)
+                player.velocity.z = cosf(tick * 0.02f) * 3;
+
+            auto start = chrono::steady_clock::now();
+            player.Move(&world, Vector3Scale(player.velocity, deltat));
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+            if(player.grounded && player.velocity.y < 0)
+                player.velocity.y = 0;
+            player.velocity.y -= player.gravity * deltat;
+
+            total_us += us;
+            max_us = fmax(max_us, us);
+            total_queries += player.queries;
+            max_queries = max(max_queries, player.queries);
+            lowest = fminf(lowest, player.position.y);
+            if(player.grounded && landed_tick < 0)
+                landed_tick = tick;
+        }
+
+        float bottom = lowest - player.capsule_radius;
+        bool tunnelled = bottom < floor.point.y - 0.05f;
+
+        cout << "BENCH: capsule drop '" << filename << "' from " << spawn.y << " at " << fall_speed << " m/s\n";
+        cout << "  floor height:     " << floor.point.y << " (lowest capsule bottom " << bottom << ")\n";
+        cout << "  landed on tick:   " << landed_tick << (tunnelled ? " (TUNNELLED)" : "") << "\n";
+        cout << "  queries per tick: " << (float)total_queries / ticks << " avg, " << max_queries << " max\n";
+        cout << "  time per tick:    " << total_us / ticks << " us avg, " << max_us << " us max\n";
+
+        return landed_tick >= 0 && !tunnelled;
+    }
+};
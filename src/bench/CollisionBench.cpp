@@ -0,0 +1,113 @@
+#pragma once
+
+// Compares the BVH collision world against the per-mesh GetRayCollisionMesh ray fan it replaced
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+#include "world/ObjLoader.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // One ray of the player collision fan, with the distance the player code accepts a hit at
+    struct FanRay {
+        Ray ray;
+        float max_distance;
+    };
+
+    // The same rays Player::CheckCollision casts from a position (wall, ground, center and ceiling rays)
+    void BuildRayFan(Vector3 position, vector<FanRay> * rays) {
+        rays->clear();
+        for(float angle = 0; angle < PI * 2; angle += PI / 8) {
+            for(float height = 0.15f; height < 1.3f; height += 0.1f)
+                rays->push_back({{{position.x, position.y + height, position.z}, {cosf(angle), 0, sinf(angle)}}, 0.3f});
+
+            rays->push_back({{{position.x + sinf(angle) * 0.15f, position.y, position.z + cosf(angle) * 0.15f}, {0, -1, 0}}, 0.3f});
+        }
+        rays->push_back({{{position.x, position.y + 0.5f, position.z}, {0, -1, 0}}, 0.3f});
+        rays->push_back({{{position.x, position.y + 1, position.z}, {0, 1, 0}}, 0.1f});
+    }
+
+    double Microseconds(chrono::steady_clock::time_point start) {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Returns false if the two paths disagree on any ray
+    bool CollisionFan(const char * filename, int iterations = 20) {
+        Mesh mesh;
+        if(!ObjLoader::Load(filename, &mesh)) {
+            cout << "ERROR: BENCH: Could not load '" << filename << "'\n";
+            return false;
+        }
+
+        CollisionWorld world;
+        auto start = chrono::steady_clock::now();
+        world.AddMesh(mesh, MatrixIdentity());
+        world.Build();
+        double build_us = Microseconds(start);
+
+        // Sample player positions on a grid across the mesh bounds
+        BoundingBox box = {{1e9, 1e9, 1e9}, {-1e9, -1e9, -1e9}};
+        for(int i = 0; i < mesh.vertexCount; ++i) {
+            Vector3 v = {mesh.vertices[i * 3], mesh.vertices[i * 3 + 1], mesh.vertices[i * 3 + 2]};
+            box.min = Vector3Min(box.min, v);
+            box.max = Vector3Max(box.max, v);
+        }
+
+        vector<Vector3> positions;
+        for(int x = 0; x < 8; ++x)
+            for(int y = 0; y < 4; ++y)
+                for(int z = 0; z < 8; ++z)
+                    positions.push_back({
+                        Lerp(box.min.x, box.max.x, (x + 0.5f) / 8),
+                        Lerp(box.min.y, box.max.y, (y + 0.5f) / 4),
+                        Lerp(box.min.z, box.max.z, (z + 0.5f) / 8)
+                    });
+
+        vector<FanRay> rays;
+        int mismatches = 0, hits = 0, fans = 0;
+        double mesh_us = 0, bvh_us = 0;
+
+        for(int it = 0; it < iterations; ++it) {
+            for(Vector3 position : positions) {
+                BuildRayFan(position, &rays);
+                ++fans;
+
+                vector<bool> mesh_hits(rays.size());
+                start = chrono::steady_clock::now();
+                for(unsigned int i = 0; i < rays.size(); ++i) {
+                    RayCollision collision = GetRayCollisionMesh(rays[i].ray, mesh, MatrixIdentity());
+                    mesh_hits[i] = collision.hit && collision.distance <= rays[i].max_distance;
+                }
+                mesh_us += Microseconds(start);
+
+                vector<bool> bvh_hits(rays.size());
+                start = chrono::steady_clock::now();
+                for(unsigned int i = 0; i < rays.size(); ++i)
+                    bvh_hits[i] = world.CastRay(rays[i].ray, rays[i].max_distance).hit;
+                bvh_us += Microseconds(start);
+
+                for(unsigned int i = 0; i < rays.size(); ++i) {
+                    hits += bvh_hits[i];
+                    mismatches += mesh_hits[i] != bvh_hits[i];
+                }
+            }
+        }
+
+        cout << "BENCH: collision fan '" << filename << "'\n";
+        cout << "  triangles:        " << world.triangles.size() << " (" << world.nodes.size() << " BVH nodes, built in " << build_us << " us)\n";
+        cout << "  rays per fan:     " << rays.size() << " (" << hits << " hits over " << fans << " fans)\n";
+        cout << "  GetRayCollisionMesh: " << mesh_us / fans << " us/fan\n";
+        cout << "  CollisionWorld:      " << bvh_us / fans << " us/fan (" << mesh_us / bvh_us << "x)\n";
+        cout << "  mismatched rays:  " << mismatches << "\n";
+
+        ObjLoader::Unload(mesh);
+        return mismatches == 0;
+    }
+};
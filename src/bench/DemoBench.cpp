@@ -0,0 +1,127 @@
+#pragma once
+
+// Records a demo of scripted input on a headless map and plays it back twice, the player and every
+// object have to end up bit for bit where the recording left them. The scripts keep state between
+// ticks (bobber.lua's clock), so this also checks they restart with the demo.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "world/Demo.cpp"
+#include "world/MapLoader.cpp"
+#include "world/Timestep.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // Everything a replay has to reproduce, compared as raw bytes
+    vector<float> DemoState(const Player & player, const ObjectManager & objects) {
+        vector<float> state = {
+            player.position.x, player.position.y, player.position.z,
+            player.velocity.x, player.velocity.y, player.velocity.z,
+            player.rotation.x, player.rotation.y
+        };
+        for(unsigned int i = 0; i < objects.object_count; ++i) {
+            state.push_back(objects.positions[i].x);
+            state.push_back(objects.positions[i].y);
+            state.push_back(objects.positions[i].z);
+        }
+        return state;
+    }
+
+    bool DemoReplay(const char * filename, int ticks = 600) {
+        Player player = Player({0, 10, 0.1});
+        AssetCache cold = AssetCache(true, 0);
+        World world = World(NULL, &player, &cold);
+        world.object_manager.RegisterScripts("resources/scripts");
+        if(!world.Load(filename)) {
+            cout << "ERROR: BENCH: Could not load '" << filename << "'\n";
+            return false;
+        }
+
+        Timestep timestep = Timestep(60);
+        MapLoader loader = MapLoader(&cold, false);
+        Demo::world = &world;
+        Demo::player = &player;
+        Demo::timestep = &timestep;
+        Demo::loader = &loader;
+        Demo::print = [](const string &) {};
+        unsigned int executed = 0;
+        Demo::exec = [&](string line) {
+            executed += line == "tickrate 60";
+            return true;
+        };
+
+        // Run the map on a while first, the demo has to start over from the freshly loaded map
+        for(int i = 0; i < 120; ++i) {
+            player.Update(timestep.Step(), &world.collision);
+            world.object_manager.Update(timestep.Step(), &player);
+        }
+
+        auto run = [&]() {
+            for(int i = 0; i < ticks && Demo::Active(); ++i) {
+                Demo::Tick(&player.input);
+                player.Update(timestep.Step(), &world.collision);
+                world.object_manager.Update(timestep.Step(), &player);
+            }
+        };
+
+        // Walk and turn in bursts, jumping now and then
+        srand(23);
+        if(!Demo::Record("bench"))
+            return false;
+        for(int i = 0; i < ticks; ++i) {
+            if(i % 30 == 0) {
+                player.input.axis = {(float)(rand() % 3 - 1), (float)(rand() % 3 - 1)};
+                player.input.jump = rand() % 4 == 0;
+                Demo::Command("tickrate 60");
+            }
+            if(i % 3 == 0)
+                player.input.look = {(float)(rand() % 41 - 20), (float)(rand() % 11 - 5)};
+            Demo::Tick(&player.input);
+            player.Update(timestep.Step(), &world.collision);
+            world.object_manager.Update(timestep.Step(), &player);
+        }
+        vector<float> recorded = DemoState(player, world.object_manager);
+        Demo::Stop();
+        string path = Demo::PathFor("bench");
+        FILE * file = fopen(path.c_str(), "rb");
+        if(file == NULL) {
+            cout << "ERROR: BENCH: Could not read '" << path << "'\n";
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long demo_bytes = ftell(file);
+        fclose(file);
+
+        bool identical = true;
+        for(int replay = 0; replay < 2; ++replay) {
+            if(!Demo::Play("bench", false))
+                return false;
+            run();
+            identical &= !Demo::Active() || Demo::tick == (unsigned long)ticks;
+            Demo::Stop();
+            vector<float> played = DemoState(player, world.object_manager);
+            identical &= played.size() == recorded.size() && !memcmp(played.data(), recorded.data(), played.size() * sizeof(float));
+        }
+        remove(path.c_str());
+        unsigned int expected_commands = 2 * ((ticks + 29) / 30);
+
+        cout << "BENCH: demo replay '" << filename << "', " << ticks << " ticks, " << world.object_manager.object_count << " objects\n";
+        cout << "  size:        " << demo_bytes << " bytes (" << (demo_bytes - (long)sizeof(DemoHeader)) / (float)ticks << " per tick)\n";
+        cout << "  commands:    " << executed << " of " << expected_commands << " replayed\n";
+        cout << "  replays:     " << (identical ? "identical" : "diverged (bad)") << "\n";
+        world.Reset();
+        return identical && executed == expected_commands;
+    }
+};
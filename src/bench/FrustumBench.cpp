@@ -0,0 +1,80 @@
+#pragma once
+
+// Checks the SIMD chunk culling against testing all eight corners of every box, and that no chunk
+// with a vertex in view is culled, over random cameras in a headless world
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "bench/LightBench.cpp"
+#include "bench/Views.cpp"
+#include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "render/Frustum.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    bool FrustumCulling(const char * filename, int views = 2000) {
+        Player player = Player({0, 0, 0});
+        AssetCache assets = AssetCache(true);
+        World world = World(NULL, &player, &assets);
+        if(!world.Load(filename, MAP_TEXT))
+            return false;
+
+        BoundingBox extent = ChunkExtent(world);
+        float aspect = 16 / 9.0f;
+
+        srand(1);
+        double simd_us = 0, brute_us = 0;
+        unsigned long drawn = 0;
+        int mismatches = 0, missing = 0;
+        vector<unsigned char> visible, reference;
+        for(int view = 0; view < views; ++view) {
+            Camera3D camera = RandomView(extent);
+            Frustum frustum = Frustum::FromCamera(camera, aspect);
+
+            auto start = chrono::steady_clock::now();
+            drawn += world.chunk_bounds.Cull(frustum, &visible);
+            simd_us += Microseconds(start);
+
+            start = chrono::steady_clock::now();
+            world.chunk_bounds.CullBruteForce(frustum, &reference);
+            brute_us += Microseconds(start);
+            mismatches += visible != reference;
+
+            // Every vertex in view has to be in a drawn chunk
+            for(unsigned int i = 0; i < world.chunks.size(); ++i) {
+                if(visible[i])
+                    continue;
+                const Model & model = world.models[world.chunks[i].model];
+                const Mesh & mesh = model.meshes[world.chunks[i].mesh];
+                Vector3 offset = {model.transform.m12, model.transform.m13, model.transform.m14};
+                for(int v = 0; v < mesh.vertexCount; ++v) {
+                    Vector3 vertex = Vector3Add({mesh.vertices[v * 3], mesh.vertices[v * 3 + 1], mesh.vertices[v * 3 + 2]}, offset);
+                    if(frustum.Contains(vertex)) {
+                        ++missing;
+                        break;
+                    }
+                }
+            }
+        }
+
+        cout << "BENCH: frustum culling '" << filename << "', " << world.chunks.size() << " chunks\n";
+        cout << "  simd:        " << simd_us / views << " us/view\n";
+        cout << "  brute force: " << brute_us / views << " us/view\n";
+        cout << "  drawn:       " << (double)drawn / views << " chunks/view avg\n";
+        cout << "  mismatches:  " << mismatches << " views, " << missing << " culled chunks with a vertex in view\n";
+
+        world.Reset();
+        assets.Clear();
+        return mismatches == 0 && missing == 0;
+    }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+// Checks the draw calls of objects sharing a model stay flat as their number grows, and that
+// every object in view is queued exactly once, with and without instancing. Headless, so draws
+// go nowhere and only what would be submitted is counted.
+#include <raylib.h>
+#include <raymath.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "bench/CollisionBench.cpp"
+#include "object/ObjectManager.cpp"
+#include "render/AssetCache.cpp"
+#include "render/Frustum.cpp"
+#include "render/InstanceBatcher.cpp"
+
+using namespace std;
+
+namespace Bench {
+    bool Instancing(int count, int frames = 100) {
+        AssetCache assets = AssetCache(true);
+        ObjectManager manager;
+
+        GameObject prop;
+        prop.type = "Prop";
+        prop.model = "resources/models/rifle.obj";
+        prop.model_scale = 0.1f;
+        manager.RegisterType(prop);
+
+        // Stand-ins for a shader and its instanced variant, only the ids matter to the batcher
+        Shader plain = {1, NULL}, instanced = {2, NULL};
+        InstanceBatcher batcher;
+        batcher.Pair(plain, instanced);
+        if(manager.AcquireModels(&assets, [&](Model * model) {
+            for(int i = 0; i < model->materialCount; ++i)
+                model->materials[i].shader = plain;
+        }) != 1)
+            return false;
+        int meshes = manager.models[0].meshCount;
+
+        // Scattered in front of the camera, some fall outside the view
+        float extent = cbrtf(count) * 2;
+        srand(1);
+        for(int i = 0; i < count; ++i) {
+            Vector3 position = {
+                (rand() / (float)RAND_MAX - 0.5f) * extent * 2,
+                (rand() / (float)RAND_MAX - 0.5f) * extent,
+                (rand() / (float)RAND_MAX) * extent * 2 + 1
+            };
+            manager.Create("Prop", "prop", position, {0, i * 0.1f, 0});
+        }
+
+        Camera3D camera = {0};
+        camera.up = {0, 1, 0};
+        camera.fovy = 60;
+        camera.target = {0, 0, 1};
+
+        double queue_us = 0;
+        unsigned int instanced_calls = 0;
+        for(int frame = 0; frame < frames; ++frame) {
+            camera.target = {sinf(frame * 0.05f), 0, 1};
+            Frustum frustum = Frustum::FromCamera(camera, 16 / 9.0f);
+
+            auto start = chrono::steady_clock::now();
+            manager.Render(frustum, &batcher);
+            instanced_calls = max(instanced_calls, batcher.DrawCalls());
+            queue_us += Microseconds(start);
+            batcher.Clear();
+        }
+
+        // Every object with its position in view has to be drawn, the rest may be
+        Frustum frustum = Frustum::FromCamera(camera, 16 / 9.0f);
+        unsigned int in_view = 0;
+        for(unsigned int i = 0; i < manager.object_count; ++i)
+            in_view += frustum.Contains(manager.positions[i]);
+
+        manager.Render(frustum, &batcher);
+        batcher.Flush();
+        unsigned int queued = batcher.instance_count;
+        unsigned int flat_calls = batcher.draw_calls;
+
+        batcher.instancing = false;
+        manager.Render(frustum, &batcher);
+        batcher.Flush();
+        unsigned int single_calls = batcher.draw_calls;
+
+        unsigned int drawn = manager.objects_drawn;
+        bool passed = instanced_calls <= (unsigned int)meshes
+            && drawn >= in_view && drawn + manager.objects_culled == (unsigned int)count
+            && queued == drawn * meshes && single_calls == queued;
+
+        cout << "BENCH: instancing, " << count << " objects of " << meshes << " meshes\n";
+        cout << "  queue:       " << queue_us / frames << " us avg per frame\n";
+        cout << "  objects:     " << drawn << " drawn, " << manager.objects_culled << " culled (" << in_view << " centres in view)\n";
+        cout << "  draw calls:  " << flat_calls << " instanced, " << single_calls << " without\n";
+        cout << "  flat:        " << (passed ? "yes" : "no") << "\n";
+        manager.ReleaseModels();
+        assets.Clear();
+        return passed;
+    }
+};
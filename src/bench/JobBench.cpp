@@ -0,0 +1,103 @@
+#pragma once
+
+// Times ObjectManager::Update from 1 to N job threads on the same scene, and checks every thread
+// count delivers exactly the collisions the single threaded run does
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "object/ObjectManager.cpp"
+#include "player/Player.cpp"
+#include "system/JobSystem.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // Runs the scene on a fresh manager, returns the average update time and the pairs of every tick
+    double ObjectScene(JobSystem * jobs, int count, int ticks, vector<pair<unsigned int, unsigned int>> * delivered, Vector3 * player_end) {
+        Player player = Player({0, 0, 0});
+        player.UpdateBounds();
+
+        ObjectManager manager;
+        manager.jobs = jobs;
+        manager.RegisterType(GameObject());
+        manager.Reserve(count);
+
+        // Same density as the object bench, with the player inside the scatter
+        float extent = cbrtf(count) * 2;
+        srand(1);
+        for(int i = 0; i < count; ++i) {
+            Vector3 position = {
+                (rand() / (float)RAND_MAX) * extent - extent / 2,
+                (rand() / (float)RAND_MAX) * extent - extent / 2,
+                (rand() / (float)RAND_MAX) * extent - extent / 2
+            };
+            manager.Create("GameObject", "object", position, {0});
+            manager.local_bounds.back() = {{-0.25f, -0.25f, -0.25f}, {0.25f, 0.25f, 0.25f}};
+            manager.collision_levels.back() = i % 4;
+        }
+
+        double total_us = 0;
+        delivered->clear();
+        for(int tick = 0; tick < ticks; ++tick) {
+            for(int i = tick % 10; i < count; i += 10) {
+                manager.positions[i].x += sinf(tick * 0.1f + i) * 0.2f;
+                manager.positions[i].z += cosf(tick * 0.1f + i) * 0.2f;
+            }
+
+            auto start = chrono::steady_clock::now();
+            manager.Update(1 / 60.0f, &player);
+            total_us += Microseconds(start);
+            delivered->insert(delivered->end(), manager.broadphase.pairs.begin(), manager.broadphase.pairs.end());
+        }
+        *player_end = player.position;
+        return total_us / ticks;
+    }
+
+    // Thread counts double up to max_threads, which is always included
+    bool JobScaling(int count, unsigned int max_threads = 0, int ticks = 100) {
+        if(max_threads == 0)
+            max_threads = max(4u, thread::hardware_concurrency());
+
+        vector<unsigned int> thread_counts;
+        for(unsigned int threads = 1; threads < max_threads; threads *= 2)
+            thread_counts.push_back(threads);
+        thread_counts.push_back(max_threads);
+
+        cout << "BENCH: job scaling, " << count << " objects, " << thread::hardware_concurrency() << " cores\n";
+
+        vector<pair<unsigned int, unsigned int>> reference;
+        Vector3 reference_player = {0};
+        double serial_us = 0;
+        bool matches = true;
+        for(unsigned int threads : thread_counts) {
+            JobSystem jobs = JobSystem(threads);
+            vector<pair<unsigned int, unsigned int>> delivered;
+            Vector3 player_end;
+            double us = ObjectScene(&jobs, count, ticks, &delivered, &player_end);
+
+            bool same = true;
+            if(threads == 1) {
+                reference = delivered;
+                reference_player = player_end;
+                serial_us = us;
+            }
+            else
+                same = delivered == reference && Vector3Equals(player_end, reference_player);
+            matches &= same;
+
+            cout << "  " << threads << " threads:" << string(threads < 10 ? 6 : 5, ' ') << us << " us avg, "
+                 << serial_us / us << "x" << (same ? "" : " (results differ)") << "\n";
+        }
+        cout << "  deterministic: " << (matches ? "yes" : "no") << "\n";
+        return matches;
+    }
+};
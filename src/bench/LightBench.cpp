@@ -0,0 +1,107 @@
+#pragma once
+
+// Times clustered light assignment against testing every light on every cluster, and checks every
+// light bright enough to matter at a point in view is listed for that point's cluster
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "bench/CollisionBench.cpp"
+#include "render/LightClusters.cpp"
+#include "render/LightManager.cpp"
+
+using namespace std;
+
+namespace Bench {
+    float Random(float low, float high) {
+        return low + (rand() / (float)RAND_MAX) * (high - low);
+    }
+
+    // Lights as bright as hub.map's scattered through a large box, the camera moves and turns every frame
+    bool ClusterCulling(int light_count, int frames = 200) {
+        // Both hold a few hundred KiB of lists
+        unique_ptr<LightManager> manager(new LightManager(NULL));
+        unique_ptr<LightClusters> brute(new LightClusters());
+
+        srand(light_count);
+        float extent = 100;
+        for(int i = 0; i < light_count; ++i)
+            manager->CreateLight(Random(0.05f, 0.75f), {Random(-extent, extent), Random(0, 10), Random(-extent, extent)});
+
+        Camera3D camera = {0};
+        camera.up = {0, 1, 0};
+        camera.fovy = 60;
+        camera.projection = CAMERA_PERSPECTIVE;
+        Vector2 screen = {640, 360};
+
+        double cluster_us = 0, brute_us = 0;
+        unsigned long tests = 0, brute_tests = 0, listed = 0, overflow = 0;
+        bool matches = true;
+        int missing = 0, samples = 0;
+
+        for(int frame = 0; frame < frames; ++frame) {
+            float yaw = frame * 0.05f, pitch = sinf(frame * 0.03f) * 0.6f;
+            camera.position = {Random(-extent, extent) / 2, Random(1, 8), Random(-extent, extent) / 2};
+            camera.target = Vector3Add(camera.position, {sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch)});
+
+            auto start = chrono::steady_clock::now();
+            manager->Cull(camera, screen);
+            cluster_us += Microseconds(start);
+            LightClusters & clusters = manager->clusters;
+
+            start = chrono::steady_clock::now();
+            brute->Begin(camera, screen.x / screen.y);
+            for(int i = 0; i < manager->light_count; ++i)
+                brute->AddBruteForce(i, manager->lights[i].position, fabsf(manager->lights[i].brightness) / LIGHT_CUTOFF);
+            brute->Finish();
+            brute_us += Microseconds(start);
+
+            matches &= clusters.pixels == brute->pixels && clusters.overflow == brute->overflow;
+            tests += clusters.tests;
+            brute_tests += brute->tests;
+            overflow += clusters.overflow;
+            for(int i = 0; i < CLUSTER_COUNT; ++i)
+                listed += clusters.counts[i];
+
+            // Points inside the view, lights brighter than the cutoff there have to be listed unless the cluster is full
+            for(int sample = 0; sample < 64; ++sample) {
+                Vector2 ndc = {Random(-1, 1), Random(-1, 1)};
+                float depth = Random(0.1f, extent * 2);
+                Vector3 point = Vector3Add(clusters.eye, Vector3Add(Vector3Scale(clusters.forward, depth), Vector3Add(
+                    Vector3Scale(clusters.right, ndc.x * depth * clusters.tan_x),
+                    Vector3Scale(clusters.up, ndc.y * depth * clusters.tan_y)
+                )));
+
+                int x = min(CLUSTER_X - 1, (int)((ndc.x + 1) / 2 * CLUSTER_X));
+                int y = min(CLUSTER_Y - 1, (int)((ndc.y + 1) / 2 * CLUSTER_Y));
+                int cluster = LightClusters::Index(x, y, LightClusters::Slice(depth));
+                if(clusters.counts[cluster] == CLUSTER_MAX_LIGHTS)
+                    continue;
+
+                ++samples;
+                for(int i = 0; i < manager->light_count; ++i) {
+                    Light & light = manager->lights[i];
+                    if(light.brightness / Vector3Distance(point, light.position) < LIGHT_CUTOFF * 1.001f)
+                        continue;
+                    unsigned char * list = &clusters.lists[cluster * CLUSTER_MAX_LIGHTS];
+                    if(!memchr(list, i, clusters.counts[cluster]))
+                        ++missing;
+                }
+            }
+        }
+
+        cout << "BENCH: clustered lights, " << light_count << " lights, " << CLUSTER_COUNT << " clusters\n";
+        cout << "  clustered:     " << cluster_us / frames << " us/frame (" << tests / frames << " sphere tests)\n";
+        cout << "  brute force:   " << brute_us / frames << " us/frame (" << brute_tests / frames << " sphere tests)\n";
+        cout << "  lights/cluster: " << (double)listed / frames / CLUSTER_COUNT << " avg, " << overflow / (double)frames << " dropped/frame\n";
+        cout << "  lists match:   " << (matches ? "yes" : "no") << "\n";
+        cout << "  coverage:      " << missing << " missing lights over " << samples << " sample points\n";
+        return matches && missing == 0;
+    }
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+// Times headless World::Load of a text map against its baked .cmap, a reload from the asset cache
+// and a background load
+#include <raylib.h>
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "bench/CollisionBench.cpp"
+#include "world/World.cpp"
+#include "world/BakedMap.cpp"
+#include "world/MapLoader.cpp"
+#include "render/AssetCache.cpp"
+#include "player/Player.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // Returns false if baking fails or the loads disagree on the resulting world
+    bool MapLoad(const char * filename, int iterations = 20) {
+        mkdir(RUN_DIR, 0755);
+        string baked_path = RUN_DIR + string(GetFileNameWithoutExt(filename)) + ".bench.cmap";
+        if(!BakedMap::Bake(filename, baked_path.c_str()))
+            return false;
+
+        // A zero budget evicts everything on Reset, so every load starts cold
+        Player player = Player({0, 0, 0});
+        AssetCache cold = AssetCache(true, 0);
+        World world = World(NULL, &player, &cold);
+
+        double text_us = 0, baked_us = 0;
+        size_t text_triangles = 0, baked_triangles = 0;
+        int text_lights = 0, baked_lights = 0;
+        Vector3 text_spawn = {0}, baked_spawn = {0};
+        bool loaded = true;
+
+        for(int it = 0; it < iterations && loaded; ++it) {
+            auto start = chrono::steady_clock::now();
+            loaded &= world.Load(filename, MAP_TEXT);
+            text_us += Microseconds(start);
+            text_triangles = world.collision.triangles.size();
+            text_lights = world.light_manager.light_count;
+            text_spawn = player.position;
+            world.Reset();
+
+            start = chrono::steady_clock::now();
+            loaded &= world.Load(baked_path.c_str(), MAP_BAKED);
+            baked_us += Microseconds(start);
+            baked_triangles = world.collision.triangles.size();
+            baked_lights = world.light_manager.light_count;
+            baked_spawn = player.position;
+            world.Reset();
+        }
+        remove(baked_path.c_str());
+
+        // Revisit the map with its models still resident
+        AssetCache warm = AssetCache(true);
+        World revisit = World(NULL, &player, &warm);
+        double warm_us = 0;
+        for(int it = 0; it <= iterations && loaded; ++it) {
+            auto start = chrono::steady_clock::now();
+            loaded &= revisit.Load(filename, MAP_TEXT);
+            if(it > 0)
+                warm_us += Microseconds(start);
+            revisit.Reset();
+        }
+
+        // Stream the map in the background while the previous one stays loaded, as the console does
+        MapLoader loader = MapLoader(&warm, false);
+        revisit.Load("resources/world/template.map");
+        int frames = 0;
+        double worst_frame_us = 0;
+        loaded &= loader.Start(filename);
+        while(loader.Busy()) {
+            auto start = chrono::steady_clock::now();
+            loader.Update(MAP_UPLOAD_BUDGET);
+            worst_frame_us = max(worst_frame_us, Microseconds(start));
+            ++frames;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        loaded &= loader.state == LOAD_READY;
+        if(loaded)
+            revisit.Apply(&loader);
+        loaded &= revisit.collision.triangles.size() == text_triangles;
+        revisit.Reset();
+
+        bool matches = loaded && text_triangles == baked_triangles && text_lights == baked_lights
+            && Vector3Equals(text_spawn, baked_spawn);
+
+        cout << "BENCH: map load '" << filename << "'\n";
+        cout << "  triangles:    " << baked_triangles << ", lights: " << baked_lights << "\n";
+        cout << "  text:         " << text_us / iterations / 1000 << " ms/load\n";
+        cout << "  baked:        " << baked_us / iterations / 1000 << " ms/load (" << text_us / baked_us << "x)\n";
+        cout << "  text, cached: " << warm_us / iterations / 1000 << " ms/load (" << warm.hits << " hits, "
+             << warm.misses << " misses, " << warm.resident_bytes / 1024 << " KiB resident)\n";
+        cout << "  background:   " << frames << " frames, longest main thread stall " << worst_frame_us / 1000 << " ms\n";
+        cout << "  worlds match: " << (matches ? "yes" : "no") << "\n";
+
+        cold.Clear();
+        warm.Clear();
+        return matches;
+    }
+};
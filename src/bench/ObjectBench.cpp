@@ -0,0 +1,112 @@
+#pragma once
+
+// Times ObjectManager::Update with the broadphase and checks its pairs against a brute force sweep
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "object/ObjectManager.cpp"
+#include "player/Player.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // Every overlapping pair the collision levels accept, the O(n^2) way (by slot, like the broadphase)
+    void BrutePairs(ObjectManager * manager, vector<pair<unsigned int, unsigned int>> * pairs) {
+        pairs->clear();
+        vector<int> & levels = manager->collision_levels;
+        for(unsigned int a = 0; a < manager->object_count; ++a) {
+            if(levels[a] == NO_COLLISION)
+                continue;
+            for(unsigned int b = a + 1; b < manager->object_count; ++b) {
+                if(levels[b] == NO_COLLISION)
+                    continue;
+                if(!ObjectManager::Responds(levels[a], levels[b]) && !ObjectManager::Responds(levels[b], levels[a]))
+                    continue;
+                if(CheckCollisionBoxes(manager->bounds[a], manager->bounds[b])) {
+                    unsigned int slot_a = manager->objects[a].handle.index, slot_b = manager->objects[b].handle.index;
+                    pairs->push_back({min(slot_a, slot_b), max(slot_a, slot_b)});
+                }
+            }
+        }
+        sort(pairs->begin(), pairs->end());
+    }
+
+    // Objects are scattered at a constant density, a tenth of them move and a hundredth are replaced
+    // every tick. Returns false if the broadphase misses or invents a pair, or a stale handle resolves.
+    bool ObjectCollision(int count, int ticks = 100) {
+        Player player = Player({0, 0, 0});
+        player.UpdateBounds();
+
+        ObjectManager manager;
+        manager.RegisterType(GameObject());
+        manager.Reserve(count);
+
+        float extent = cbrtf(count) * 2;
+        vector<ObjectHandle> handles;
+        auto spawn = [&](int level) {
+            Vector3 position = {
+                (rand() / (float)RAND_MAX) * extent,
+                (rand() / (float)RAND_MAX) * extent,
+                (rand() / (float)RAND_MAX) * extent
+            };
+            handles.push_back(manager.Create("GameObject", "object", position, {0}));
+            manager.local_bounds.back() = {{-0.25f, -0.25f, -0.25f}, {0.25f, 0.25f, 0.25f}};
+            manager.collision_levels.back() = level;
+        };
+        srand(1);
+        for(int i = 0; i < count; ++i)
+            spawn(i % 4);
+
+        bool stale_valid = false;
+
+        double update_us = 0, worst_us = 0;
+        size_t pair_total = 0;
+        for(int tick = 0; tick < ticks; ++tick) {
+            for(int i = tick % 10; i < count; i += 10) {
+                manager.positions[i].x += sinf(tick * 0.1f + i) * 0.2f;
+                manager.positions[i].z += cosf(tick * 0.1f + i) * 0.2f;
+            }
+
+            // Replace a hundredth of the objects, handles to the old ones must go stale
+            for(int i = 0; i < max(1, count / 100); ++i) {
+                unsigned int pick = rand() % handles.size();
+                ObjectHandle old = handles[pick];
+                manager.Delete(old);
+                handles[pick] = handles.back();
+                handles.pop_back();
+                spawn(rand() % 4);
+                stale_valid |= manager.Valid(old);
+            }
+
+            auto start = chrono::steady_clock::now();
+            manager.Update(1 / 60.0f, &player);
+            double us = Microseconds(start);
+            update_us += us;
+            worst_us = max(worst_us, us);
+            pair_total += manager.broadphase.pairs.size();
+        }
+
+        // Compare the last tick against brute force
+        vector<pair<unsigned int, unsigned int>> brute;
+        auto start = chrono::steady_clock::now();
+        BrutePairs(&manager, &brute);
+        double brute_us = Microseconds(start);
+        bool matches = brute == manager.broadphase.pairs && !stale_valid && manager.object_count == (unsigned int)count;
+
+        cout << "BENCH: object collision, " << count << " objects\n";
+        cout << "  update:        " << update_us / ticks << " us avg, " << worst_us << " us worst ("
+             << (double)pair_total / ticks << " pairs/tick)\n";
+        cout << "  brute force:   " << brute_us << " us for the pair sweep alone\n";
+        cout << "  stale handles: " << (stale_valid ? "resolved (bad)" : "rejected") << "\n";
+        cout << "  pairs match:   " << (matches ? "yes" : "no") << "\n";
+        return matches;
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+// Checks the SIMD occlusion rasterizer and box test against their per pixel references, and that
+// nothing hidden could be seen: no world chunk vertex or test box point culled by occlusion has a
+// clear line to the camera through the full collision scene. Random cameras in a headless world.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "bench/LightBench.cpp"
+#include "bench/Views.cpp"
+#include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "render/Frustum.cpp"
+#include "render/Occlusion.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // Whether point is in view and nothing in the collision scene lies between it and the camera
+    bool Seen(const World & world, const Frustum & frustum, Vector3 eye, Vector3 point) {
+        if(!frustum.Contains(point))
+            return false;
+        Vector3 to = Vector3Subtract(point, eye);
+        float distance = Vector3Length(to);
+        if(distance < 0.01f)
+            return true;
+        return !world.collision.Occluded({eye, Vector3Scale(to, 1 / distance)}, distance * 0.999f - 0.001f);
+    }
+
+    bool OcclusionCulling(const char * filename, int views = 500, int boxes = 64) {
+        Player player = Player({0, 0, 0});
+        AssetCache assets = AssetCache(true);
+        World world = World(NULL, &player, &assets);
+        if(!world.Load(filename, MAP_TEXT))
+            return false;
+
+        BoundingBox extent = ChunkExtent(world);
+        float aspect = 16 / 9.0f;
+
+        srand(1);
+        OcclusionBuffer occlusion, reference;
+        double simd_us = 0, reference_us = 0, test_us = 0;
+        unsigned long tested = 0, hidden = 0;
+        int buffer_mismatches = 0, test_mismatches = 0, false_culls = 0;
+        vector<unsigned char> in_view;
+        vector<BoundingBox> tests;
+        for(int view = 0; view < views; ++view) {
+            Camera3D camera = RandomView(extent);
+            Frustum frustum = Frustum::FromCamera(camera, aspect);
+
+            auto start = chrono::steady_clock::now();
+            occlusion.Build(camera, aspect, world.collision.triangles);
+            simd_us += Microseconds(start);
+
+            start = chrono::steady_clock::now();
+            reference.Begin(camera, aspect);
+            for(unsigned int index : occlusion.occluders)
+                reference.RasterizeReference(world.collision.triangles[index]);
+            reference_us += Microseconds(start);
+            buffer_mismatches += occlusion.depth != reference.depth;
+
+            // The chunks in view and random boxes around the map
+            world.chunk_bounds.Cull(frustum, &in_view);
+            tests.clear();
+            for(unsigned int i = 0; i < world.chunks.size(); ++i) {
+                if(in_view[i])
+                    tests.push_back(world.chunk_bounds.Get(i));
+            }
+            unsigned int chunk_tests = tests.size();
+            for(int i = 0; i < boxes; ++i) {
+                Vector3 center = {Random(extent.min.x, extent.max.x), Random(extent.min.y, extent.max.y), Random(extent.min.z, extent.max.z)};
+                float size = Random(0.25f, 2);
+                tests.push_back({Vector3SubtractValue(center, size), Vector3AddValue(center, size)});
+            }
+
+            for(unsigned int i = 0; i < tests.size(); ++i) {
+                start = chrono::steady_clock::now();
+                bool visible = occlusion.Visible(tests[i]);
+                test_us += Microseconds(start);
+                ++tested;
+                test_mismatches += visible != occlusion.VisibleReference(tests[i]);
+                if(visible)
+                    continue;
+                ++hidden;
+
+                // Hidden chunks may not have a vertex in sight, hidden boxes no corner or centre
+                bool seen = false;
+                if(i < chunk_tests) {
+                    unsigned int chunk = 0, found = 0;
+                    for(; chunk < world.chunks.size(); ++chunk) {
+                        if(in_view[chunk] && found++ == i)
+                            break;
+                    }
+                    const Model & model = world.models[world.chunks[chunk].model];
+                    const Mesh & mesh = model.meshes[world.chunks[chunk].mesh];
+                    Vector3 offset = {model.transform.m12, model.transform.m13, model.transform.m14};
+                    for(int v = 0; v < mesh.vertexCount && !seen; ++v)
+                        seen = Seen(world, frustum, camera.position, Vector3Add({mesh.vertices[v * 3], mesh.vertices[v * 3 + 1], mesh.vertices[v * 3 + 2]}, offset));
+                }
+                else {
+                    BoundingBox box = tests[i];
+                    seen = Seen(world, frustum, camera.position, Vector3Scale(Vector3Add(box.min, box.max), 0.5f));
+                    for(int corner = 0; corner < 8 && !seen; ++corner) {
+                        Vector3 point = {corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z};
+                        seen = Seen(world, frustum, camera.position, point);
+                    }
+                }
+                false_culls += seen;
+            }
+        }
+
+        cout << "BENCH: occlusion culling '" << filename << "', " << OCCLUSION_WIDTH << "x" << OCCLUSION_HEIGHT << ", "
+             << min<size_t>(OCCLUSION_OCCLUDERS, world.collision.triangles.size()) << " occluders\n";
+        cout << "  rasterize:   " << simd_us / views << " us/view simd, " << reference_us / views << " us/view reference\n";
+        cout << "  test:        " << test_us / tested << " us/box, " << 100.0 * hidden / tested << "% of boxes hidden\n";
+        cout << "  mismatches:  " << buffer_mismatches << " buffers, " << test_mismatches << " box tests\n";
+        cout << "  false culls: " << false_culls << "\n";
+
+        world.Reset();
+        assets.Clear();
+        return buffer_mismatches == 0 && test_mismatches == 0 && false_culls == 0;
+    }
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Measures what a profiler zone costs and checks the zones of several threads recording at once
+// all reach their frame, nested under their parents, and make it into a trace dump.
+#include <sys/stat.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "system/Profiler.cpp"
+
+#ifndef RUN_DIR
+#define RUN_DIR "run/"
+#endif
+
+using namespace std;
+
+namespace Bench {
+    bool ProfilerZones(int threads, int zones_per_thread = 2000) {
+        // Collect whatever earlier suites recorded so the frame below only holds these zones
+        Profiler::EndFrame();
+        unsigned long dropped = Profiler::dropped;
+
+        vector<double> record_us(threads);
+        vector<thread> workers;
+        for(int t = 0; t < threads; ++t)
+            workers.emplace_back([&record_us, t, zones_per_thread]() {
+                auto start = chrono::steady_clock::now();
+                for(int i = 0; i < zones_per_thread / 2; ++i) {
+                    PROFILE_ZONE("Outer");
+                    PROFILE_ZONE("Inner");
+                }
+                record_us[t] = Microseconds(start);
+            });
+        double total_us = 0;
+        for(int t = 0; t < threads; ++t) {
+            workers[t].join();
+            total_us += record_us[t];
+        }
+        Profiler::EndFrame();
+
+        const ProfileFrame & frame = Profiler::frames.back();
+        unsigned int outer = 0, inner = 0, misnested = 0;
+        for(const ProfileEvent & event : frame.events) {
+            if(string(event.name) == "Outer") {
+                ++outer;
+                misnested += event.depth != 0;
+            }
+            else if(string(event.name) == "Inner") {
+                ++inner;
+                misnested += event.depth != 1;
+            }
+        }
+        unsigned int expected = threads * (zones_per_thread / 2);
+
+        mkdir(RUN_DIR, 0755);
+        string trace_path = string(RUN_DIR) + "bench_trace.json";
+        bool traced = Profiler::WriteTrace(trace_path.c_str(), 1);
+        ifstream trace(trace_path);
+        unsigned int trace_lines = 0;
+        for(string line; getline(trace, line);)
+            trace_lines += line.find("\"ph\":\"X\"") != string::npos;
+        traced &= trace_lines == frame.events.size() + 1;
+        remove(trace_path.c_str());
+
+        cout << "BENCH: profiler zones, " << threads << " threads x " << zones_per_thread << " zones\n";
+        cout << "  record:      " << total_us * 1000 / (threads * zones_per_thread) << " ns/zone\n";
+        cout << "  collected:   " << outer + inner << " of " << 2 * expected << " zones, " << misnested << " misnested, "
+             << Profiler::dropped - dropped << " dropped\n";
+        cout << "  trace:       " << (traced ? "complete" : "incomplete (bad)") << "\n";
+        return outer == expected && inner == expected && misnested == 0 && traced;
+    }
+};
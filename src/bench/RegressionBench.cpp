@@ -0,0 +1,199 @@
+#pragma once
+
+// Repeatable timings of the hot paths for catching regressions between commits: collision queries
+// against a model, headless map loads, object updates per collision level and light updates.
+// Every input is fixed (seeded or on a grid) so runs are comparable, see bench/Results.cpp.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "bench/LightBench.cpp"
+#include "bench/Results.cpp"
+#include "object/ObjectManager.cpp"
+#include "physics/CollisionWorld.cpp"
+#include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "render/LightManager.cpp"
+#include "world/BakedMap.cpp"
+#include "world/ObjLoader.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // The results are named after the file without its directory or extension
+    string BenchName(const char * filename) {
+        return GetFileNameWithoutExt(filename);
+    }
+
+    // The player ray fan and a capsule sweep at positions on a grid through the model's bounds
+    bool RegressCollision(const char * filename, int samples = 20) {
+        Mesh mesh;
+        if(!ObjLoader::Load(filename, &mesh)) {
+            cout << "ERROR: BENCH: Could not load '" << filename << "'\n";
+            return false;
+        }
+        CollisionWorld world;
+        world.AddMesh(mesh, MatrixIdentity());
+        world.Build();
+
+        BoundingBox box = GetMeshBoundingBox(mesh);
+        ObjLoader::Unload(mesh);
+        vector<Vector3> positions;
+        for(int x = 0; x < 8; ++x)
+            for(int y = 0; y < 4; ++y)
+                for(int z = 0; z < 8; ++z)
+                    positions.push_back({
+                        Lerp(box.min.x, box.max.x, (x + 0.5f) / 8),
+                        Lerp(box.min.y, box.max.y, (y + 0.5f) / 4),
+                        Lerp(box.min.z, box.max.z, (z + 0.5f) / 8)
+                    });
+
+        cout << "BENCH: regression collision '" << filename << "', " << positions.size() << " positions per sample\n";
+        string name = "collision." + BenchName(filename);
+
+        vector<FanRay> rays;
+        int hits = 0;
+        Report(name + ".ray_fan", Sample(samples, [&](int) {
+            for(Vector3 position : positions) {
+                BuildRayFan(position, &rays);
+                for(const FanRay & fan : rays) {
+                    RayCollision hit = world.CastRay(fan.ray);
+                    hits += hit.hit && hit.distance < fan.max_distance;
+                }
+            }
+        }));
+        // Printed so the casts are not optimised out, the fan reaches nothing in testzone.obj
+        cout << "  ray fan hits: " << hits << "\n";
+
+        // A step of a player walking at 6 m/s and falling, in each direction around the grid
+        Player player = Player({0, 0, 0});
+        Report(name + ".capsule_move", Sample(samples, [&](int sample) {
+            float angle = sample * 0.7f;
+            Vector3 motion = {sinf(angle) * 0.1f, -0.05f, cosf(angle) * 0.1f};
+            for(Vector3 position : positions) {
+                player.position = position;
+                player.Move(&world, motion);
+            }
+        }));
+        return true;
+    }
+
+    // Cold headless loads of a text map and its baked copy, the cache keeps nothing between them
+    bool RegressMapLoad(const char * filename, int samples = 20) {
+        // Baked next to the other files the game writes, not into resources/
+        mkdir(RUN_DIR, 0755);
+        string baked_path = RUN_DIR + BenchName(filename) + ".bench.cmap";
+        if(!BakedMap::Bake(filename, baked_path.c_str()))
+            return false;
+
+        Player player = Player({0, 0, 0});
+        AssetCache cold = AssetCache(true, 0);
+        World world = World(NULL, &player, &cold);
+        world.object_manager.RegisterScripts("resources/scripts");
+
+        cout << "BENCH: regression map load '" << filename << "'\n";
+        string name = "mapload." + BenchName(filename);
+        bool loaded = true;
+        Report(name + ".text", Sample(samples, [&](int) {
+            loaded &= world.Load(filename, MAP_TEXT);
+            world.Reset();
+        }, 1));
+        Report(name + ".baked", Sample(samples, [&](int) {
+            loaded &= world.Load(baked_path.c_str(), MAP_BAKED);
+            world.Reset();
+        }, 1));
+
+        cold.Clear();
+        remove(baked_path.c_str());
+        return loaded;
+    }
+
+    // ObjectManager::Update with every object at one collision level, a tenth of them moving each tick
+    bool RegressObjects(int count, int level, int samples = 100) {
+        Player player = Player({0, 0, 0});
+        player.UpdateBounds();
+
+        ObjectManager manager;
+        manager.RegisterType(GameObject());
+        manager.Reserve(count);
+
+        // Constant density, so the pairs per object stay alike at every count
+        srand(count + level);
+        float extent = cbrtf(count) * 2;
+        for(int i = 0; i < count; ++i) {
+            manager.Create("GameObject", "object", {Random(0, extent), Random(0, extent), Random(0, extent)}, {0});
+            manager.local_bounds.back() = {{-0.25f, -0.25f, -0.25f}, {0.25f, 0.25f, 0.25f}};
+            manager.collision_levels.back() = level;
+        }
+
+        const char * level_names[] = {"none", "player", "partner", "global"};
+        cout << "BENCH: regression object update, " << count << " objects at " << level_names[level] << " collision\n";
+        Report("objects." + to_string(count) + "." + level_names[level], Sample(samples, [&](int tick) {
+            for(int i = tick % 10; i < count; i += 10) {
+                manager.positions[i].x += sinf(tick * 0.1f + i) * 0.2f;
+                manager.positions[i].z += cosf(tick * 0.1f + i) * 0.2f;
+            }
+            manager.Update(1 / 60.0f, &player);
+        }));
+        return manager.object_count == (unsigned int)count;
+    }
+
+    // Clustering and packing light_count lights for a moving camera, with a few lights changed per
+    // frame and with all of them changed. The renderer has no shaders, so packing is timed but
+    // nothing is sent.
+    bool RegressLights(int light_count, int samples = 200) {
+        Renderer renderer;
+        renderer.shaders = NULL;
+        renderer.shader_count = 0;
+        unique_ptr<LightManager> manager(new LightManager(NULL));
+
+        srand(light_count);
+        float extent = 100;
+        for(int i = 0; i < light_count; ++i)
+            manager->CreateLight(Random(0.05f, 0.75f), {Random(-extent, extent), Random(0, 10), Random(-extent, extent)});
+
+        Camera3D camera = {0};
+        camera.up = {0, 1, 0};
+        camera.fovy = 60;
+        camera.projection = CAMERA_PERSPECTIVE;
+        Vector2 screen = {640, 360};
+
+        // Culling uploads the clusters with a renderer, so it is only given one to flush
+        auto frame = [&](int index, int changed) {
+            float yaw = index * 0.05f;
+            camera.position = {sinf(index * 0.01f) * extent / 2, 4, cosf(index * 0.013f) * extent / 2};
+            camera.target = Vector3Add(camera.position, {sinf(yaw), 0, cosf(yaw)});
+            for(int i = 0; i < changed; ++i) {
+                int light = (index * 7 + i) % light_count;
+                manager->lights[light].position.y = 5 + sinf(index * 0.1f + i) * 4;
+                manager->UpdateLight(light);
+            }
+
+            manager->renderer = NULL;
+            manager->Cull(camera, screen);
+            manager->renderer = &renderer;
+            manager->Flush(index / 60.0f);
+        };
+
+        cout << "BENCH: regression light update, " << light_count << " lights\n";
+        string name = "lights." + to_string(light_count);
+        Report(name + ".moving_8", Sample(samples, [&](int index) {
+            frame(index, min(8, light_count));
+        }));
+        Report(name + ".moving_all", Sample(samples, [&](int index) {
+            frame(index, light_count);
+        }));
+        manager->renderer = NULL;
+        return manager->light_count == light_count;
+    }
+};
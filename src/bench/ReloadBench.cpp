@@ -0,0 +1,95 @@
+#pragma once
+
+// Checks hot reloading in a headless world: an edited map is reported once after it has been
+// quiet for the debounce time, its lights and objects are patched in without reloading the models
+// (an edit that moves a model is refused), and a reloaded world model is drawn from the new meshes.
+#include <raylib.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "bench/CollisionBench.cpp"
+#include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "render/MeshChunks.cpp"
+#include "system/FileWatcher.cpp"
+#include "world/ObjLoader.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    bool WriteFile(const string & path, const string & text) {
+        ofstream file(path);
+        file << text;
+        return file.good();
+    }
+
+    bool HotReload(const char * model_path) {
+        string directory = string(RUN_DIR) + "reload";
+        mkdir(RUN_DIR, 0755);
+        mkdir(directory.c_str(), 0755);
+        string map_path = directory + "/reload.map";
+        string model_line = string("M ") + model_path + " 0,-5,0\n";
+        if(!WriteFile(map_path, model_line + "L 0.75 0,-1.4,0\nO bobber 0,1,0\nO bobber 0,2,0\n"))
+            return false;
+
+        Player player = Player({0, 0, 0});
+        AssetCache assets = AssetCache(true);
+        World world = World(NULL, &player, &assets);
+        world.object_manager.RegisterScripts("resources/scripts");
+        if(!world.Load(map_path.c_str(), MAP_TEXT))
+            return false;
+
+        // A change is only reported once the file has been quiet long enough
+        FileWatcher watcher;
+        watcher.Watch(directory);
+        WriteFile(map_path, model_line + "L 0.75 0,-1.4,0\nL 0.5 3,0,0\nO bobber 0,1,0\nO bobber 4,2,0\nO bobber 0,3,0\n");
+        size_t early = watcher.Poll(10).size();
+        size_t quiet = watcher.Poll(10 + FILE_WATCH_DEBOUNCE).size();
+        size_t again = watcher.Poll(20).size();
+        bool debounced = early == 0 && quiet == 1 && again == 0;
+
+        auto start = chrono::steady_clock::now();
+        bool patched = world.Patch(map_path.c_str());
+        double patch_us = Microseconds(start);
+        patched &= world.light_manager.light_count == 2 && world.object_manager.object_count == 3;
+
+        // Moving a model needs the collision scene built again, the caller loads the map instead
+        WriteFile(map_path, string("M ") + model_path + " 0,-4,0\nL 0.75 0,-1.4,0\n");
+        bool refused = !world.Patch(map_path.c_str()) && world.object_manager.object_count == 3;
+
+        // Reload the world model as a hot reload does, without the upload
+        unsigned int chunk_count = world.chunks.size();
+        Model old;
+        start = chrono::steady_clock::now();
+        bool reloaded = assets.ReloadModel(model_path, &old, [&](Model * model) {
+            Mesh mesh;
+            if(!ObjLoader::Load(model_path, &mesh))
+                return false;
+            vector<Mesh> chunks = MeshChunks::Split(mesh);
+            ObjLoader::Unload(mesh);
+            *model = MeshChunks::ToModel(chunks);
+            return true;
+        });
+        const Model & loaded = assets.assets.at(model_path).model;
+        world.RefreshModel(old, loaded);
+        double reload_ms = Microseconds(start) / 1000;
+        reloaded &= world.models[0].meshes == loaded.meshes && world.chunks.size() == chunk_count;
+
+        cout << "BENCH: hot reload '" << model_path << "'\n";
+        cout << "  watcher:     " << (debounced ? "debounced" : "not debounced (bad)") << "\n";
+        cout << "  map patch:   " << (patched ? "applied" : "not applied (bad)") << " in " << patch_us << " us, model edit "
+             << (refused ? "refused" : "patched (bad)") << "\n";
+        cout << "  model:       " << (reloaded ? "reloaded" : "not reloaded (bad)") << " in " << reload_ms << " ms, "
+             << world.chunks.size() << " chunks\n";
+
+        world.Reset();
+        assets.Clear();
+        remove(map_path.c_str());
+        return debounced && patched && refused && reloaded;
+    }
+};
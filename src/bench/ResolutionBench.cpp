@@ -0,0 +1,59 @@
+#pragma once
+
+// Drives the dynamic resolution controller with modelled frame times, a fixed CPU cost plus a GPU
+// cost that goes with the pixel count, through a light room, a heavy one and back. With vsync the
+// frame times are rounded up to whole refreshes. The scale has to settle in the heavy room without
+// frames staying over budget, and come back to full once it is light again.
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "render/DynamicResolution.cpp"
+
+using namespace std;
+
+namespace Bench {
+    struct ResolutionPhase {
+        unsigned int frames;
+        unsigned int changes;
+        // Frames over the budget after the first second, once the scale had time to settle
+        unsigned int over;
+        float scale;
+    };
+
+    bool DynamicScaling(bool vsync, int frames = 1200) {
+        DynamicResolution dynamic;
+        srand(24);
+
+        // Milliseconds at full scale
+        float cpu_ms = 4;
+        auto phase = [&](float gpu_ms) {
+            ResolutionPhase result = {(unsigned int)frames, dynamic.changes, 0, 0};
+            for(int i = 0; i < frames; ++i) {
+                float jitter = 1 + (rand() % 101 - 50) / 1000.0f;
+                float frame_ms = (cpu_ms + gpu_ms * dynamic.Scale() * dynamic.Scale()) * jitter;
+                if(vsync)
+                    frame_ms = ceilf(frame_ms / dynamic.budget_ms - 0.01f) * dynamic.budget_ms;
+                result.over += i >= 60 && frame_ms > dynamic.budget_ms * DYNRES_DROP;
+                dynamic.Update(frame_ms);
+            }
+            result.changes = dynamic.changes - result.changes;
+            result.scale = dynamic.Scale();
+            return result;
+        };
+
+        ResolutionPhase light = phase(8);
+        ResolutionPhase heavy = phase(24);
+        ResolutionPhase after = phase(8);
+
+        cout << "BENCH: dynamic resolution, " << (vsync ? "vsync" : "no vsync") << ", " << dynamic.budget_ms << " ms budget\n";
+        for(auto & entry : {make_pair("light", light), make_pair("heavy", heavy), make_pair("light again", after)}) {
+            const ResolutionPhase & result = entry.second;
+            cout << "  " << entry.first << ": scale " << result.scale << ", " << result.changes << " changes, " << result.over << " of "
+                 << result.frames << " frames over budget after the first second\n";
+        }
+        return light.scale == dynamic.max_scale && light.changes == 0 && heavy.scale < dynamic.max_scale
+            && heavy.over < (unsigned int)frames / 20 && after.scale == dynamic.max_scale;
+    }
+};
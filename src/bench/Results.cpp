@@ -0,0 +1,84 @@
+#pragma once
+
+// Timing samples of the regression benchmarks, summarised as min, median and 99th percentile and
+// written as JSON (bench <suite> --json <path>) so runs on two commits can be diffed
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+
+using namespace std;
+
+struct BenchResult {
+    string name;
+    unsigned int samples;
+    double min, median, p99, mean;
+};
+
+namespace Bench {
+    vector<BenchResult> results;
+
+    // Summarise the samples (microseconds) of one benchmark and print them
+    void Report(const string & name, vector<double> samples) {
+        if(samples.empty())
+            return;
+
+        sort(samples.begin(), samples.end());
+        BenchResult result;
+        result.name = name;
+        result.samples = samples.size();
+        result.min = samples.front();
+        result.median = samples[samples.size() / 2];
+        // Nearest rank, the largest sample below 100 samples
+        result.p99 = samples[(size_t)ceil(samples.size() * 0.99) - 1];
+        result.mean = 0;
+        for(double sample : samples)
+            result.mean += sample;
+        result.mean /= samples.size();
+        results.push_back(result);
+
+        cout << "  " << name << ": " << result.min << " us min, " << result.median << " us median, " << result.p99 << " us p99 ("
+             << result.samples << " samples)\n";
+    }
+
+    // Time body once per sample after a few untimed runs to warm the caches
+    template<typename Body>
+    vector<double> Sample(int count, Body body, int warmup = 3) {
+        for(int i = 0; i < warmup; ++i)
+            body(i);
+
+        vector<double> samples;
+        for(int i = 0; i < count; ++i) {
+            auto start = chrono::steady_clock::now();
+            body(i);
+            samples.push_back(Microseconds(start));
+        }
+        return samples;
+    }
+
+    // One result per line, so two runs diff cleanly
+    bool WriteResults(const char * path) {
+        ofstream file(path);
+        if(!file.is_open()) {
+            cout << "ERROR: BENCH: Could not write '" << path << "'\n";
+            return false;
+        }
+
+        file << "{\"unit\": \"us\", \"results\": [\n";
+        for(unsigned int i = 0; i < results.size(); ++i) {
+            const BenchResult & result = results[i];
+            file << "  {\"name\": \"" << result.name << "\", \"samples\": " << result.samples << ", \"min\": " << result.min
+                 << ", \"median\": " << result.median << ", \"p99\": " << result.p99 << ", \"mean\": " << result.mean << "}"
+                 << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "]}\n";
+        cout << "INFO: BENCH: Wrote " << results.size() << " results to '" << path << "'\n";
+        return file.good();
+    }
+};
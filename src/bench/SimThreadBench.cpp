@@ -0,0 +1,170 @@
+#pragma once
+
+// Ticks a headless map on the simulation thread while this thread stands in for the renderer.
+// Checks the threaded ticks end up bit for bit where ticking on one thread does, that the
+// snapshots read while the simulation runs are whole and in order and that a pause holds it,
+// then times frames with as much drawing work as ticking work, one after the other and at once.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bench/CollisionBench.cpp"
+#include "bench/DemoBench.cpp"
+#include "object/GameObject.cpp"
+#include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "world/SimThread.cpp"
+#include "world/Timestep.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // A world with extra objects for the ticks to work on, ticked by a SimThread
+    struct SimBench {
+        Player player = Player({0, 10, 0.1});
+        AssetCache assets = AssetCache(true);
+        World world = World(NULL, &player, &assets);
+        Timestep timestep = Timestep(60);
+        SimThread sim = SimThread(&world, &player, &timestep);
+
+        bool Load(const char * filename, int objects) {
+            world.object_manager.RegisterScripts("resources/scripts");
+            if(!world.Load(filename))
+                return false;
+            world.object_manager.RegisterType(GameObject());
+            srand(objects);
+            float extent = cbrtf(objects) * 2;
+            for(int i = 0; i < objects; ++i) {
+                world.object_manager.Create("GameObject", "object", {Random(-extent, extent), Random(0, extent), Random(-extent, extent)}, {0});
+                world.object_manager.collision_levels.back() = GLOBAL_COLLISION;
+            }
+            return true;
+        }
+
+        // The input of tick i, the same for every run
+        static PlayerInput Input(int i) {
+            PlayerInput input;
+            input.axis = {(float)(i / 40 % 3 - 1), (float)(i / 25 % 3 - 1)};
+            input.jump = i % 90 == 0;
+            input.look = {sinf(i * 0.1f) * 10, cosf(i * 0.07f) * 3};
+            return input;
+        }
+    };
+
+    bool SimThreadTicks(const char * filename, int objects = 2000, int ticks = 300) {
+        // Every tick on this thread, then the same input ticked on the simulation thread
+        unique_ptr<SimBench> inline_run(new SimBench());
+        unique_ptr<SimBench> threaded(new SimBench());
+        if(!inline_run->Load(filename, objects) || !threaded->Load(filename, objects))
+            return false;
+
+        inline_run->sim.SetLockstep(true);
+        threaded->sim.SetLockstep(true);
+        threaded->sim.Start();
+        double inline_us = 0, threaded_us = 0;
+        for(int i = 0; i < ticks; ++i) {
+            auto start = chrono::steady_clock::now();
+            inline_run->sim.Input(SimBench::Input(i));
+            inline_run->sim.Step();
+            inline_us += Microseconds(start);
+
+            start = chrono::steady_clock::now();
+            threaded->sim.Input(SimBench::Input(i));
+            threaded->sim.Step();
+            threaded->sim.WaitStep();
+            threaded_us += Microseconds(start);
+        }
+        vector<float> expected = DemoState(inline_run->player, inline_run->world.object_manager);
+        vector<float> state = DemoState(threaded->player, threaded->world.object_manager);
+        bool identical = state.size() == expected.size() && !memcmp(state.data(), expected.data(), state.size() * sizeof(float));
+
+        // Free running at 60 ticks per second, read like the frames would. Nothing spawns or is
+        // deleted, so every snapshot holds as many instances as the objects with a model.
+        vector<ObjectInstance> instances;
+        inline_run->world.object_manager.Snapshot(&instances);
+        threaded->sim.SetLockstep(false);
+        unsigned int reads = 0, torn = 0, backwards = 0;
+        unsigned long last_tick = 0;
+        auto start = chrono::steady_clock::now();
+        while(Microseconds(start) < 300000) {
+            threaded->sim.snapshots.Acquire();
+            const RenderSnapshot & snapshot = threaded->sim.snapshots.Front();
+            backwards += snapshot.tick < last_tick;
+            last_tick = snapshot.tick;
+            torn += snapshot.objects.size() != instances.size();
+            ++reads;
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        unsigned long free_ticks = last_tick - ticks;
+
+        threaded->sim.Pause();
+        unsigned long paused_tick = threaded->timestep.tick;
+        this_thread::sleep_for(chrono::milliseconds(50));
+        bool held = threaded->timestep.tick == paused_tick;
+        threaded->sim.Resume();
+        threaded->sim.Stop();
+
+        cout << "BENCH: simulation thread '" << filename << "', " << threaded->world.object_manager.object_count << " objects, " << ticks << " ticks\n";
+        cout << "  lockstep:    " << (identical ? "identical to one thread" : "diverged from one thread (bad)") << ", "
+             << inline_us / ticks << " us/tick inline, " << threaded_us / ticks << " us/tick handed over\n";
+        cout << "  free:        " << free_ticks << " ticks in 300 ms, " << reads << " snapshots read, " << backwards << " out of order, "
+             << torn << " incomplete\n";
+        cout << "  pause:       " << (held ? "held" : "kept ticking (bad)") << "\n";
+        return identical && backwards == 0 && torn == 0 && held && free_ticks > 0;
+    }
+
+    // Frames of one tick plus as long again of stand-in drawing, one after the other and with the
+    // tick on the simulation thread. With a core for each the second should take about half as long.
+    bool SimThreadOverlap(const char * filename, int objects = 4000, int frames = 120) {
+        unique_ptr<SimBench> bench(new SimBench());
+        if(!bench->Load(filename, objects))
+            return false;
+        bench->sim.SetLockstep(true);
+
+        auto draw = [](double us) {
+            auto start = chrono::steady_clock::now();
+            volatile float sink = 0;
+            while(Microseconds(start) < us)
+                sink = sink + 1;
+        };
+
+        // Warm up and measure what a tick costs
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < 20; ++i)
+            bench->sim.Step();
+        double tick_us = Microseconds(start) / 20;
+
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < frames; ++i) {
+            bench->sim.Step();
+            draw(tick_us);
+        }
+        double serial_us = Microseconds(start) / frames;
+
+        bench->sim.Start();
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < frames; ++i) {
+            bench->sim.Step();
+            draw(tick_us);
+            bench->sim.WaitStep();
+        }
+        double overlapped_us = Microseconds(start) / frames;
+        bench->sim.Stop();
+
+        unsigned int cores = thread::hardware_concurrency();
+        cout << "BENCH: simulation overlap, " << tick_us << " us per tick and per draw, " << cores << " cores\n";
+        cout << "  one thread:  " << serial_us << " us/frame\n";
+        cout << "  two threads: " << overlapped_us << " us/frame (" << overlapped_us / serial_us * 100 << "%)\n";
+        // A single core cannot overlap, it only has to not be much slower
+        return cores > 1 ? overlapped_us < serial_us * 0.8 : overlapped_us < serial_us * 1.25;
+    }
+};
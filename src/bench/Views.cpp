@@ -0,0 +1,37 @@
+#pragma once
+
+// Random cameras over a headless world, for the culling benchmarks
+#include <raylib.h>
+#include <raymath.h>
+#include <float.h>
+#include <math.h>
+
+#include "bench/LightBench.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+namespace Bench {
+    // The box around every world chunk
+    BoundingBox ChunkExtent(const World & world) {
+        BoundingBox extent = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+        for(unsigned int i = 0; i < world.chunks.size(); ++i) {
+            BoundingBox box = world.chunk_bounds.Get(i);
+            extent.min = Vector3Min(extent.min, box.min);
+            extent.max = Vector3Max(extent.max, box.max);
+        }
+        return extent;
+    }
+
+    // A camera somewhere in extent looking any way but straight up or down, from rand()
+    Camera3D RandomView(BoundingBox extent) {
+        Camera3D camera = {0};
+        camera.up = {0, 1, 0};
+        camera.fovy = 60;
+        camera.projection = CAMERA_PERSPECTIVE;
+        camera.position = {Random(extent.min.x, extent.max.x), Random(extent.min.y, extent.max.y), Random(extent.min.z, extent.max.z)};
+        float yaw = Random(0, 2 * PI), pitch = Random(-1.4f, 1.4f);
+        camera.target = Vector3Add(camera.position, {sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch)});
+        return camera;
+    }
+};
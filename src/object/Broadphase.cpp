@@ -0,0 +1,169 @@
+#pragma once
+
+// Spatial hash broadphase for object collision. Objects are kept in the uniform grid cells their
+// bounds cover and only move between cells when those change, so a mostly static scene costs
+// almost nothing to update. Overlapping pairs are reported once each per call to FindPairs.
+#include <raylib.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "system/JobSystem.cpp"
+
+// Edge length of a grid cell, around the size of a typical object
+#define BROADPHASE_CELL_SIZE 2.0f
+
+using namespace std;
+
+class Broadphase {
+    public:
+    float cell_size;
+    // Result of the last FindPairs, lower index first and sorted
+    vector<pair<unsigned int, unsigned int>> pairs;
+
+    Broadphase(float cell_size = BROADPHASE_CELL_SIZE) {
+        this->cell_size = cell_size;
+    }
+
+    void Clear() {
+        cells.clear();
+        proxies.clear();
+        pairs.clear();
+    }
+
+    // Place an object by its world bounds, only touches the grid when its cell range changed
+    void Update(unsigned int index, BoundingBox bounds) {
+        if(index >= proxies.size())
+            proxies.resize(index + 1);
+
+        Proxy & proxy = proxies[index];
+        proxy.bounds = bounds;
+
+        int lo[3], hi[3];
+        CellRange(bounds, lo, hi);
+        if(proxy.active && equal(lo, lo + 3, proxy.lo) && equal(hi, hi + 3, proxy.hi))
+            return;
+
+        if(proxy.active)
+            Unlink(index);
+        copy(lo, lo + 3, proxy.lo);
+        copy(hi, hi + 3, proxy.hi);
+        proxy.active = true;
+        ForEachCell(proxy, [&](uint64_t key) {
+            cells[key].push_back(index);
+        });
+    }
+
+    void Remove(unsigned int index) {
+        if(index >= proxies.size() || !proxies[index].active)
+            return;
+        Unlink(index);
+        proxies[index].active = false;
+    }
+
+    // Collect every overlapping pair accepted by filter(a, b), a < b. With jobs the cells are tested
+    // in parallel groups, so the filter has to be safe to call from several threads.
+    template<typename Filter>
+    void FindPairs(Filter filter, JobSystem * jobs = NULL) {
+        pairs.clear();
+        if(jobs == NULL || jobs->ThreadCount() == 1) {
+            for(auto & cell : cells)
+                TestCell(cell, filter, &pairs);
+        }
+        else {
+            cell_list.clear();
+            for(auto & cell : cells)
+                cell_list.push_back(&cell);
+
+            unsigned int groups = jobs->ThreadCount() * 4;
+            group_pairs.resize(groups);
+            jobs->ParallelFor(groups, 1, [&](unsigned int begin, unsigned int end) {
+                for(unsigned int group = begin; group < end; ++group) {
+                    group_pairs[group].clear();
+                    size_t first = cell_list.size() * group / groups, last = cell_list.size() * (group + 1) / groups;
+                    for(size_t i = first; i < last; ++i)
+                        TestCell(*cell_list[i], filter, &group_pairs[group]);
+                }
+            });
+            for(auto & group : group_pairs)
+                pairs.insert(pairs.end(), group.begin(), group.end());
+        }
+
+        // Hash order is arbitrary, keep the delivery order deterministic
+        sort(pairs.begin(), pairs.end());
+    }
+
+    private:
+    struct Proxy {
+        BoundingBox bounds;
+        int lo[3], hi[3];
+        bool active = false;
+    };
+
+    vector<Proxy> proxies;
+    unordered_map<uint64_t, vector<unsigned int>> cells;
+
+    // Scratch for the parallel FindPairs
+    vector<pair<const uint64_t, vector<unsigned int>> *> cell_list;
+    vector<vector<pair<unsigned int, unsigned int>>> group_pairs;
+
+    template<typename Filter>
+    void TestCell(const pair<const uint64_t, vector<unsigned int>> & cell, Filter & filter, vector<pair<unsigned int, unsigned int>> * out) {
+        const vector<unsigned int> & members = cell.second;
+        for(unsigned int i = 0; i < members.size(); ++i) {
+            for(unsigned int j = i + 1; j < members.size(); ++j) {
+                unsigned int a = min(members[i], members[j]), b = max(members[i], members[j]);
+                const Proxy & pa = proxies[a];
+                const Proxy & pb = proxies[b];
+
+                // Pairs sharing several cells are only reported from the first cell they share
+                if(Key(max(pa.lo[0], pb.lo[0]), max(pa.lo[1], pb.lo[1]), max(pa.lo[2], pb.lo[2])) != cell.first)
+                    continue;
+                if(!CheckCollisionBoxes(pa.bounds, pb.bounds) || !filter(a, b))
+                    continue;
+                out->push_back({a, b});
+            }
+        }
+    }
+
+    static uint64_t Key(int x, int y, int z) {
+        return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) | (uint64_t)(z & 0x1FFFFF);
+    }
+
+    void CellRange(BoundingBox bounds, int * lo, int * hi) {
+        float min[3] = {bounds.min.x, bounds.min.y, bounds.min.z};
+        float max[3] = {bounds.max.x, bounds.max.y, bounds.max.z};
+        for(int axis = 0; axis < 3; ++axis) {
+            lo[axis] = (int)floorf(min[axis] / cell_size);
+            hi[axis] = std::max(lo[axis], (int)floorf(max[axis] / cell_size));
+        }
+    }
+
+    template<typename Visit>
+    void ForEachCell(const Proxy & proxy, Visit visit) {
+        for(int x = proxy.lo[0]; x <= proxy.hi[0]; ++x)
+            for(int y = proxy.lo[1]; y <= proxy.hi[1]; ++y)
+                for(int z = proxy.lo[2]; z <= proxy.hi[2]; ++z)
+                    visit(Key(x, y, z));
+    }
+
+    void Unlink(unsigned int index) {
+        ForEachCell(proxies[index], [&](uint64_t key) {
+            auto cell = cells.find(key);
+            if(cell == cells.end())
+                return;
+            vector<unsigned int> & members = cell->second;
+            auto member = find(members.begin(), members.end(), index);
+            if(member != members.end()) {
+                *member = members.back();
+                members.pop_back();
+            }
+            if(members.empty())
+                cells.erase(cell);
+        });
+    }
+};
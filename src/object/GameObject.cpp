@@ -18,6 +18,19 @@
 
 using namespace std;
 
+// Stable reference to an object, deleting the object invalidates every handle to it
+struct ObjectHandle {
+    unsigned int index = 0;
+    // Generation 0 is never used, so a default handle is always invalid
+    unsigned int generation = 0;
+
+    bool operator==(const ObjectHandle & other) const {
+        return index == other.index && generation == other.generation;
+    }
+};
+
+// Per object data the manager does not touch every tick (position, bounds and collision level
+// live in the manager's arrays, the values here are the defaults for new objects of the type)
 class GameObject {
     public:
     // Flags
@@ -27,35 +40,40 @@ class GameObject {
     string name;
     string type = "GameObject";
     
-    // ID is unique per object instance
-    unsigned int id;
+    // Handle is unique per object instance
+    ObjectHandle handle;
+
+    // Index of the Lua script that runs the type, -1 for native types (see ScriptHost)
+    int script = -1;
 
-    // When setting the objects bounds, use "local_bounds" since "bounds" is calculated by the object manager
-    BoundingBox bounds, local_bounds;
+    // Bounds around the object position, copied to the manager on creation
+    BoundingBox local_bounds = {{0}, {0}};
 
-    // The current position of the object
-    Vector3 position;
+    // Model drawn at the object (a path, empty for none) and its index in the manager once loaded
+    string model;
+    int model_index = -1;
+    float model_scale = 1;
 
     // Rotation is not used by the object manager and is purely for the object to utilize
     Vector3 rotation;
 
     // OnStart runs once on the object initilisation
-    void OnStart();
+    void OnStart() {}
 
     // OnDelete runs once on the object deletion
-    void OnDelete();
+    void OnDelete() {}
 
-    // Update runs once per frame for object logic
-    void Update(float deltat);
+    // Update runs once per simulation tick for object logic
+    void Update(float deltat) {}
 
     // Render runs once per frame to draw the object
-    void Render(float deltat, Renderer * renderer);
+    void Render(float deltat, Renderer * renderer) {}
 
     // On collide is triggered when two GameObjects overlap their collision boxes
-    void OnCollide(GameObject * object);
+    void OnCollide(GameObject * object) {}
 
     // On collide (player) is triggered if the GameObject collides with the player
-    void OnCollide(Player * object);
+    void OnCollide(Player * object) {}
 
     GameObject(){}
 };
\ No newline at end of file
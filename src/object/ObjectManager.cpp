@@ -1,177 +1,510 @@
+#pragma once
+
+#include <raylib.h>
+#include <raymath.h>
+
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include <map>
-#include <LuaCpp/LuaCpp.hpp>
 
 #include "object/GameObject.cpp"
+#include "object/Broadphase.cpp"
+#include "object/ScriptHost.cpp"
 #include "player/Player.cpp"
+#include "render/AssetCache.cpp"
+#include "render/Frustum.cpp"
+#include "render/InstanceBatcher.cpp"
+#include "system/JobSystem.cpp"
+#include "system/Profiler.cpp"
 
-using namespace LuaCpp;
-using namespace LuaCpp::Registry;
-using namespace LuaCpp::Engine;
+// Objects per job in the parallel passes
+#define OBJECT_JOB_CHUNK 512
 
 using namespace std;
 
+// An object as the renderer draws it, captured from the simulation so it can be drawn while the next tick runs
+struct ObjectInstance {
+    int model;
+    // Culling sphere around position
+    float radius;
+    Vector3 position;
+    Matrix transform;
+};
+
 class ObjectManager {
     private:
     map<string, GameObject> types;
-    
-    // Objects with partner collision
-    vector<GameObject*> collidable;
+
+    // Slot map, a handle's index picks a slot which points at the object's place in the packed arrays
+    struct Slot {
+        unsigned int dense = 0;
+        unsigned int generation = 1;
+    };
+    vector<Slot> slots;
+    vector<unsigned int> free_slots;
+    // Slot of each packed object
+    vector<unsigned int> dense_slots;
 
     public:
     unsigned int object_count = 0;
+
+    // Hot fields, packed so the per tick passes walk contiguous memory (index 0 .. object_count - 1)
+    vector<Vector3> positions;
+    vector<BoundingBox> local_bounds;
+    // World space bounds, calculated by Update from position and local bounds
+    vector<BoundingBox> bounds;
+    vector<int> collision_levels;
+
+    // Cold data in the same packed order
     vector<GameObject> objects;
 
+    // Every object that collides with other objects, keyed by slot so entries survive deletes
+    Broadphase broadphase;
+
+    // Lua object types
+    ScriptHost scripts;
+
+    // Spreads the per object passes over several threads, NULL runs them all on the caller
+    JobSystem * jobs = NULL;
+
+    // Models of the types that have one, shared by every object of the type
+    vector<Model> models;
+    // Radius around the object position each model fits in at any rotation, for culling
+    vector<float> model_radii;
+    // Objects drawn and culled by the last Render
+    unsigned int objects_drawn = 0, objects_culled = 0;
+    // Bumped when the models or the objects are replaced wholesale, instances from a Snapshot
+    // taken before index models and objects that are gone
+    unsigned int revision = 0;
+
+    ObjectManager() {
+        scripts.positions = &positions;
+        scripts.objects = &objects;
+        scripts.resolve = [this](ObjectHandle handle) {
+            return IndexOf(handle);
+        };
+    }
+
     void RegisterType(GameObject object) {
         cout << "INFO: OBJECT: Registered new object type '" << object.type << "'\n";
         types.insert({object.type, object});
     }
 
-    void Create(string type, string name, Vector3 position, Vector3 rotation) {
+    // Register the type a Lua script defines, named after the script's file
+    bool RegisterScript(const char * path) {
+        GameObject type;
+        if(!scripts.Load(path, &type))
+            return false;
+        RegisterType(type);
+        return true;
+    }
+
+    // Register every script in a directory, in name order, returns how many loaded
+    int RegisterScripts(const char * directory) {
+        if(!DirectoryExists(directory))
+            return 0;
+
+        FilePathList files = LoadDirectoryFiles(directory);
+        vector<string> paths;
+        for(unsigned int i = 0; i < files.count; ++i) {
+            if(IsFileExtension(files.paths[i], ".lua"))
+                paths.push_back(files.paths[i]);
+        }
+        UnloadDirectoryFiles(files);
+        sort(paths.begin(), paths.end());
+
+        int loaded = 0;
+        for(string path : paths)
+            loaded += RegisterScript(path.c_str());
+        cout << "INFO: OBJECT: Loaded " << loaded << " scripts (" << scripts.cache_hits << " from the bytecode cache)\n";
+        return loaded;
+    }
+
+    // Load the model of every type that names one through the cache, setup runs on each model so
+    // the caller can give it its shader and textures. Returns how many loaded.
+    int AcquireModels(AssetCache * assets, function<void (Model *)> setup) {
+        ReleaseModels();
+        this->assets = assets;
+
+        map<string, int> loaded;
+        for(auto & entry : types) {
+            GameObject & type = entry.second;
+            if(type.model.empty())
+                continue;
+
+            // Types sharing a model share the index, so their objects batch together
+            if(loaded.count(type.model) == 0) {
+                Model model;
+                if(!assets->AcquireModel(type.model, &model)) {
+                    cout << "WARNING: OBJECT: Could not load model '" << type.model << "' for type '" << type.type << "'\n";
+                    continue;
+                }
+                setup(&model);
+
+                loaded[type.model] = models.size();
+                models.push_back(model);
+                model_radii.push_back(Radius(model));
+                model_keys.push_back(type.model);
+            }
+            type.model_index = loaded[type.model];
+        }
+
+        for(GameObject & object : objects)
+            object.model_index = types.at(object.type).model_index;
+        ++revision;
+        cout << "INFO: OBJECT: Loaded " << models.size() << " object models\n";
+        return models.size();
+    }
+
+    // Hand the models back to the cache (GPU assets need the window still open)
+    void ReleaseModels() {
+        for(string key : model_keys)
+            assets->Release(key);
+        model_keys.clear();
+        models.clear();
+        model_radii.clear();
+        for(auto & entry : types)
+            entry.second.model_index = -1;
+        for(GameObject & object : objects)
+            object.model_index = -1;
+        ++revision;
+    }
+
+    // A cached model was reloaded, copies of old draw the new meshes with their own materials
+    void RefreshModel(const Model & old, const Model & loaded) {
+        for(unsigned int i = 0; i < models.size(); ++i) {
+            if(models[i].meshes != old.meshes)
+                continue;
+            models[i].meshCount = loaded.meshCount;
+            models[i].meshes = loaded.meshes;
+            models[i].meshMaterial = loaded.meshMaterial;
+            model_radii[i] = Radius(models[i]);
+        }
+    }
+
+    bool HasType(string type) {
+        return types.find(type) != types.end();
+    }
+
+    void Reserve(unsigned int count) {
+        positions.reserve(count);
+        local_bounds.reserve(count);
+        bounds.reserve(count);
+        collision_levels.reserve(count);
+        objects.reserve(count);
+        dense_slots.reserve(count);
+        slots.reserve(count);
+    }
+
+    ObjectHandle Create(string type, string name, Vector3 position, Vector3 rotation) {
+        // Reuse a free slot, its generation was bumped when it was freed
+        unsigned int slot;
+        if(!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        else {
+            slot = slots.size();
+            slots.push_back(Slot());
+        }
+        slots[slot].dense = object_count;
+
         // Clone the object template
         GameObject obj = types.at(type);
 
         // Initialise the values
         obj.name = name;
-        obj.position = position;
         obj.rotation = rotation;
-        obj.id = object_count;
-
-        // Trigger the OnStart method
-        obj.OnStart();
+        obj.handle = {slot, slots[slot].generation};
 
-        // Add the obj
+        positions.push_back(position);
+        local_bounds.push_back(obj.local_bounds);
+        bounds.push_back({Vector3Add(obj.local_bounds.min, position), Vector3Add(obj.local_bounds.max, position)});
+        collision_levels.push_back(obj.collision_level);
+        dense_slots.push_back(slot);
         objects.push_back(obj);
-        if(obj.collision_level == PARTNER_COLLISION)
-            collidable.push_back(&objects[object_count]);
 
         // Update the object counter
         object_count = objects.size();
+
+        // Trigger the OnStart method
+        if(obj.script >= 0)
+            scripts.Start(obj.script, obj.handle);
+        else
+            objects.back().OnStart();
+        return obj.handle;
+    }
+
+    bool Valid(ObjectHandle handle) {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+
+    // Packed index of a live object, -1 once it has been deleted
+    int IndexOf(ObjectHandle handle) {
+        return Valid(handle) ? slots[handle.index].dense : -1;
+    }
+
+    GameObject * Get(ObjectHandle handle) {
+        return Valid(handle) ? &objects[slots[handle.index].dense] : NULL;
     }
 
-    void Delete(unsigned int id) {
-        // Delete the element
-        objects.at(id).OnDelete();
-        objects.erase(objects.begin() - 1 + id);
+    bool Delete(ObjectHandle handle) {
+        if(!Valid(handle))
+            return false;
+
+        unsigned int index = slots[handle.index].dense;
+        if(objects[index].script >= 0)
+            scripts.Delete(objects[index].script, handle);
+        else
+            objects[index].OnDelete();
+        broadphase.Remove(handle.index);
 
-        // Remove from collidable list
-        for(int i = 0; i < collidable.size(); ++i) {
-            if(collidable[i]->id == id)
-                collidable.erase(collidable.begin() - 1 + i);
+        // Move the last object into the gap so the arrays stay packed
+        unsigned int last = object_count - 1;
+        if(index != last) {
+            positions[index] = positions[last];
+            local_bounds[index] = local_bounds[last];
+            bounds[index] = bounds[last];
+            collision_levels[index] = collision_levels[last];
+            objects[index] = objects[last];
+            dense_slots[index] = dense_slots[last];
+            slots[dense_slots[index]].dense = index;
         }
+        positions.pop_back();
+        local_bounds.pop_back();
+        bounds.pop_back();
+        collision_levels.pop_back();
+        objects.pop_back();
+        dense_slots.pop_back();
 
-        // Update the other element ids
-        for(int i = 0; i < objects.size(); ++i)
-            objects[i].id = i;
+        // Outstanding handles to the slot go stale
+        if(++slots[handle.index].generation == 0)
+            slots[handle.index].generation = 1;
+        free_slots.push_back(handle.index);
 
         // Update the object counter
         object_count = objects.size();
+        return true;
+    }
+
+    void Clear() {
+        // Scripts drop whatever they keep per object
+        for(unsigned int i = 0; i < object_count; ++i) {
+            if(objects[i].script >= 0)
+                scripts.Delete(objects[i].script, objects[i].handle);
+        }
+        scripts.spawns.clear();
+        scripts.deletes.clear();
+
+        // Slots are kept so handles from before the clear stay invalid
+        for(unsigned int slot : dense_slots) {
+            if(++slots[slot].generation == 0)
+                slots[slot].generation = 1;
+            free_slots.push_back(slot);
+        }
+
+        positions.clear();
+        local_bounds.clear();
+        bounds.clear();
+        collision_levels.clear();
+        objects.clear();
+        dense_slots.clear();
+        broadphase.Clear();
+        object_count = 0;
+        ++revision;
+    }
+
+    // Whether an object reacts to touching another (the player is handled separately)
+    static bool Responds(int level, int other_level) {
+        switch(level) {
+            // Partner collision only reacts to objects with the same collision level
+            case PARTNER_COLLISION:
+                return other_level == PARTNER_COLLISION;
+            // Global collision reacts to all objects
+            case GLOBAL_COLLISION:
+                return true;
+        }
+        return false;
     }
 
+    // Work is split across jobs when set, callbacks always run on the calling thread in object order
+    // so the outcome does not depend on the thread count
     void Update(float deltat, Player * player) {
-        bool collision;
-        for(int i = 0; i < objects.size(); ++i) {
-            objects[i].Update(deltat);
-
-            // Calculate the bounds of the object
-            objects[i].bounds = {
-                {
-                    objects[i].local_bounds.min.x + objects[i].position.x, 
-                    objects[i].local_bounds.min.y + objects[i].position.y, 
-                    objects[i].local_bounds.min.z + objects[i].position.z
-                },
-                {
-                    objects[i].local_bounds.max.x + objects[i].position.x, 
-                    objects[i].local_bounds.max.y + objects[i].position.y, 
-                    objects[i].local_bounds.max.z + objects[i].position.z
-                }
-            };
+        PROFILE_ZONE("ObjectManager::Update");
+        // Native types update in parallel chunks and may only touch their own object
+        For(OBJECT_JOB_CHUNK, [&](unsigned int begin, unsigned int end) {
+            for(unsigned int i = begin; i < end; ++i) {
+                if(objects[i].script < 0)
+                    objects[i].Update(deltat);
+            }
+        });
 
-            // Early continue to save time if no collision
-            if(objects[i].collision_level == NO_COLLISION)
-                continue;
-            
-            collision = false;
-            GameObject * collide_obj;
-
-            GameObject player_obj;
-            player_obj.type = "Player";
-
-            switch(objects[i].collision_level) {
-                // Player collision only checks collisions with the player
-                case PLAYER_COLLISION:
-                    // Create dummy player object
-                    collide_obj = &player_obj;
-
-                    // Check feet collider
-                    collision = CheckCollisionBoxes(player->feet, objects[i].bounds);
-                    if(collision)
-                        collide_obj->name = "feet";
-                    
-                    // Check body collider
-                    collision = CheckCollisionBoxes(player->bounds, objects[i].bounds);
-                    if(collision)
-                        collide_obj->name = "body";
-                    break;
-
-                // Partner collision only checks collisions with the same collision level
-                case PARTNER_COLLISION:
-                    // Check the objects in the collidable buffer
-                    for(GameObject * object : collidable) {
-                        if(CheckCollisionBoxes(object->bounds, objects[i].bounds)) {
-                            collision = true;
-                            collide_obj = object;
-                            break;
-                        }
-                    }
-                    break;
-
-                // Global collision checks collision with all objects
-                case GLOBAL_COLLISION:
-                    // Check all the objects
-                    for(GameObject object : objects) {
-                        if(CheckCollisionBoxes(object.bounds, objects[i].bounds)) {
-                            collision = true;
-                            collide_obj = &object;
-                            break;
-                        }
-                    }
-
-                    // Global collision also applies to the player
-                    if(!collision) {
-                        collision = CheckCollisionBoxes(player->bounds, objects[i].bounds);
-                        collide_obj = &player_obj;
-                    }
-                    break;
+        // Scripted types get one call with all of their objects, the Lua state is single threaded
+        for(unsigned int i = 0; i < object_count; ++i) {
+            if(objects[i].script >= 0)
+                scripts.scripts[objects[i].script].batch.push_back(objects[i].handle);
+        }
+        scripts.player = player;
+        scripts.Update(deltat);
+
+        // Calculate the bounds of every object and find what touches the player
+        contacts.resize(object_count);
+        For(OBJECT_JOB_CHUNK, [&](unsigned int begin, unsigned int end) {
+            for(unsigned int i = begin; i < end; ++i) {
+                bounds[i].min = Vector3Add(local_bounds[i].min, positions[i]);
+                bounds[i].max = Vector3Add(local_bounds[i].max, positions[i]);
+
+                // Player and global collision also check the player, only player collision objects can be stood on
+                contacts[i] = CONTACT_NONE;
+                if(collision_levels[i] != PLAYER_COLLISION && collision_levels[i] != GLOBAL_COLLISION)
+                    continue;
+                if(CheckCollisionBoxes(player->bounds, bounds[i]))
+                    contacts[i] = CONTACT_BODY;
+                else if(collision_levels[i] == PLAYER_COLLISION && CheckCollisionBoxes(player->feet, bounds[i]))
+                    contacts[i] = CONTACT_FEET;
             }
+        });
 
-            // Trigger collide methods
-            if(collision && collide_obj->type == "Player") {
-                // Trigger player collisions
-                if(collide_obj->name == "feet") {
-                    // Make the player grounded
-                    player->grounded = true;
-                    if(objects[i].bounds.max.y > objects[i].bounds.min.y)
-                        player->position.y = objects[i].bounds.max.y + 0.1f;
-                    else
-                        player->position.y = objects[i].bounds.min.y + 0.1f;
-                }
+        // The grid is shared, objects that never collide stay out of it
+        for(unsigned int i = 0; i < object_count; ++i) {
+            if(collision_levels[i] == NO_COLLISION)
+                broadphase.Remove(dense_slots[i]);
+            else
+                broadphase.Update(dense_slots[i], bounds[i]);
+        }
+
+        for(unsigned int i = 0; i < object_count; ++i) {
+            if(contacts[i] == CONTACT_BODY) {
+                player->OnCollide(bounds[i]);
+                CollidePlayer(i, player);
+            }
+            else if(contacts[i] == CONTACT_FEET) {
+                // Make the player grounded
+                player->grounded = true;
+                if(bounds[i].max.y > bounds[i].min.y)
+                    player->position.y = bounds[i].max.y + 0.1f;
                 else
-                    player->OnCollide(objects[i].bounds);
-                
-                // Trigger the object collision
-                objects[i].OnCollide(player);
+                    player->position.y = bounds[i].min.y + 0.1f;
+                CollidePlayer(i, player);
             }
-            else if(collision)
-                objects[i].OnCollide(collide_obj);
+        }
+
+        // Object pairs (by slot), each overlapping pair is found and delivered once per tick
+        broadphase.FindPairs([&](unsigned int a, unsigned int b) {
+            int level_a = collision_levels[slots[a].dense], level_b = collision_levels[slots[b].dense];
+            return Responds(level_a, level_b) || Responds(level_b, level_a);
+        }, jobs);
+        for(auto pair : broadphase.pairs) {
+            unsigned int a = slots[pair.first].dense, b = slots[pair.second].dense;
+            if(Responds(collision_levels[a], collision_levels[b]))
+                CollideObject(a, b);
+            if(Responds(collision_levels[b], collision_levels[a]))
+                CollideObject(b, a);
+        }
+
+        // Spawns and deletes scripts asked for during the tick
+        for(ObjectHandle handle : scripts.deletes)
+            Delete(handle);
+        scripts.deletes.clear();
+        vector<ScriptSpawn> spawns;
+        spawns.swap(scripts.spawns);
+        for(ScriptSpawn & spawn : spawns) {
+            if(HasType(spawn.type))
+                Create(spawn.type, spawn.name, spawn.position, {0});
+            else
+                cout << "WARNING: OBJECT: Script tried to spawn unknown type '" << spawn.type << "'\n";
+        }
+    }
+
+    // The drawn state of every object with a model, scaled, rotated, then moved to its position
+    void Snapshot(vector<ObjectInstance> * instances) {
+        instances->clear();
+        for(unsigned int i = 0; i < object_count; ++i) {
+            int index = objects[i].model_index;
+            if(index < 0)
+                continue;
+            float scale = objects[i].model_scale;
+            Matrix transform = MatrixMultiply(models[index].transform, MatrixScale(scale, scale, scale));
+            transform = MatrixMultiply(transform, MatrixRotateXYZ(objects[i].rotation));
+            transform = MatrixMultiply(transform, MatrixTranslate(positions[i].x, positions[i].y, positions[i].z));
+            instances->push_back({index, model_radii[index] * fabsf(scale), positions[i], transform});
+        }
+    }
+
+    // Queue the model of every object in view that visible (when set) does not reject by its bounds,
+    // like the PVS or occluders would
+    void Render(const Frustum & frustum, InstanceBatcher * batcher, function<bool (BoundingBox)> visible = NULL) {
+        Snapshot(&scratch);
+        Render(scratch, frustum, batcher, visible);
+    }
+
+    // Same for instances captured by Snapshot, the models have to be the ones they were captured with
+    void Render(const vector<ObjectInstance> & instances, const Frustum & frustum, InstanceBatcher * batcher, function<bool (BoundingBox)> visible = NULL) {
+        objects_drawn = objects_culled = 0;
+        for(const ObjectInstance & instance : instances) {
+            if(instance.model >= (int)models.size())
+                continue;
+            Vector3 reach = {instance.radius, instance.radius, instance.radius};
+            if(!frustum.Contains(instance.position, instance.radius)
+               || (visible && !visible({Vector3Subtract(instance.position, reach), Vector3Add(instance.position, reach)}))) {
+                ++objects_culled;
+                continue;
+            }
+
+            const Model & model = models[instance.model];
+            for(int mesh = 0; mesh < model.meshCount; ++mesh)
+                batcher->Add(model.meshes[mesh], model.materials[model.meshMaterial[mesh]], instance.transform);
+            ++objects_drawn;
         }
     }
 
-    void Render(float deltat, Renderer * renderer) {
-        for(int i = 0; i < objects.size(); ++i) {
-            objects[i].Render(deltat, renderer);
+    private:
+    // Cache the models came from and their keys, released by ReleaseModels
+    AssetCache * assets = NULL;
+    vector<string> model_keys;
+
+    // Distance from the origin of the farthest mesh bound, objects are culled as spheres
+    static float Radius(const Model & model) {
+        float radius = 0;
+        for(int i = 0; i < model.meshCount; ++i) {
+            BoundingBox box = GetMeshBoundingBox(model.meshes[i]);
+            radius = max(radius, Vector3Length(Vector3Max(Vector3Negate(box.min), box.max)));
         }
+        return radius;
+    }
+
+    // How each object touched the player this tick
+    enum Contact : unsigned char {
+        CONTACT_NONE,
+        CONTACT_BODY,
+        CONTACT_FEET
+    };
+    vector<Contact> contacts;
+    // Instances drawn straight from the objects
+    vector<ObjectInstance> scratch;
+
+    // Run body(begin, end) over every object, in chunks when there is a job system
+    template<typename Body>
+    void For(unsigned int chunk, Body body) {
+        if(jobs != NULL)
+            jobs->ParallelFor(object_count, chunk, body);
+        else if(object_count > 0)
+            body(0u, object_count);
+    }
+
+    void CollidePlayer(unsigned int index, Player * player) {
+        if(objects[index].script >= 0)
+            scripts.Collide(objects[index].script, objects[index].handle, ObjectHandle());
+        else
+            objects[index].OnCollide(player);
+    }
+
+    void CollideObject(unsigned int index, unsigned int other) {
+        if(objects[index].script >= 0)
+            scripts.Collide(objects[index].script, objects[index].handle, objects[other].handle);
+        else
+            objects[index].OnCollide(&objects[other]);
     }
 };
\ No newline at end of file
@@ -0,0 +1,556 @@
+#pragma once
+
+// Object types written in Lua. Every script in resources/scripts defines the type named after its
+// file, runs in its own environment on one shared Lua state and is called once per tick with all
+// objects of its type. Each call runs under an instruction budget so a runaway script is aborted
+// instead of stalling the tick, and the time spent in every script is tracked for the console.
+//
+// A script returns its type table, every field is optional:
+//   local Spinner = {collision_level = 1, bounds = {-0.5, -0.5, -0.5, 0.5, 0.5, 0.5},
+//                    model = "resources/models/spinner.obj", model_scale = 0.5}
+//   function Spinner.start(h) end                   -- a new object
+//   function Spinner.update(handles, count, dt) end -- every object of the type
+//   function Spinner.collide(h, other) end          -- other is 0 for the player
+//   function Spinner.delete(h) end
+//   return Spinner
+#include <raylib.h>
+#include <lua.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "object/GameObject.cpp"
+#include "player/Player.cpp"
+
+#ifndef RUN_DIR
+#define RUN_DIR "run/"
+#endif
+
+// Compiled scripts are kept here and reused while the source hash matches
+#define SCRIPT_CACHE_DIR RUN_DIR "scripts/"
+#define SCRIPT_CACHE_MAGIC "C3DL"
+
+// Lua instructions a single call may run, checked every SCRIPT_HOOK_INTERVAL instructions
+#define SCRIPT_INSTRUCTION_BUDGET 1000000
+#define SCRIPT_HOOK_INTERVAL 1000
+
+// Failed or aborted calls before a script is switched off
+#define SCRIPT_MAX_ERRORS 8
+
+// Ticks the per tick average is smoothed over
+#define SCRIPT_AVERAGE_TICKS 60
+
+using namespace std;
+
+struct Script {
+    string name;
+    string path;
+
+    // Registry references to the type table and the handle array reused by every update
+    int table = LUA_NOREF;
+    int handles = LUA_NOREF;
+    unsigned int handles_size = 0;
+    bool has_start = false, has_update = false, has_collide = false, has_delete = false;
+
+    // Objects of the type, gathered by the object manager before each update
+    vector<ObjectHandle> batch;
+    unsigned int object_count = 0;
+
+    // Accounting, tick_us is everything the script ran during the current tick
+    unsigned long calls = 0;
+    // Counted in steps of SCRIPT_HOOK_INTERVAL, so short calls add nothing
+    unsigned long instructions = 0;
+    double total_us = 0, worst_us = 0;
+    double tick_us = 0, average_us = 0;
+    unsigned int budget_aborts = 0, errors = 0;
+    bool disabled = false;
+};
+
+// An object a script asked for, created once the scripts are done for the tick
+struct ScriptSpawn {
+    string type;
+    string name;
+    Vector3 position;
+};
+
+class ScriptHost {
+    public:
+    vector<Script> scripts;
+    unsigned int cache_hits = 0, cache_misses = 0;
+
+    // Requests made by scripts, applied by the object manager after the update pass
+    vector<ScriptSpawn> spawns;
+    vector<ObjectHandle> deletes;
+
+    // Object data the bindings work on, set by the owner
+    vector<Vector3> * positions = NULL;
+    vector<GameObject> * objects = NULL;
+    function<int (ObjectHandle)> resolve;
+    Player * player = NULL;
+
+    ScriptHost() {}
+    // The Lua state points back at the host
+    ScriptHost(const ScriptHost &) = delete;
+    ScriptHost & operator=(const ScriptHost &) = delete;
+    ~ScriptHost() {
+        if(L != NULL)
+            lua_close(L);
+    }
+
+    // Run a script and fill the object template from the type table it returns
+    bool Load(const char * path, GameObject * type) {
+        if(L == NULL && !Open())
+            return false;
+
+        Script script;
+        script.name = GetFileNameWithoutExt(path);
+        script.path = path;
+        if(!Run(script))
+            return false;
+
+        lua_getfield(L, -1, "collision_level");
+        if(lua_isnumber(L, -1))
+            type->collision_level = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "model");
+        if(lua_isstring(L, -1))
+            type->model = lua_tostring(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "model_scale");
+        if(lua_isnumber(L, -1))
+            type->model_scale = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "bounds");
+        if(lua_istable(L, -1)) {
+            float bounds[6];
+            for(int i = 0; i < 6; ++i) {
+                lua_rawgeti(L, -1, i + 1);
+                bounds[i] = lua_tonumber(L, -1);
+                lua_pop(L, 1);
+            }
+            type->local_bounds = {{bounds[0], bounds[1], bounds[2]}, {bounds[3], bounds[4], bounds[5]}};
+        }
+        lua_pop(L, 1);
+
+        Bind(script);
+        type->type = script.name;
+        type->script = scripts.size();
+        scripts.push_back(script);
+        return true;
+    }
+
+    // Run every script again in a fresh environment, so what they keep in their locals starts over
+    // as on the first load (demos need the same start every playback). Clear the objects first.
+    bool Restart() {
+        if(L == NULL)
+            return true;
+
+        // Scripts using math.random get the same numbers every time
+        lua_getglobal(L, "math");
+        lua_getfield(L, -1, "randomseed");
+        lua_pushinteger(L, 0);
+        lua_call(L, 1, 0);
+        lua_pop(L, 1);
+
+        bool restarted = true;
+        for(Script & script : scripts) {
+            luaL_unref(L, LUA_REGISTRYINDEX, script.table);
+            luaL_unref(L, LUA_REGISTRYINDEX, script.handles);
+            script.table = script.handles = LUA_NOREF;
+            script.handles_size = 0;
+            script.errors = 0;
+            script.disabled = !Run(script);
+            if(script.disabled) {
+                restarted = false;
+                continue;
+            }
+            Bind(script);
+        }
+        return restarted;
+    }
+
+    // Hand every script the objects gathered into its batch, one call per script
+    void Update(float deltat) {
+        for(Script & script : scripts) {
+            // The previous tick is complete, collisions included
+            script.average_us += (script.tick_us - script.average_us) / SCRIPT_AVERAGE_TICKS;
+            script.tick_us = 0;
+            script.object_count = script.batch.size();
+
+            if(script.disabled || !script.has_update || script.batch.empty()) {
+                script.batch.clear();
+                continue;
+            }
+
+            PushFunction(script, "update");
+            lua_rawgeti(L, LUA_REGISTRYINDEX, script.handles);
+            for(unsigned int i = 0; i < script.batch.size(); ++i) {
+                lua_pushinteger(L, Encode(script.batch[i]));
+                lua_rawseti(L, -2, i + 1);
+            }
+            // Trim what is left from a larger batch so the length operator stays right
+            for(unsigned int i = script.batch.size(); i < script.handles_size; ++i) {
+                lua_pushnil(L);
+                lua_rawseti(L, -2, i + 1);
+            }
+            script.handles_size = script.batch.size();
+            lua_pushinteger(L, script.batch.size());
+            lua_pushnumber(L, deltat);
+            Call(script, 3, 0);
+            script.batch.clear();
+        }
+    }
+
+    void Start(int index, ObjectHandle handle) {
+        Script & script = scripts[index];
+        if(script.disabled || !script.has_start)
+            return;
+        PushFunction(script, "start");
+        lua_pushinteger(L, Encode(handle));
+        Call(script, 1, 0);
+    }
+
+    // Other is the default (never valid) handle when the object touched the player
+    void Collide(int index, ObjectHandle handle, ObjectHandle other) {
+        Script & script = scripts[index];
+        if(script.disabled || !script.has_collide)
+            return;
+        PushFunction(script, "collide");
+        lua_pushinteger(L, Encode(handle));
+        lua_pushinteger(L, Encode(other));
+        Call(script, 2, 0);
+    }
+
+    void Delete(int index, ObjectHandle handle) {
+        Script & script = scripts[index];
+        if(script.disabled || !script.has_delete)
+            return;
+        PushFunction(script, "delete");
+        lua_pushinteger(L, Encode(handle));
+        Call(script, 1, 0);
+    }
+
+    // Scripts by their average time per tick, most expensive first
+    vector<const Script *> Expensive() {
+        vector<const Script *> order;
+        for(const Script & script : scripts)
+            order.push_back(&script);
+        stable_sort(order.begin(), order.end(), [](const Script * a, const Script * b) {
+            return a->average_us > b->average_us;
+        });
+        return order;
+    }
+
+    // Handles reach Lua as one integer, generation in the high half
+    static lua_Integer Encode(ObjectHandle handle) {
+        return ((lua_Integer)handle.generation << 32) | handle.index;
+    }
+
+    static ObjectHandle Decode(lua_Integer value) {
+        ObjectHandle handle;
+        handle.index = (unsigned int)(value & 0xFFFFFFFF);
+        handle.generation = (unsigned int)((uint64_t)value >> 32);
+        return handle;
+    }
+
+    private:
+    lua_State * L = NULL;
+
+    // Instructions run by the current call and whether the hook stopped it
+    unsigned long executed = 0;
+    bool over_budget = false;
+
+    bool Open() {
+        L = luaL_newstate();
+        if(L == NULL) {
+            cout << "ERROR: SCRIPT: Could not create the Lua state\n";
+            return false;
+        }
+        luaL_openlibs(L);
+        *(ScriptHost **)lua_getextraspace(L) = this;
+
+        // Object access shared by every script
+        static const luaL_Reg library[] = {
+            {"valid", LuaValid},
+            {"position", LuaPosition},
+            {"set_position", LuaSetPosition},
+            {"rotation", LuaRotation},
+            {"set_rotation", LuaSetRotation},
+            {"name", LuaName},
+            {"player", LuaPlayer},
+            {"spawn", LuaSpawn},
+            {"delete", LuaDelete},
+            {NULL, NULL}
+        };
+        luaL_newlib(L, library);
+        lua_setglobal(L, "objects");
+
+        cout << "INFO: SCRIPT: " << LUA_RELEASE << " ready\n";
+        return true;
+    }
+
+    // Run the script's main chunk in its own environment, leaving the type table it returns on the stack
+    bool Run(Script & script) {
+        if(!Compile(script))
+            return false;
+
+        // Globals the script sets stay in its own environment, reads fall through to the shared one
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushglobaltable(L);
+        lua_setfield(L, -2, "__index");
+        lua_setmetatable(L, -2);
+        lua_setupvalue(L, -2, 1);
+
+        if(!Call(script, 0, 1))
+            return false;
+        if(!lua_istable(L, -1)) {
+            cout << "ERROR: SCRIPT: '" << script.path << "' did not return a type table\n";
+            lua_pop(L, 1);
+            return false;
+        }
+        return true;
+    }
+
+    // Take the type table off the stack and note which callbacks it has
+    void Bind(Script & script) {
+        script.has_start = HasFunction("start");
+        script.has_update = HasFunction("update");
+        script.has_collide = HasFunction("collide");
+        script.has_delete = HasFunction("delete");
+        script.table = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_newtable(L);
+        script.handles = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    // Push the script's main chunk, from the bytecode cache if it was compiled from the same source
+    bool Compile(Script & script) {
+        ifstream file(script.path, ios::binary);
+        if(!file.is_open()) {
+            cout << "ERROR: SCRIPT: Could not read '" << script.path << "'\n";
+            return false;
+        }
+        stringstream stream;
+        stream << file.rdbuf();
+        string source = stream.str();
+
+        // FNV-1a of the source, seeded with the Lua version since bytecode is not portable between them
+        uint64_t hash = 14695981039346656037ull ^ LUA_VERSION_NUM;
+        for(unsigned char c : source)
+            hash = (hash ^ c) * 1099511628211ull;
+
+        string chunk_name = "@" + script.path;
+        string cache_path = SCRIPT_CACHE_DIR + script.name + ".luac";
+        const size_t header_size = 4 + sizeof(hash);
+
+        ifstream cache(cache_path, ios::binary);
+        if(cache.is_open()) {
+            stringstream cached_stream;
+            cached_stream << cache.rdbuf();
+            string cached = cached_stream.str();
+            if(cached.size() > header_size && !memcmp(cached.data(), SCRIPT_CACHE_MAGIC, 4) && !memcmp(cached.data() + 4, &hash, sizeof(hash))) {
+                if(luaL_loadbufferx(L, cached.data() + header_size, cached.size() - header_size, chunk_name.c_str(), "b") == LUA_OK) {
+                    ++cache_hits;
+                    return true;
+                }
+                lua_pop(L, 1);
+            }
+        }
+
+        ++cache_misses;
+        if(luaL_loadbufferx(L, source.data(), source.size(), chunk_name.c_str(), "t") != LUA_OK) {
+            cout << "ERROR: SCRIPT: " << lua_tostring(L, -1) << "\n";
+            lua_pop(L, 1);
+            return false;
+        }
+
+        // Keep the bytecode for the next run, debug info included so errors still have line numbers
+        string bytecode;
+        lua_dump(L, [](lua_State *, const void * data, size_t size, void * out) {
+            ((string *)out)->append((const char *)data, size);
+            return 0;
+        }, &bytecode, 0);
+
+        mkdir(RUN_DIR, 0755);
+        mkdir(SCRIPT_CACHE_DIR, 0755);
+        FILE * out = fopen(cache_path.c_str(), "wb");
+        if(out == NULL) {
+            cout << "WARNING: SCRIPT: Could not write '" << cache_path << "'\n";
+            return true;
+        }
+        bool written = fwrite(SCRIPT_CACHE_MAGIC, 1, 4, out) == 4 && fwrite(&hash, sizeof(hash), 1, out) == 1
+            && fwrite(bytecode.data(), 1, bytecode.size(), out) == bytecode.size();
+        if(fclose(out) != 0 || !written) {
+            cout << "WARNING: SCRIPT: Could not write '" << cache_path << "'\n";
+            remove(cache_path.c_str());
+        }
+        return true;
+    }
+
+    // Whether the type table on top of the stack has the named function
+    bool HasFunction(const char * name) {
+        lua_getfield(L, -1, name);
+        bool found = lua_isfunction(L, -1);
+        lua_pop(L, 1);
+        return found;
+    }
+
+    void PushFunction(Script & script, const char * name) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, script.table);
+        lua_getfield(L, -1, name);
+        lua_remove(L, -2);
+    }
+
+    // Call the function below the arguments under the instruction budget, charging the time to the script
+    bool Call(Script & script, int args, int results) {
+        executed = 0;
+        over_budget = false;
+        lua_sethook(L, Hook, LUA_MASKCOUNT, SCRIPT_HOOK_INTERVAL);
+
+        auto start = chrono::steady_clock::now();
+        int status = lua_pcall(L, args, results, 0);
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        lua_sethook(L, NULL, 0, 0);
+
+        ++script.calls;
+        script.instructions += executed;
+        script.total_us += us;
+        script.tick_us += us;
+        if(us > script.worst_us)
+            script.worst_us = us;
+
+        if(status == LUA_OK)
+            return true;
+
+        if(over_budget) {
+            ++script.budget_aborts;
+            cout << "WARNING: SCRIPT: '" << script.name << "' ran over its budget of " << SCRIPT_INSTRUCTION_BUDGET << " instructions\n";
+        }
+        else {
+            ++script.errors;
+            cout << "ERROR: SCRIPT: " << lua_tostring(L, -1) << "\n";
+        }
+        lua_pop(L, 1);
+
+        if(script.budget_aborts + script.errors >= SCRIPT_MAX_ERRORS && !script.disabled) {
+            script.disabled = true;
+            cout << "WARNING: SCRIPT: Disabled '" << script.name << "' after " << SCRIPT_MAX_ERRORS << " failed calls\n";
+        }
+        return false;
+    }
+
+    static ScriptHost * Host(lua_State * L) {
+        return *(ScriptHost **)lua_getextraspace(L);
+    }
+
+    static void Hook(lua_State * L, lua_Debug * debug) {
+        ScriptHost * host = Host(L);
+        host->executed += SCRIPT_HOOK_INTERVAL;
+        if(host->executed >= SCRIPT_INSTRUCTION_BUDGET) {
+            host->over_budget = true;
+            luaL_error(L, "instruction budget exceeded");
+        }
+    }
+
+    // Packed index of the handle in the first argument, -1 if the object is gone
+    static int Index(lua_State * L) {
+        return Host(L)->resolve(Decode(luaL_checkinteger(L, 1)));
+    }
+
+    static int PushVector(lua_State * L, Vector3 vector) {
+        lua_pushnumber(L, vector.x);
+        lua_pushnumber(L, vector.y);
+        lua_pushnumber(L, vector.z);
+        return 3;
+    }
+
+    static Vector3 CheckVector(lua_State * L, int first) {
+        return {(float)luaL_checknumber(L, first), (float)luaL_checknumber(L, first + 1), (float)luaL_checknumber(L, first + 2)};
+    }
+
+    // objects.valid(h)
+    static int LuaValid(lua_State * L) {
+        lua_pushboolean(L, Index(L) >= 0);
+        return 1;
+    }
+
+    // objects.position(h) -> x, y, z, nothing for a deleted object
+    static int LuaPosition(lua_State * L) {
+        int index = Index(L);
+        if(index < 0)
+            return 0;
+        return PushVector(L, (*Host(L)->positions)[index]);
+    }
+
+    // objects.set_position(h, x, y, z)
+    static int LuaSetPosition(lua_State * L) {
+        int index = Index(L);
+        Vector3 position = CheckVector(L, 2);
+        if(index >= 0)
+            (*Host(L)->positions)[index] = position;
+        return 0;
+    }
+
+    // objects.rotation(h) -> x, y, z
+    static int LuaRotation(lua_State * L) {
+        int index = Index(L);
+        if(index < 0)
+            return 0;
+        return PushVector(L, (*Host(L)->objects)[index].rotation);
+    }
+
+    // objects.set_rotation(h, x, y, z)
+    static int LuaSetRotation(lua_State * L) {
+        int index = Index(L);
+        Vector3 rotation = CheckVector(L, 2);
+        if(index >= 0)
+            (*Host(L)->objects)[index].rotation = rotation;
+        return 0;
+    }
+
+    // objects.name(h) -> name
+    static int LuaName(lua_State * L) {
+        int index = Index(L);
+        if(index < 0)
+            return 0;
+        lua_pushstring(L, (*Host(L)->objects)[index].name.c_str());
+        return 1;
+    }
+
+    // objects.player() -> x, y, z
+    static int LuaPlayer(lua_State * L) {
+        Player * player = Host(L)->player;
+        if(player == NULL)
+            return 0;
+        return PushVector(L, player->position);
+    }
+
+    // objects.spawn(type, name, x, y, z), the object appears after this tick's scripts
+    static int LuaSpawn(lua_State * L) {
+        ScriptSpawn spawn;
+        spawn.type = luaL_checkstring(L, 1);
+        spawn.name = luaL_checkstring(L, 2);
+        spawn.position = CheckVector(L, 3);
+        Host(L)->spawns.push_back(spawn);
+        return 0;
+    }
+
+    // objects.delete(h), the object goes after this tick's scripts
+    static int LuaDelete(lua_State * L) {
+        Host(L)->deletes.push_back(Decode(luaL_checkinteger(L, 1)));
+        return 0;
+    }
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+// Capsule vs triangle queries against the static collision world
+#include <raylib.h>
+#include <raymath.h>
+#include <float.h>
+#include <math.h>
+
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+
+// Gap kept between the capsule and the surfaces it rests against
+#define CAPSULE_SKIN 0.005f
+// Newton steps per triangle before a sweep gives up and reports a (conservative) hit
+#define CAPSULE_SWEEP_STEPS 16
+
+using namespace std;
+
+// A capsule is the set of points within radius of the segment a-b
+struct Capsule {
+    Vector3 a, b;
+    float radius;
+};
+
+// Result of a sweep, time is the fraction of the motion that is free
+struct SweepHit {
+    bool hit;
+    float time;
+    Vector3 normal;
+    Vector3 point;
+};
+
+// Closest point on a triangle to a point (Ericson, Real-Time Collision Detection 5.1.5)
+Vector3 ClosestPointTriangle(Vector3 p, const CollisionTriangle & tri) {
+    Vector3 ab = Vector3Subtract(tri.b, tri.a), ac = Vector3Subtract(tri.c, tri.a), ap = Vector3Subtract(p, tri.a);
+    float d1 = Vector3DotProduct(ab, ap), d2 = Vector3DotProduct(ac, ap);
+    if(d1 <= 0 && d2 <= 0) return tri.a;
+
+    Vector3 bp = Vector3Subtract(p, tri.b);
+    float d3 = Vector3DotProduct(ab, bp), d4 = Vector3DotProduct(ac, bp);
+    if(d3 >= 0 && d4 <= d3) return tri.b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0 && d1 >= 0 && d3 <= 0)
+        return Vector3Add(tri.a, Vector3Scale(ab, d1 / (d1 - d3)));
+
+    Vector3 cp = Vector3Subtract(p, tri.c);
+    float d5 = Vector3DotProduct(ab, cp), d6 = Vector3DotProduct(ac, cp);
+    if(d6 >= 0 && d5 <= d6) return tri.c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0 && d2 >= 0 && d6 <= 0)
+        return Vector3Add(tri.a, Vector3Scale(ac, d2 / (d2 - d6)));
+
+    float va = d3 * d6 - d5 * d4;
+    if(va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        return Vector3Add(tri.b, Vector3Scale(Vector3Subtract(tri.c, tri.b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+
+    float denom = 1 / (va + vb + vc);
+    return Vector3Add(tri.a, Vector3Add(Vector3Scale(ab, vb * denom), Vector3Scale(ac, vc * denom)));
+}
+
+// Closest points between segments p1-q1 and p2-q2 (Ericson 5.1.9)
+void ClosestPointsSegments(Vector3 p1, Vector3 q1, Vector3 p2, Vector3 q2, Vector3 * c1, Vector3 * c2) {
+    Vector3 d1 = Vector3Subtract(q1, p1), d2 = Vector3Subtract(q2, p2), r = Vector3Subtract(p1, p2);
+    float a = Vector3DotProduct(d1, d1), e = Vector3DotProduct(d2, d2), f = Vector3DotProduct(d2, r);
+    float s = 0, t = 0;
+
+    if(a <= FLT_EPSILON && e <= FLT_EPSILON) {
+        *c1 = p1;
+        *c2 = p2;
+        return;
+    }
+
+    if(a <= FLT_EPSILON)
+        t = Clamp(f / e, 0, 1);
+    else {
+        float c = Vector3DotProduct(d1, r);
+        if(e <= FLT_EPSILON)
+            s = Clamp(-c / a, 0, 1);
+        else {
+            float b = Vector3DotProduct(d1, d2);
+            float denom = a * e - b * b;
+            s = denom != 0 ? Clamp((b * f - c * e) / denom, 0, 1) : 0;
+            t = (b * s + f) / e;
+            if(t < 0) {
+                t = 0;
+                s = Clamp(-c / a, 0, 1);
+            }
+            else if(t > 1) {
+                t = 1;
+                s = Clamp((b - c) / a, 0, 1);
+            }
+        }
+    }
+
+    *c1 = Vector3Add(p1, Vector3Scale(d1, s));
+    *c2 = Vector3Add(p2, Vector3Scale(d2, t));
+}
+
+// Squared distance between a segment and a triangle, with the closest point on each
+float SegmentTriangleDistanceSqr(Vector3 p, Vector3 q, const CollisionTriangle & tri, Vector3 * on_segment, Vector3 * on_triangle) {
+    Vector3 ab = Vector3Subtract(tri.b, tri.a), ac = Vector3Subtract(tri.c, tri.a);
+    Vector3 n = Vector3CrossProduct(ab, ac);
+
+    // The segment passes through the triangle
+    Vector3 pq = Vector3Subtract(q, p);
+    float denom = Vector3DotProduct(n, pq);
+    if(denom != 0) {
+        float t = Vector3DotProduct(n, Vector3Subtract(tri.a, p)) / denom;
+        if(t >= 0 && t <= 1) {
+            Vector3 x = Vector3Add(p, Vector3Scale(pq, t));
+            Vector3 ax = Vector3Subtract(x, tri.a);
+            float d00 = Vector3DotProduct(ab, ab), d01 = Vector3DotProduct(ab, ac), d11 = Vector3DotProduct(ac, ac);
+            float d20 = Vector3DotProduct(ax, ab), d21 = Vector3DotProduct(ax, ac);
+            float det = d00 * d11 - d01 * d01;
+            if(det != 0) {
+                float v = (d11 * d20 - d01 * d21) / det;
+                float w = (d00 * d21 - d01 * d20) / det;
+                if(v >= 0 && w >= 0 && v + w <= 1) {
+                    *on_segment = x;
+                    *on_triangle = x;
+                    return 0;
+                }
+            }
+        }
+    }
+
+    // Otherwise the closest pair involves a segment end point or a triangle edge
+    float best = FLT_MAX;
+    Vector3 ends[2] = {p, q};
+    for(Vector3 end : ends) {
+        Vector3 c = ClosestPointTriangle(end, tri);
+        float d = Vector3DistanceSqr(end, c);
+        if(d < best) {
+            best = d;
+            *on_segment = end;
+            *on_triangle = c;
+        }
+    }
+
+    Vector3 edges[3][2] = {{tri.a, tri.b}, {tri.b, tri.c}, {tri.c, tri.a}};
+    for(int i = 0; i < 3; ++i) {
+        Vector3 c1, c2;
+        ClosestPointsSegments(p, q, edges[i][0], edges[i][1], &c1, &c2);
+        float d = Vector3DistanceSqr(c1, c2);
+        if(d < best) {
+            best = d;
+            *on_segment = c1;
+            *on_triangle = c2;
+        }
+    }
+    return best;
+}
+
+// Unit direction pushing the capsule away from a triangle, falls back to the face normal when touching
+Vector3 SeparatingNormal(Vector3 on_segment, Vector3 on_triangle, const CollisionTriangle & tri, Vector3 center) {
+    Vector3 n = Vector3Subtract(on_segment, on_triangle);
+    float length = Vector3Length(n);
+    if(length > 0.0001f)
+        return Vector3Scale(n, 1 / length);
+
+    n = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(tri.b, tri.a), Vector3Subtract(tri.c, tri.a)));
+    if(Vector3DotProduct(n, Vector3Subtract(center, tri.a)) < 0)
+        n = Vector3Negate(n);
+    return n;
+}
+
+BoundingBox CapsuleBounds(Capsule capsule, Vector3 motion, float margin) {
+    Vector3 lo = Vector3Min(Vector3Min(capsule.a, capsule.b), Vector3Add(Vector3Min(capsule.a, capsule.b), motion));
+    Vector3 hi = Vector3Max(Vector3Max(capsule.a, capsule.b), Vector3Add(Vector3Max(capsule.a, capsule.b), motion));
+    return {Vector3SubtractValue(lo, capsule.radius + margin), Vector3AddValue(hi, capsule.radius + margin)};
+}
+
+// Sweep a capsule along motion and report the first contact (one world query).
+// The distance between two convex shapes under translation is convex in time, so Newton steps
+// from the start never pass the first contact and a non-closing rate means the triangle is never hit.
+SweepHit SweepCapsule(CollisionWorld * world, Capsule capsule, Vector3 motion) {
+    SweepHit result = {false, 1, {0, 1, 0}, {0}};
+
+    thread_local vector<unsigned int> candidates;
+    world->Query(CapsuleBounds(capsule, motion, CAPSULE_SKIN * 2), &candidates);
+
+    Vector3 center = Vector3Scale(Vector3Add(capsule.a, capsule.b), 0.5f);
+    float target = capsule.radius + CAPSULE_SKIN;
+
+    // Motion already projected onto a surface keeps a tiny closing rate from rounding, ignore it
+    float min_closing = Vector3Length(motion) * 0.001f;
+
+    for(unsigned int index : candidates) {
+        const CollisionTriangle & tri = world->triangles[index];
+
+        float t = 0;
+        for(int step = 0; step < CAPSULE_SWEEP_STEPS && t < result.time; ++step) {
+            Vector3 offset = Vector3Scale(motion, t);
+            Vector3 on_segment, on_triangle;
+            float distance = sqrtf(SegmentTriangleDistanceSqr(
+                Vector3Add(capsule.a, offset), Vector3Add(capsule.b, offset), tri, &on_segment, &on_triangle
+            ));
+
+            Vector3 normal = SeparatingNormal(on_segment, on_triangle, tri, Vector3Add(center, offset));
+            float closing = -Vector3DotProduct(motion, normal);
+
+            // Moving away or parallel, the distance can only grow from here
+            if(closing <= min_closing)
+                break;
+
+            // Close enough (or out of steps), report the contact
+            if(distance - target < CAPSULE_SKIN || step == CAPSULE_SWEEP_STEPS - 1) {
+                result.hit = true;
+                result.time = t;
+                result.normal = normal;
+                result.point = on_triangle;
+                break;
+            }
+
+            t += (distance - target) / closing;
+            if(t >= 1)
+                break;
+        }
+    }
+    return result;
+}
+
+// Push the capsule out of any triangle it overlaps, returns the correction applied (one world query)
+Vector3 DepenetrateCapsule(CollisionWorld * world, Capsule capsule) {
+    thread_local vector<unsigned int> candidates;
+    world->Query(CapsuleBounds(capsule, {0}, 0), &candidates);
+
+    Vector3 correction = {0};
+    for(unsigned int index : candidates) {
+        const CollisionTriangle & tri = world->triangles[index];
+        Vector3 a = Vector3Add(capsule.a, correction), b = Vector3Add(capsule.b, correction);
+
+        Vector3 on_segment, on_triangle;
+        float distance = sqrtf(SegmentTriangleDistanceSqr(a, b, tri, &on_segment, &on_triangle));
+        if(distance >= capsule.radius)
+            continue;
+
+        Vector3 normal = SeparatingNormal(on_segment, on_triangle, tri, Vector3Scale(Vector3Add(a, b), 0.5f));
+        correction = Vector3Add(correction, Vector3Scale(normal, capsule.radius + CAPSULE_SKIN - distance));
+    }
+    return correction;
+}
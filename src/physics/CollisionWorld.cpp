@@ -0,0 +1,386 @@
+#pragma once
+
+// Static collision scene: every world triangle in one SAH-built BVH
+#include <raylib.h>
+#include <raymath.h>
+#include <float.h>
+#include <math.h>
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+// Number of SAH bins tested per axis when splitting a node
+#define BVH_BINS 12
+// Nodes with this many triangles or fewer are never split
+#define BVH_LEAF_SIZE 2
+// Maximum traversal depth (the build keeps trees far shallower than this)
+#define BVH_STACK_SIZE 64
+
+using namespace std;
+
+// A world space triangle, pre-transformed so queries never touch the model matrix
+struct CollisionTriangle {
+    Vector3 a, b, c;
+};
+
+// Flat BVH node (32 bytes, two per cache line).
+// Interior nodes store their first child in left_first, the second child is always left_first + 1.
+// Leaves store the index of their first triangle in left_first and their triangle count in tri_count.
+struct BvhNode {
+    Vector3 min;
+    unsigned int left_first;
+    Vector3 max;
+    unsigned int tri_count;
+};
+
+class CollisionWorld {
+    public:
+    vector<CollisionTriangle> triangles;
+    vector<BvhNode> nodes;
+
+    // Number of queries since the last reset (used by the benchmarks), atomic as the main thread
+    // casts rays of its own while the simulation thread queries
+    atomic<unsigned long> queries{0};
+
+    // Remove all geometry
+    void Clear() {
+        triangles.clear();
+        nodes.clear();
+    }
+
+    // Append the triangles of a mesh, transformed into world space
+    void AddMesh(Mesh mesh, Matrix transform) {
+        if(mesh.vertices == NULL)
+            return;
+
+        for(int i = 0; i < mesh.triangleCount; ++i) {
+            int index[3];
+            for(int c = 0; c < 3; ++c)
+                index[c] = mesh.indices ? mesh.indices[i * 3 + c] : i * 3 + c;
+
+            Vector3 p[3];
+            for(int c = 0; c < 3; ++c) {
+                float * v = &mesh.vertices[index[c] * 3];
+                p[c] = Vector3Transform({v[0], v[1], v[2]}, transform);
+            }
+            triangles.push_back({p[0], p[1], p[2]});
+        }
+    }
+
+    // Append every mesh of a model
+    void AddModel(Model model) {
+        for(int i = 0; i < model.meshCount; ++i)
+            AddMesh(model.meshes[i], model.transform);
+    }
+
+    // Build the BVH over all triangles added so far
+    void Build() {
+        nodes.clear();
+        if(triangles.empty())
+            return;
+
+        // Centroids are only needed during the build
+        centroids.resize(triangles.size());
+        order.resize(triangles.size());
+        for(unsigned int i = 0; i < triangles.size(); ++i) {
+            centroids[i] = Vector3Scale(Vector3Add(Vector3Add(triangles[i].a, triangles[i].b), triangles[i].c), 1 / 3.0f);
+            order[i] = i;
+        }
+
+        // A binary tree never has more than 2n - 1 nodes, reserve so references stay valid
+        nodes.reserve(triangles.size() * 2);
+        nodes.push_back({{0}, 0, {0}, (unsigned int)triangles.size()});
+        UpdateBounds(0);
+        Subdivide(0, 0);
+
+        // Store triangles in leaf order so traversal reads them sequentially
+        vector<CollisionTriangle> sorted(triangles.size());
+        for(unsigned int i = 0; i < order.size(); ++i)
+            sorted[i] = triangles[order[i]];
+        triangles.swap(sorted);
+
+        centroids = {};
+        order = {};
+
+        cout << "INFO: COLLISION: Built BVH (" << triangles.size() << " triangles, " << nodes.size() << " nodes)\n";
+    }
+
+    // Closest hit along the ray within max_distance, matches the result layout of GetRayCollisionMesh
+    RayCollision CastRay(Ray ray, float max_distance = FLT_MAX) {
+        queries.fetch_add(1, memory_order_relaxed);
+
+        RayCollision result = {0};
+        if(nodes.empty())
+            return result;
+
+        float closest = max_distance;
+        int closest_tri = -1;
+
+        Vector3 inv = {1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+
+        unsigned int stack[BVH_STACK_SIZE];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while(stack_size) {
+            const BvhNode & node = nodes[stack[--stack_size]];
+
+            if(node.tri_count) {
+                for(unsigned int i = node.left_first; i < node.left_first + node.tri_count; ++i) {
+                    float t = IntersectTriangle(ray, triangles[i]);
+                    if(t < closest) {
+                        closest = t;
+                        closest_tri = i;
+                    }
+                }
+                continue;
+            }
+
+            // Visit the nearer child first so the far one is more likely to be pruned
+            unsigned int near_child = node.left_first, far_child = node.left_first + 1;
+            float near_dist = IntersectBox(ray, inv, nodes[near_child], closest);
+            float far_dist = IntersectBox(ray, inv, nodes[far_child], closest);
+            if(far_dist < near_dist) {
+                swap(near_child, far_child);
+                swap(near_dist, far_dist);
+            }
+
+            if(far_dist != FLT_MAX && stack_size < BVH_STACK_SIZE)
+                stack[stack_size++] = far_child;
+            if(near_dist != FLT_MAX && stack_size < BVH_STACK_SIZE)
+                stack[stack_size++] = near_child;
+        }
+
+        if(closest_tri < 0)
+            return result;
+
+        const CollisionTriangle & tri = triangles[closest_tri];
+        result.hit = true;
+        result.distance = closest;
+        result.point = Vector3Add(ray.position, Vector3Scale(ray.direction, closest));
+        result.normal = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(tri.b, tri.a), Vector3Subtract(tri.c, tri.a)));
+        return result;
+    }
+
+    // Whether anything blocks the ray within max_distance. Stops at the first hit and leaves the
+    // query count alone, so it is safe to call from several threads at once.
+    bool Occluded(Ray ray, float max_distance) const {
+        if(nodes.empty())
+            return false;
+
+        Vector3 inv = {1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+
+        unsigned int stack[BVH_STACK_SIZE];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while(stack_size) {
+            const BvhNode & node = nodes[stack[--stack_size]];
+            if(IntersectBox(ray, inv, node, max_distance) == FLT_MAX)
+                continue;
+
+            if(node.tri_count) {
+                for(unsigned int i = node.left_first; i < node.left_first + node.tri_count; ++i) {
+                    if(IntersectTriangle(ray, triangles[i]) < max_distance)
+                        return true;
+                }
+                continue;
+            }
+
+            if(stack_size + 2 <= BVH_STACK_SIZE) {
+                stack[stack_size++] = node.left_first + 1;
+                stack[stack_size++] = node.left_first;
+            }
+        }
+        return false;
+    }
+
+    // Collect the triangles whose bounds overlap the box
+    void Query(BoundingBox box, vector<unsigned int> * out) {
+        queries.fetch_add(1, memory_order_relaxed);
+
+        out->clear();
+        if(nodes.empty())
+            return;
+
+        unsigned int stack[BVH_STACK_SIZE];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+
+        while(stack_size) {
+            const BvhNode & node = nodes[stack[--stack_size]];
+            if(node.min.x > box.max.x || node.max.x < box.min.x ||
+               node.min.y > box.max.y || node.max.y < box.min.y ||
+               node.min.z > box.max.z || node.max.z < box.min.z)
+                continue;
+
+            if(node.tri_count) {
+                for(unsigned int i = node.left_first; i < node.left_first + node.tri_count; ++i)
+                    out->push_back(i);
+            }
+            else if(stack_size + 2 <= BVH_STACK_SIZE) {
+                stack[stack_size++] = node.left_first + 1;
+                stack[stack_size++] = node.left_first;
+            }
+        }
+    }
+
+    private:
+    vector<Vector3> centroids;
+    vector<unsigned int> order;
+
+    static float SurfaceArea(Vector3 min, Vector3 max) {
+        Vector3 e = Vector3Subtract(max, min);
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    void UpdateBounds(unsigned int index) {
+        BvhNode & node = nodes[index];
+        node.min = {FLT_MAX, FLT_MAX, FLT_MAX};
+        node.max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for(unsigned int i = node.left_first; i < node.left_first + node.tri_count; ++i) {
+            const CollisionTriangle & tri = triangles[order[i]];
+            node.min = Vector3Min(node.min, Vector3Min(tri.a, Vector3Min(tri.b, tri.c)));
+            node.max = Vector3Max(node.max, Vector3Max(tri.a, Vector3Max(tri.b, tri.c)));
+        }
+    }
+
+    // Binned SAH split search, returns the cost of the best split (FLT_MAX if none)
+    float FindSplit(const BvhNode & node, int * best_axis, float * best_pos) {
+        float best_cost = FLT_MAX;
+
+        for(int axis = 0; axis < 3; ++axis) {
+            // Bin by centroid bounds rather than node bounds for better spread
+            float cmin = FLT_MAX, cmax = -FLT_MAX;
+            for(unsigned int i = node.left_first; i < node.left_first + node.tri_count; ++i) {
+                float c = ((float *)&centroids[order[i]])[axis];
+                cmin = fminf(cmin, c);
+                cmax = fmaxf(cmax, c);
+            }
+            if(cmin == cmax)
+                continue;
+
+            struct Bin {
+                Vector3 min = {FLT_MAX, FLT_MAX, FLT_MAX};
+                Vector3 max = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+                unsigned int count = 0;
+            } bins[BVH_BINS];
+
+            float scale = BVH_BINS / (cmax - cmin);
+            for(unsigned int i = node.left_first; i < node.left_first + node.tri_count; ++i) {
+                const CollisionTriangle & tri = triangles[order[i]];
+                int bin = min(BVH_BINS - 1, (int)((((float *)&centroids[order[i]])[axis] - cmin) * scale));
+                bins[bin].count++;
+                bins[bin].min = Vector3Min(bins[bin].min, Vector3Min(tri.a, Vector3Min(tri.b, tri.c)));
+                bins[bin].max = Vector3Max(bins[bin].max, Vector3Max(tri.a, Vector3Max(tri.b, tri.c)));
+            }
+
+            // Sweep from both sides to get the cost of every plane between bins
+            float left_area[BVH_BINS - 1], right_area[BVH_BINS - 1];
+            unsigned int left_count[BVH_BINS - 1], right_count[BVH_BINS - 1];
+            Vector3 lmin = {FLT_MAX, FLT_MAX, FLT_MAX}, lmax = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+            Vector3 rmin = lmin, rmax = lmax;
+            unsigned int lsum = 0, rsum = 0;
+            for(int i = 0; i < BVH_BINS - 1; ++i) {
+                lsum += bins[i].count;
+                left_count[i] = lsum;
+                lmin = Vector3Min(lmin, bins[i].min);
+                lmax = Vector3Max(lmax, bins[i].max);
+                left_area[i] = lsum ? SurfaceArea(lmin, lmax) : 0;
+
+                rsum += bins[BVH_BINS - 1 - i].count;
+                right_count[BVH_BINS - 2 - i] = rsum;
+                rmin = Vector3Min(rmin, bins[BVH_BINS - 1 - i].min);
+                rmax = Vector3Max(rmax, bins[BVH_BINS - 1 - i].max);
+                right_area[BVH_BINS - 2 - i] = rsum ? SurfaceArea(rmin, rmax) : 0;
+            }
+
+            for(int i = 0; i < BVH_BINS - 1; ++i) {
+                if(!left_count[i] || !right_count[i])
+                    continue;
+                float cost = left_count[i] * left_area[i] + right_count[i] * right_area[i];
+                if(cost < best_cost) {
+                    best_cost = cost;
+                    *best_axis = axis;
+                    *best_pos = cmin + (i + 1) / scale;
+                }
+            }
+        }
+        return best_cost;
+    }
+
+    void Subdivide(unsigned int index, int depth) {
+        BvhNode node = nodes[index];
+        if(node.tri_count <= BVH_LEAF_SIZE || depth >= BVH_STACK_SIZE - 2)
+            return;
+
+        int axis = 0;
+        float split = 0;
+        float cost = FindSplit(node, &axis, &split);
+        if(cost >= node.tri_count * SurfaceArea(node.min, node.max))
+            return;
+
+        // Partition the triangle order around the split plane
+        int i = node.left_first, j = node.left_first + node.tri_count - 1;
+        while(i <= j) {
+            if(((float *)&centroids[order[i]])[axis] < split)
+                ++i;
+            else
+                swap(order[i], order[j--]);
+        }
+
+        unsigned int left_count = i - node.left_first;
+        if(left_count == 0 || left_count == node.tri_count)
+            return;
+
+        unsigned int left = nodes.size();
+        nodes.push_back({{0}, node.left_first, {0}, left_count});
+        nodes.push_back({{0}, (unsigned int)i, {0}, node.tri_count - left_count});
+        nodes[index].left_first = left;
+        nodes[index].tri_count = 0;
+
+        UpdateBounds(left);
+        UpdateBounds(left + 1);
+        Subdivide(left, depth + 1);
+        Subdivide(left + 1, depth + 1);
+    }
+
+    // Slab test, returns the entry distance or FLT_MAX on a miss
+    static float IntersectBox(Ray ray, Vector3 inv, const BvhNode & node, float max_distance) {
+        float tx1 = (node.min.x - ray.position.x) * inv.x, tx2 = (node.max.x - ray.position.x) * inv.x;
+        float tmin = fminf(tx1, tx2), tmax = fmaxf(tx1, tx2);
+        float ty1 = (node.min.y - ray.position.y) * inv.y, ty2 = (node.max.y - ray.position.y) * inv.y;
+        tmin = fmaxf(tmin, fminf(ty1, ty2)); tmax = fminf(tmax, fmaxf(ty1, ty2));
+        float tz1 = (node.min.z - ray.position.z) * inv.z, tz2 = (node.max.z - ray.position.z) * inv.z;
+        tmin = fmaxf(tmin, fminf(tz1, tz2)); tmax = fminf(tmax, fmaxf(tz1, tz2));
+
+        if(tmax >= tmin && tmax > 0 && tmin < max_distance)
+            return tmin;
+        return FLT_MAX;
+    }
+
+    // Moller-Trumbore, returns the hit distance or FLT_MAX on a miss
+    static float IntersectTriangle(Ray ray, const CollisionTriangle & tri) {
+        Vector3 edge1 = Vector3Subtract(tri.b, tri.a);
+        Vector3 edge2 = Vector3Subtract(tri.c, tri.a);
+        Vector3 p = Vector3CrossProduct(ray.direction, edge2);
+        float det = Vector3DotProduct(edge1, p);
+        if(det > -0.000001f && det < 0.000001f)
+            return FLT_MAX;
+
+        float inv_det = 1.0f / det;
+        Vector3 tv = Vector3Subtract(ray.position, tri.a);
+        float u = Vector3DotProduct(tv, p) * inv_det;
+        if(u < 0 || u > 1)
+            return FLT_MAX;
+
+        Vector3 q = Vector3CrossProduct(tv, edge1);
+        float v = Vector3DotProduct(ray.direction, q) * inv_det;
+        if(v < 0 || u + v > 1)
+            return FLT_MAX;
+
+        float t = Vector3DotProduct(edge2, q) * inv_det;
+        return t > 0.000001f ? t : FLT_MAX;
+    }
+};
@@ -6,10 +6,27 @@
 
 #include <iostream>
 
+#include "physics/CollisionWorld.cpp"
+#include "physics/Capsule.cpp"
+#include "system/Profiler.cpp"
+
 #define DEBUG false
 
+// The tick rate the movement constants were tuned at, other rates are scaled to feel the same
+#define PLAYER_TUNING_RATE 60.0f
+
 using namespace std;
 
+// Input sampled by the render loop and consumed by the simulation ticks
+struct PlayerInput {
+    // x is left (+) / right (-), y is forward (+) / back (-)
+    Vector2 axis = {0, 0};
+    // Mouse movement not yet applied by a tick
+    Vector2 look = {0, 0};
+    bool jump = false;
+    bool descend = false;
+};
+
 class Player {
     private:
     float deltat;
@@ -21,14 +38,28 @@ class Player {
     float speed = 1;
     float sensitivity = 50;
 
-    bool grounded;
+    // Collision capsule, the segment runs from the player position up to capsule_height
+    float capsule_radius = 0.3f;
+    float capsule_height = 1.1f;
+    // Tallest ledge the player walks up without jumping
+    float step_height = 0.35f;
+    // Surfaces with a normal.y above this can be stood on
+    float walkable = 0.7f;
+    // Collision world queries made during the last update
+    int queries = 0;
+
+    bool grounded = false;
 
     Vector3 position, last_pos;
     Vector3 velocity = {0, 0, 0};
+    PlayerInput input;
     Vector2 input_axis = {0, 0};
     float net_velocity; // Total direction velocity
     Camera3D camera;
-    Vector2 rotation = {0, 0};
+    Vector2 rotation = {0, 0}, last_rotation = {0, 0};
+
+    // Position between the last two ticks that the current frame is drawn at
+    Vector3 view_position;
 
     Vector3 look;
 
@@ -50,126 +81,274 @@ class Player {
     }
     Player(){}
 
-    void Update() {
-        deltat = GetFrameTime();
+    // Stand still at position facing forward with no input, the state every demo starts from
+    void Reset(Vector3 position) {
+        this->position = last_pos = view_position = position;
+        velocity = {0, 0, 0};
+        rotation = last_rotation = {0, 0};
+        input = PlayerInput();
+        input_axis = {0, 0};
+        net_velocity = 0;
+        grounded = false;
+    }
+
+    // Take the simulated state of a player ticked elsewhere, the view and gun sway stay this one's
+    void Follow(const Player & simulated) {
+        position = simulated.position;
+        last_pos = simulated.last_pos;
+        velocity = simulated.velocity;
+        rotation = simulated.rotation;
+        last_rotation = simulated.last_rotation;
+        input_axis = simulated.input_axis;
+        net_velocity = simulated.net_velocity;
+        grounded = simulated.grounded;
+    }
+
+    // Sample the keyboard and mouse, called once per rendered frame
+    void PollInput() {
+        input.axis = {
+            (float)(IsKeyDown(KEY_A) - IsKeyDown(KEY_D)),
+            (float)(IsKeyDown(KEY_W) - IsKeyDown(KEY_S))
+        };
+        input.look = Vector2Add(input.look, GetMouseDelta());
+        input.jump = IsKeyDown(KEY_SPACE);
+        input.descend = IsKeyDown(KEY_LEFT_SHIFT);
+    }
+
+    // One simulation tick. Pass the static world to move with collision, or NULL to fly through everything (edit mode)
+    void Update(float deltat, CollisionWorld * world) {
+        PROFILE_ZONE("Player::Update");
+        this->deltat = deltat;
+
+        // Number of tuning-rate frames this tick stands in for
+        float frames = deltat * PLAYER_TUNING_RATE;
 
-        if(IsKeyDown(KEY_SPACE) && grounded)
+        last_pos = position;
+        last_rotation = rotation;
+
+        if(input.jump && grounded)
             velocity.y = jump;
         else if(grounded)
             velocity.y = 0;
 
-        input_axis.y = Lerp(input_axis.y, IsKeyDown(KEY_W) - IsKeyDown(KEY_S), deltat * 8);
-        input_axis.x = Lerp(input_axis.x, IsKeyDown(KEY_A) - IsKeyDown(KEY_D), deltat * 8);
+        input_axis.y = Lerp(input_axis.y, input.axis.y, Clamp(deltat * 8, 0, 1));
+        input_axis.x = Lerp(input_axis.x, input.axis.x, Clamp(deltat * 8, 0, 1));
 
         // Controls
-        velocity.x += speed * sinf(rotation.x) * input_axis.y;
-        velocity.z += speed * cosf(rotation.x) * input_axis.y;
+        velocity.x += speed * sinf(rotation.x) * input_axis.y * frames;
+        velocity.z += speed * cosf(rotation.x) * input_axis.y * frames;
 
-        velocity.x += speed * sinf(rotation.x + PI/2.0) * input_axis.x;
-        velocity.z += speed * cosf(rotation.x + PI/2.0) * input_axis.x;
-        if(IsKeyDown(KEY_LEFT_SHIFT)) {
+        velocity.x += speed * sinf(rotation.x + PI/2.0) * input_axis.x * frames;
+        velocity.z += speed * cosf(rotation.x + PI/2.0) * input_axis.x * frames;
+        if(input.descend) {
             velocity.y = -jump;
         }
 
         // Calculate net horizontal velocity
         net_velocity = sqrtf((velocity.x * velocity.x) + (velocity.z * velocity.z));
 
+        // Mouse movement is applied once, by the first tick after it was sampled
+        rotation.x -= input.look.x * sensitivity / 10000;
+        rotation.y -= input.look.y * sensitivity / 10000;
+        input.look = {0, 0};
+        
+        if(rotation.y > PI/2.1)
+            rotation.y = PI/2.1;
+        if(rotation.y < -PI/2.1)
+            rotation.y = -PI/2.1;
+
+        // Same damping per second at any tick rate
+        float damping = powf(1 + friction, -frames);
+        velocity.x *= damping;
+        velocity.z *= damping;
+
+        if(world)
+            Move(world, Vector3Scale(velocity, deltat));
+        else
+            position = Vector3Add(position, Vector3Scale(velocity, deltat));
+
+        velocity.y -= gravity * deltat;
+        
+        friction = grounded ? 0.15 : 0.01;
+        speed = grounded ? 0.7 : 0.04;
+
+        // Respawn without interpolating across the map
+        if(position.y < -10) {
+            position = {0, 20, 0};
+            last_pos = position;
+        }
+
+        UpdateBounds();
+    }
+
+    // Place the camera and gun between the last two ticks, called once per rendered frame
+    void Interpolate(float alpha, float frame_time) {
+        view_position = Vector3Lerp(last_pos, position, alpha);
+        Vector2 view_rotation = Vector2Lerp(last_rotation, rotation, alpha);
+
         this->look = {
-            sinf(rotation.x) * cos(rotation.y), 
-            sin(rotation.y), 
-            cosf(rotation.x) * cos(rotation.y)
+            sinf(view_rotation.x) * cos(view_rotation.y), 
+            sin(view_rotation.y), 
+            cosf(view_rotation.x) * cos(view_rotation.y)
         };
 
-        this->camera.position = {position.x, position.y + 1, position.z};
+        this->camera.position = {view_position.x, view_position.y + 1, view_position.z};
         this->camera.target = {
-            position.x + look.x, 
-            position.y + 1 + look.y, 
-            position.z + look.z
+            view_position.x + look.x, 
+            view_position.y + 1 + look.y, 
+            view_position.z + look.z
         };
 
+        // Gun sway eases by half every tuning-rate frame
+        float ease = 1 - powf(0.5f, frame_time * PLAYER_TUNING_RATE);
+
         gun_height = Lerp(
             gun_height,
-            (sin(rotation.x) * sin(position.x * 2) + cos(rotation.x) * sin(position.z * 2))
+            (sin(view_rotation.x) * sin(view_position.x * 2) + cos(view_rotation.x) * sin(view_position.z * 2))
             * Clamp(net_velocity, 0, 1) / 100 + 0.2f + Clamp(velocity.y / 200, -0.03, 0.1),
-            0.5
+            ease
         );
 
         gun_position = {
-            position.x + look.x / 2.2f + sin(rotation.y) * gun_height * sin(rotation.x),
-            position.y + look.y / 2.2f + 1 - cos(rotation.y) * gun_height,
-            position.z + look.z / 2.2f + sin(rotation.y) * gun_height * cos(rotation.x)
+            view_position.x + look.x / 2.2f + sin(view_rotation.y) * gun_height * sin(view_rotation.x),
+            view_position.y + look.y / 2.2f + 1 - cos(view_rotation.y) * gun_height,
+            view_position.z + look.z / 2.2f + sin(view_rotation.y) * gun_height * cos(view_rotation.x)
         };
 
         gun_rotation = {
-            Lerp(gun_rotation.x, rotation.x - (PI/2), 0.5), 
-            Lerp(gun_rotation.y, rotation.y -input_axis.y / 20, 0.5)
+            Lerp(gun_rotation.x, view_rotation.x - (PI/2), ease), 
+            Lerp(gun_rotation.y, view_rotation.y - input_axis.y / 20, ease)
         };
+    }
 
-        rotation.x -= GetMouseDelta().x * sensitivity / 10000;
-        rotation.y -= GetMouseDelta().y * sensitivity / 10000;
-        
-        if(rotation.y > PI/2.1)
-            rotation.y = PI/2.1;
-        if(rotation.y < -PI/2.1)
-            rotation.y = -PI/2.1;
-
-        last_pos = position;
-
-        velocity.x /= 1 + friction;
-        velocity.z /= 1 + friction;
-
-        position.x += velocity.x * deltat;
-        position.y += velocity.y * deltat;
-        position.z += velocity.z * deltat;
-
-        velocity.y -= gravity * deltat;
-        
-        friction = grounded ? 0.15 : 0.01;
-        speed = grounded ? 0.7 : 0.04;
-
-        if(position.y < -10)
-            position = {0, 20, 0};
+    // The collision capsule at the current position
+    Capsule GetCapsule() {
+        return {position, {position.x, position.y + capsule_height, position.z}, capsule_radius};
+    }
 
+    // Feet cover the bottom of the capsule, bounds cover all of it
+    void UpdateBounds() {
+        float bottom = position.y - capsule_radius;
         feet = {
-            {position.x - 0.15f, position.y - 0.1f, position.z - 0.15f},
-            {position.x + 0.15f, position.y, position.z + 0.15f}
+            {position.x - capsule_radius / 2, bottom - 0.1f, position.z - capsule_radius / 2},
+            {position.x + capsule_radius / 2, bottom + 0.05f, position.z + capsule_radius / 2}
         };
 
         bounds = {
-            {position.x - 0.2f, position.y, position.z - 0.2f},
-            {position.x + 0.2f, position.y + 1.2f, position.z + 0.2f}
+            {position.x - capsule_radius, bottom, position.z - capsule_radius},
+            {position.x + capsule_radius, position.y + capsule_height + capsule_radius, position.z + capsule_radius}
         };
     }
 
-    void OnCollide(BoundingBox box) {
-        if(DEBUG) return;
+    // Slide the capsule along motion, returns the motion that was blocked by the first steep surface.
+    // While on the ground steep surfaces act as vertical walls so edges cannot launch the player upwards.
+    Vector3 Slide(CollisionWorld * world, Vector3 motion, int max_hits, bool on_ground) {
+        Vector3 blocked = {0};
+        for(int i = 0; i < max_hits; ++i) {
+            if(Vector3LengthSqr(motion) < 0.0000001f)
+                break;
+
+            ++queries;
+            SweepHit hit = SweepCapsule(world, GetCapsule(), motion);
+            position = Vector3Add(position, Vector3Scale(motion, hit.time));
+            if(!hit.hit)
+                break;
+
+            if(on_ground && hit.normal.y > 0 && hit.normal.y < walkable)
+                hit.normal = Vector3Normalize({hit.normal.x, 0, hit.normal.z});
+
+            // Land on walkable ground, otherwise lose the velocity going into the surface
+            float into = Vector3DotProduct(velocity, hit.normal);
+            if(hit.normal.y >= walkable) {
+                grounded = true;
+                if(velocity.y < 0)
+                    velocity.y = 0;
+            }
+            else {
+                if(into < 0)
+                    velocity = Vector3Subtract(velocity, Vector3Scale(hit.normal, into));
+                if(Vector3LengthSqr(blocked) == 0)
+                    blocked = Vector3Scale(motion, 1 - hit.time);
+            }
 
-        // The center of the box (x and z only)
-        Vector2 center = {(box.min.x + box.max.x) / 2.0f, (box.min.z + box.max.z) / 2.0f};
-   
-        // Calculate the direction away from the wall and the net velocity
-        float angle = atan2f(-center.y + position.z, -center.x + position.x); // tan-1(rise/run) == angle
-        net_velocity = sqrtf((velocity.x * velocity.x) + (velocity.z * velocity.z));
+            // Continue with the remaining motion projected onto the surface
+            Vector3 remaining = Vector3Scale(motion, 1 - hit.time);
+            motion = Vector3Subtract(remaining, Vector3Scale(hit.normal, Vector3DotProduct(remaining, hit.normal)));
+        }
+        return blocked;
+    }
 
-        // Move in the calculated direction
-        position.x += cosf(angle) * net_velocity * deltat;
-        position.z += sinf(angle) * net_velocity * deltat;
+    // Swept capsule movement with slide and step resolution, makes at most 10 world queries
+    void Move(CollisionWorld * world, Vector3 motion) {
+        queries = 0;
+        bool was_grounded = grounded;
+        grounded = false;
 
-        velocity = {
-            (cosf(angle) * net_velocity + velocity.x) / 2.0f,
-            velocity.y,
-            (sinf(angle) * net_velocity + velocity.z) / 2.0f
-        };
+        if(DEBUG) {
+            position = Vector3Add(position, motion);
+            return;
+        }
+
+        // Resolve any overlap left by moving platforms, spawning or teleports
+        ++queries;
+        position = Vector3Add(position, DepenetrateCapsule(world, GetCapsule()));
+
+        Vector3 start = position;
+        Vector3 blocked = Slide(world, motion, 4, was_grounded);
+
+        // Blocked by a wall while walking, try stepping over it
+        Vector3 step = {blocked.x, 0, blocked.z};
+        if(was_grounded && Vector3LengthSqr(step) > 0) {
+            Vector3 walked = position;
+
+            ++queries;
+            SweepHit up = SweepCapsule(world, GetCapsule(), {0, step_height, 0});
+            Vector3 raised = Vector3Add(position, {0, step_height * up.time, 0});
+
+            ++queries;
+            position = raised;
+            SweepHit forward = SweepCapsule(world, GetCapsule(), step);
+            position = Vector3Add(position, Vector3Scale(step, forward.time));
+
+            ++queries;
+            SweepHit down = SweepCapsule(world, GetCapsule(), {0, -(raised.y - walked.y) - CAPSULE_SKIN, 0});
+            position.y -= (raised.y - walked.y + CAPSULE_SKIN) * down.time;
+
+            // Landing on the rounded bottom gives edge normals, so also accept walkable ground straight below
+            bool landed = down.hit && down.normal.y >= walkable;
+            if(down.hit && !landed) {
+                ++queries;
+                RayCollision below = world->CastRay({position, {0, -1, 0}}, capsule_radius + step_height);
+                landed = below.hit && below.normal.y >= walkable;
+            }
+
+            // Only keep the step if it landed and got further than sliding did
+            float stepped = Vector3LengthSqr(Vector3Subtract({position.x, 0, position.z}, {start.x, 0, start.z}));
+            float slid = Vector3LengthSqr(Vector3Subtract({walked.x, 0, walked.z}, {start.x, 0, start.z}));
+            if(landed && stepped > slid)
+                grounded = true;
+            else
+                position = walked;
+        }
+
+        // Snap to the ground below when walking off small ledges or down slopes
+        if(!grounded && velocity.y <= 0) {
+            float probe = was_grounded ? step_height : CAPSULE_SKIN * 4;
+
+            ++queries;
+            SweepHit down = SweepCapsule(world, GetCapsule(), {0, -probe, 0});
+            if(down.hit && down.normal.y >= walkable) {
+                position.y -= probe * down.time;
+                grounded = true;
+            }
+        }
     }
 
-    void OnCollide(Vector3 point) {
+    void OnCollide(BoundingBox box) {
         if(DEBUG) return;
 
-        // The center of the point (x and z only)
-        Vector2 center = {
-            point.x,
-            point.z
-        };
+        // The center of the box (x and z only)
+        Vector2 center = {(box.min.x + box.max.x) / 2.0f, (box.min.z + box.max.z) / 2.0f};
    
         // Calculate the direction away from the wall and the net velocity
         float angle = atan2f(-center.y + position.z, -center.x + position.x); // tan-1(rise/run) == angle
@@ -185,90 +364,4 @@ class Player {
             (sinf(angle) * net_velocity + velocity.z) / 2.0f
         };
     }
-
-    void CheckCollision(Model model) {
-        grounded = false;
-
-        Ray collisionRay;
-        RayCollision rayCollision;
-
-        // Add extra room for error when moving fast
-        float boundry = velocity.y < -10 ? -velocity.y * deltat / 2 : 0;
-        
-        for(float angle = 0; angle < PI * 2; angle += PI / 8) {
-            // Check for walls
-            for(float height = 0.15f; height < 1.3f; height += 0.1f) {
-                // Get the direction of movement
-                collisionRay = {
-                    {
-                        position.x,
-                        position.y + height,
-                        position.z
-                    },
-                    {
-                        cosf(angle),
-                        0,
-                        sinf(angle)
-                    }
-                };
-
-                rayCollision = GetRayCollisionMesh(collisionRay, model.meshes[0], model.transform);
-                if(rayCollision.distance <= 0.3f && rayCollision.hit) {
-                    OnCollide(rayCollision.point);
-                    break;
-                }
-            }
-
-            // Check for ground
-            collisionRay = {
-                {
-                    position.x + sinf(angle) * 0.15f,
-                    position.y,
-                    position.z + cosf(angle) * 0.15f
-                },
-                {
-                    0,
-                    -1,
-                    0
-                }
-            };
-
-            rayCollision = GetRayCollisionMesh(collisionRay, model.meshes[0], model.transform);
-            if(rayCollision.distance <= 0.3 + boundry && rayCollision.hit) {
-                grounded = true;
-
-                // Move up
-                if(rayCollision.distance < 0.29 + boundry)
-                    position.y = Lerp(position.y, rayCollision.point.y + 0.3f, deltat * 5);
-            }
-        }
-
-        // Check center of player if not grounded
-        if(!grounded) {
-            collisionRay = {
-                {position.x, position.y + 0.5f, position.z},
-                {0, -1, 0}
-            };
-            rayCollision = GetRayCollisionMesh(collisionRay, model.meshes[0], model.transform);
-
-            if(rayCollision.distance <= 0.3 + boundry && rayCollision.hit) {
-                grounded = true;
-
-                // Move up
-                if(rayCollision.distance < 0.29 + boundry)
-                    position.y = Lerp(position.y, rayCollision.point.y + 0.3f, deltat * 5);
-            }
-        }
-
-        // Check above player if jumping
-        if(velocity.y > 0) {
-            collisionRay = {
-                camera.position,
-                {0, 1, 0}
-            };
-            rayCollision = GetRayCollisionMesh(collisionRay, model.meshes[0], model.transform);
-            if(rayCollision.distance <= 0.1 && rayCollision.hit)
-                velocity.y = 0;
-        }
-    }
 };
\ No newline at end of file
@@ -0,0 +1,425 @@
+#pragma once
+
+// Reference counted cache of models, textures and shaders keyed by path.
+// Released assets stay resident until the unreferenced ones exceed the budget, then the least
+// recently used are unloaded, so returning to a recently visited map does not reload anything.
+#include <raylib.h>
+#include <rlgl.h>
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "world/ObjLoader.cpp"
+
+#define ASSET_CACHE_BUDGET (256 * 1024 * 1024)
+
+using namespace std;
+
+enum AssetType {
+    ASSET_MODEL,
+    ASSET_TEXTURE,
+    ASSET_SHADER
+};
+
+struct Asset {
+    AssetType type;
+    int refs = 0;
+    size_t bytes = 0;
+    // Cache clock value at the last release, orders eviction
+    unsigned long last_used = 0;
+
+    Model model;
+    Texture2D texture;
+    Shader shader;
+};
+
+class AssetCache {
+    public:
+    // Bytes of unreferenced assets kept for reuse
+    size_t budget;
+    unsigned long hits = 0, misses = 0, evictions = 0;
+    size_t resident_bytes = 0;
+    map<string, Asset> assets;
+
+    // A headless cache loads models CPU-side only, and no textures or shaders
+    AssetCache(bool headless = false, size_t budget = ASSET_CACHE_BUDGET) {
+        this->headless = headless;
+        this->budget = budget;
+    }
+
+    AssetCache(const AssetCache &) = delete;
+    AssetCache & operator=(const AssetCache &) = delete;
+
+    // Unload everything, referenced or not (GPU assets need the window still open)
+    void Clear() {
+        for(auto & entry : assets)
+            Unload(entry.second);
+        assets.clear();
+        resident_bytes = 0;
+    }
+
+    // Load builds the model on a miss, by default the file at path is loaded
+    bool AcquireModel(const string & path, Model * model, function<bool (Model *)> load = NULL) {
+        Asset * asset = Find(path);
+        if(asset == NULL) {
+            Model loaded = {0};
+            if(load ? !load(&loaded) : !LoadModelFile(path.c_str(), &loaded))
+                return false;
+
+            asset = Insert(path, ASSET_MODEL);
+            asset->model = loaded;
+            for(int i = 0; i < loaded.meshCount; ++i)
+                asset->bytes += MeshBytes(loaded.meshes[i]);
+            resident_bytes += asset->bytes;
+        }
+        *model = asset->model;
+        return true;
+    }
+
+    bool AcquireTexture(const string & path, Texture2D * texture) {
+        Asset * asset = Find(path);
+        if(asset == NULL) {
+            if(headless)
+                return false;
+
+            Texture2D loaded = LoadTexture(path.c_str());
+            if(loaded.id == 0)
+                return false;
+
+            asset = Insert(path, ASSET_TEXTURE);
+            asset->texture = loaded;
+            asset->bytes = GetPixelDataSize(loaded.width, loaded.height, loaded.format);
+            resident_bytes += asset->bytes;
+        }
+        *texture = asset->texture;
+        return true;
+    }
+
+    // Shaders are keyed by their vertex and fragment paths together, and the defines (lines like
+    // "#define INSTANCED") they are compiled with, added after the #version line of both
+    bool AcquireShader(const string & vertex, const string & fragment, Shader * shader, const string & defines = "") {
+        string key = ShaderKey(vertex, fragment, defines);
+        Asset * asset = Find(key);
+        if(asset == NULL) {
+            if(headless)
+                return false;
+
+            Shader loaded = LoadShaderFiles(vertex, fragment, defines);
+            if(loaded.id == 0)
+                return false;
+
+            asset = Insert(key, ASSET_SHADER);
+            asset->shader = loaded;
+        }
+        *shader = asset->shader;
+        return true;
+    }
+
+    // Hot reloading replaces a resident asset in place, every holder of the old one has to be pointed
+    // at the new one (shaders and textures in cached materials are patched here). Nothing is replaced
+    // when the new file does not load.
+
+    // Load builds the replacement like AcquireModel. The cached materials are kept so the shaders and
+    // textures given to them stay, old gets the replaced model for finding copies of it.
+    bool ReloadModel(const string & path, Model * old, function<bool (Model *)> load = NULL) {
+        auto entry = assets.find(path);
+        if(entry == assets.end() || entry->second.type != ASSET_MODEL)
+            return false;
+
+        Model loaded = {0};
+        if(load ? !load(&loaded) : !LoadModelFile(path.c_str(), &loaded)) {
+            cout << "WARNING: ASSETS: Could not reload '" << path << "', keeping the old model\n";
+            return false;
+        }
+
+        Asset & asset = entry->second;
+        *old = asset.model;
+        for(int i = 0; i < loaded.meshCount; ++i) {
+            if(loaded.meshMaterial[i] >= old->materialCount)
+                loaded.meshMaterial[i] = 0;
+        }
+        for(int i = 0; i < loaded.materialCount; ++i)
+            UnloadMaterialOf(loaded.materials[i]);
+        MemFree(loaded.materials);
+        loaded.materials = old->materials;
+        loaded.materialCount = old->materialCount;
+
+        for(int i = 0; i < old->meshCount; ++i)
+            UnloadMeshOf(old->meshes[i]);
+        MemFree(old->meshes);
+        MemFree(old->meshMaterial);
+
+        resident_bytes -= asset.bytes;
+        asset.bytes = 0;
+        for(int i = 0; i < loaded.meshCount; ++i)
+            asset.bytes += MeshBytes(loaded.meshes[i]);
+        resident_bytes += asset.bytes;
+        asset.model = loaded;
+        cout << "INFO: ASSETS: Reloaded '" << path << "' (" << loaded.meshCount << " meshes)\n";
+        return true;
+    }
+
+    // Textures of the same size and format are updated in place and keep their id
+    bool ReloadTexture(const string & path, Texture2D * texture) {
+        auto entry = assets.find(path);
+        if(entry == assets.end() || entry->second.type != ASSET_TEXTURE)
+            return false;
+
+        Image image = LoadImage(path.c_str());
+        if(image.data == NULL) {
+            cout << "WARNING: ASSETS: Could not reload '" << path << "', keeping the old texture\n";
+            return false;
+        }
+
+        Asset & asset = entry->second;
+        Texture2D old = asset.texture;
+        if(image.width == old.width && image.height == old.height && image.format == old.format && old.mipmaps == 1)
+            UpdateTexture(old, image.data);
+        else {
+            Texture2D loaded = LoadTextureFromImage(image);
+            if(loaded.id == 0) {
+                UnloadImage(image);
+                return false;
+            }
+            ForEachMaterial([&](Material & material) {
+                for(int map = 0; map <= MATERIAL_MAP_BRDF; ++map) {
+                    if(material.maps[map].texture.id == old.id)
+                        material.maps[map].texture = loaded;
+                }
+            });
+            UnloadTexture(old);
+            asset.texture = loaded;
+
+            resident_bytes -= asset.bytes;
+            asset.bytes = GetPixelDataSize(loaded.width, loaded.height, loaded.format);
+            resident_bytes += asset.bytes;
+        }
+        UnloadImage(image);
+
+        *texture = asset.texture;
+        cout << "INFO: ASSETS: Reloaded '" << path << "'\n";
+        return true;
+    }
+
+    // A shader that fails to compile leaves the old one in use. old gets the replaced shader.
+    bool ReloadShader(const string & vertex, const string & fragment, const string & defines, Shader * shader, Shader * old) {
+        auto entry = assets.find(ShaderKey(vertex, fragment, defines));
+        if(entry == assets.end() || entry->second.type != ASSET_SHADER)
+            return false;
+
+        // raylib falls back to its default shader when compiling or linking fails
+        Shader loaded = LoadShaderFiles(vertex, fragment, defines);
+        if(loaded.id == 0 || loaded.id == rlGetShaderIdDefault()) {
+            cout << "WARNING: ASSETS: Could not compile '" << vertex << "' with '" << fragment << "', keeping the old shader\n";
+            return false;
+        }
+
+        Asset & asset = entry->second;
+        *old = asset.shader;
+        ForEachMaterial([&](Material & material) {
+            if(material.shader.id == old->id)
+                material.shader = loaded;
+        });
+        UnloadShader(*old);
+        asset.shader = loaded;
+
+        *shader = loaded;
+        cout << "INFO: ASSETS: Reloaded '" << vertex << "' with '" << fragment << "'\n";
+        return true;
+    }
+
+    // Take a reference to every resident model without counting hits, so other threads can read
+    // their CPU-side meshes until each is released
+    void PinModels(map<string, Model> * out) {
+        for(auto & entry : assets) {
+            if(entry.second.type != ASSET_MODEL)
+                continue;
+            ++entry.second.refs;
+            (*out)[entry.first] = entry.second.model;
+        }
+    }
+
+    // Drop one reference, unreferenced assets stay resident within the budget
+    void Release(const string & key) {
+        auto entry = assets.find(key);
+        if(entry == assets.end() || entry->second.refs == 0)
+            return;
+
+        if(--entry->second.refs == 0) {
+            entry->second.last_used = ++clock;
+            Trim();
+        }
+    }
+
+    void ReleaseShader(const string & vertex, const string & fragment, const string & defines = "") {
+        Release(ShaderKey(vertex, fragment, defines));
+    }
+
+    // Unload least recently used unreferenced assets until they fit the budget
+    void Trim() {
+        while(true) {
+            size_t unused_bytes = 0;
+            auto oldest = assets.end();
+            for(auto entry = assets.begin(); entry != assets.end(); ++entry) {
+                if(entry->second.refs > 0)
+                    continue;
+                unused_bytes += entry->second.bytes;
+                if(oldest == assets.end() || entry->second.last_used < oldest->second.last_used)
+                    oldest = entry;
+            }
+            if(oldest == assets.end() || unused_bytes <= budget)
+                return;
+
+            cout << "INFO: ASSETS: Evicted '" << oldest->first << "' (" << oldest->second.bytes / 1024 << " KiB)\n";
+            resident_bytes -= oldest->second.bytes;
+            Unload(oldest->second);
+            assets.erase(oldest);
+            ++evictions;
+        }
+    }
+
+    private:
+    bool headless;
+    unsigned long clock = 0;
+
+    // Find a resident asset and take a reference to it
+    Asset * Find(const string & key) {
+        auto entry = assets.find(key);
+        if(entry == assets.end()) {
+            ++misses;
+            return NULL;
+        }
+        ++hits;
+        ++entry->second.refs;
+        return &entry->second;
+    }
+
+    Asset * Insert(const string & key, AssetType type) {
+        Asset & asset = assets[key];
+        asset.type = type;
+        asset.refs = 1;
+        return &asset;
+    }
+
+    bool LoadModelFile(const char * path, Model * model) {
+        // Without a GL context raylib cannot load models, parse the OBJ directly
+        if(headless) {
+            Mesh mesh;
+            if(!ObjLoader::Load(path, &mesh))
+                return false;
+            *model = LoadModelFromMesh(mesh);
+            return true;
+        }
+
+        if(!FileExists(path))
+            return false;
+        *model = LoadModel(path);
+        return model->meshCount > 0;
+    }
+
+    static string ShaderKey(const string & vertex, const string & fragment, const string & defines) {
+        return vertex + "|" + fragment + (defines.empty() ? "" : "|" + defines);
+    }
+
+    // GLSL 100 has no includes, each '#include "file"' line is replaced by the file next to the shader.
+    // The defines go after the #version line, which has to come first.
+    static bool ShaderText(const string & path, const string & defines, string * text, int depth = 0) {
+        char * source = LoadFileText(path.c_str());
+        if(source == NULL)
+            return false;
+        istringstream lines(source);
+        UnloadFileText(source);
+
+        string directory = path.substr(0, path.find_last_of('/') + 1);
+        string line;
+        while(getline(lines, line)) {
+            size_t open = line.find('"'), close = line.rfind('"');
+            if(line.compare(0, 9, "#include ") != 0 || open == close) {
+                *text += line + "\n";
+                if(depth == 0 && line.compare(0, 9, "#version ") == 0)
+                    *text += defines + "\n";
+                continue;
+            }
+            // Includes nest, but not forever
+            string included = directory + line.substr(open + 1, close - open - 1);
+            if(depth == 8 || !ShaderText(included, "", text, depth + 1)) {
+                cout << "WARNING: ASSETS: Could not include '" << included << "' in '" << path << "'\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A shader id of 0 when either file or an include is missing
+    static Shader LoadShaderFiles(const string & vertex, const string & fragment, const string & defines) {
+        string vertex_text, fragment_text;
+        if(!ShaderText(vertex, defines, &vertex_text) || !ShaderText(fragment, defines, &fragment_text))
+            return {0};
+        return LoadShaderFromMemory(vertex_text.c_str(), fragment_text.c_str());
+    }
+
+    // Every material of every cached model, copies of the models share them
+    void ForEachMaterial(function<void (Material &)> patch) {
+        for(auto & entry : assets) {
+            if(entry.second.type != ASSET_MODEL)
+                continue;
+            for(int i = 0; i < entry.second.model.materialCount; ++i)
+                patch(entry.second.model.materials[i]);
+        }
+    }
+
+    void UnloadMeshOf(Mesh mesh) {
+        if(headless)
+            ObjLoader::Unload(mesh);
+        else
+            UnloadMesh(mesh);
+    }
+
+    void UnloadMaterialOf(Material material) {
+        if(headless)
+            MemFree(material.maps);
+        else
+            UnloadMaterial(material);
+    }
+
+    static size_t MeshBytes(Mesh mesh) {
+        size_t floats = 0;
+        if(mesh.vertices) floats += mesh.vertexCount * 3;
+        if(mesh.texcoords) floats += mesh.vertexCount * 2;
+        if(mesh.normals) floats += mesh.vertexCount * 3;
+        if(mesh.tangents) floats += mesh.vertexCount * 4;
+        size_t bytes = floats * sizeof(float);
+        if(mesh.colors) bytes += mesh.vertexCount * 4;
+        if(mesh.indices) bytes += mesh.triangleCount * 3 * sizeof(unsigned short);
+        return bytes;
+    }
+
+    void Unload(Asset & asset) {
+        switch(asset.type) {
+            case ASSET_MODEL:
+                if(!headless) {
+                    UnloadModel(asset.model);
+                    break;
+                }
+
+                // Headless models were never uploaded, free the CPU side only
+                for(int i = 0; i < asset.model.meshCount; ++i)
+                    ObjLoader::Unload(asset.model.meshes[i]);
+                for(int i = 0; i < asset.model.materialCount; ++i)
+                    MemFree(asset.model.materials[i].maps);
+                MemFree(asset.model.meshes);
+                MemFree(asset.model.materials);
+                MemFree(asset.model.meshMaterial);
+                break;
+            case ASSET_TEXTURE:
+                UnloadTexture(asset.texture);
+                break;
+            case ASSET_SHADER:
+                UnloadShader(asset.shader);
+                break;
+        }
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+// Picks the render scale that keeps frames within a time budget. The scales between max_scale and
+// min_scale are split into a few fixed levels so the renderer can keep a render target for each.
+// A level is dropped once frames run over budget for a few frames in a row. A level is raised once
+// the smoothed frame time, scaled by the next level's extra pixels, fits with headroom. Under vsync
+// frames sit at the budget whatever the load, so a stretch pinned there probes a level up; when that
+// probe goes over budget the level is dropped again and the next probe waits twice as long.
+#include <raymath.h>
+
+#include <algorithm>
+
+// Render targets kept, level 0 is max_scale and the last level min_scale
+#define DYNRES_LEVELS 6
+// Weight of the newest frame in the smoothed frame time
+#define DYNRES_SMOOTHING 0.1f
+// Frames after a change before the next one, the smoothed time has to catch up first
+#define DYNRES_COOLDOWN 15
+// Frames over DYNRES_DROP times the budget before a level is dropped
+#define DYNRES_DROP 1.1f
+#define DYNRES_DROP_FRAMES 8
+// Frames the next level up has to be predicted under DYNRES_RAISE times the budget before it is raised
+#define DYNRES_RAISE 0.85f
+#define DYNRES_RAISE_FRAMES 30
+// Frames this close to the budget are taken as held there by vsync
+#define DYNRES_PINNED 0.95f
+// Frames within budget before probing a level up, doubled after every failed probe up to the max
+#define DYNRES_PROBE_FRAMES 120
+#define DYNRES_PROBE_MAX 960
+
+using namespace std;
+
+class DynamicResolution {
+    public:
+    bool enabled = true;
+    // Frame time to hold in milliseconds
+    float budget_ms = 1000 / 60.0f;
+    float min_scale = 0.5f;
+    float max_scale = 1;
+
+    int level = 0;
+    // Smoothed frame time in milliseconds
+    float average_ms = 0;
+    // Level changes since the start, for the console
+    unsigned int changes = 0;
+
+    float Scale(int level) const {
+        return Lerp(max_scale, min_scale, level / (float)(DYNRES_LEVELS - 1));
+    }
+
+    float Scale() const {
+        return Scale(level);
+    }
+
+    // Feed the last frame's time, true when the level changed
+    bool Update(float frame_ms) {
+        average_ms = average_ms == 0 ? frame_ms : Lerp(average_ms, frame_ms, DYNRES_SMOOTHING);
+        if(!enabled)
+            return SetLevel(0);
+
+        ++since_change;
+        over = frame_ms > budget_ms * DYNRES_DROP ? over + 1 : 0;
+        if(level > 0) {
+            // Cost goes with the pixel count, the square of the scale
+            float ratio = Scale(level - 1) / Scale();
+            fits = average_ms * ratio * ratio < budget_ms * DYNRES_RAISE ? fits + 1 : 0;
+            steady = average_ms > budget_ms * DYNRES_PINNED && average_ms < budget_ms * DYNRES_DROP ? steady + 1 : 0;
+        }
+        if(since_change < DYNRES_COOLDOWN)
+            return false;
+
+        if(over >= DYNRES_DROP_FRAMES && level < DYNRES_LEVELS - 1) {
+            // Going straight back down means the last probe up did not fit
+            if(probed)
+                probe_frames = min(probe_frames * 2, DYNRES_PROBE_MAX);
+            return SetLevel(level + 1);
+        }
+        if(level > 0 && (fits >= DYNRES_RAISE_FRAMES || steady >= probe_frames)) {
+            bool probe = fits < DYNRES_RAISE_FRAMES;
+            SetLevel(level - 1);
+            probed = probe;
+            return true;
+        }
+        // A probe that held for a while was right, the next one can come sooner
+        if(probed && since_change > DYNRES_COOLDOWN + DYNRES_RAISE_FRAMES) {
+            probed = false;
+            probe_frames = DYNRES_PROBE_FRAMES;
+        }
+        return false;
+    }
+
+    bool SetLevel(int level) {
+        level = Clamp(level, 0, DYNRES_LEVELS - 1);
+        if(level == this->level)
+            return false;
+        this->level = level;
+        ++changes;
+        since_change = over = fits = steady = 0;
+        probed = false;
+        return true;
+    }
+
+    private:
+    int since_change = 0;
+    // Consecutive frames over budget, with room for the next level up and within budget
+    int over = 0, fits = 0, steady = 0;
+    int probe_frames = DYNRES_PROBE_FRAMES;
+    // The last change was a probe up
+    bool probed = false;
+};
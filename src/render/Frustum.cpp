@@ -0,0 +1,174 @@
+#pragma once
+
+// View frustum culling. ChunkBounds keeps boxes as separate min and max arrays per axis so the
+// SSE path tests four boxes against a plane at once: per plane only the corner furthest along its
+// normal is tested (which corner that is only depends on the plane), and a box is culled once
+// that corner is behind any plane.
+#include <raylib.h>
+#include <raymath.h>
+#include <float.h>
+#include <math.h>
+
+#include <vector>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// The clip planes BeginMode3D projects with (rlgl's RL_CULL_DISTANCE_NEAR and _FAR)
+#define FRUSTUM_NEAR 0.01
+#define FRUSTUM_FAR 1000.0
+
+using namespace std;
+
+struct Frustum {
+    // Left, right, bottom, top, near, far. A point p is inside a plane when dot(xyz, p) + w >= 0.
+    Vector4 planes[6];
+
+    // The frustum a camera draws with on a target of the given aspect
+    static Frustum FromCamera(Camera3D camera, float aspect) {
+        Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+        Matrix projection = MatrixPerspective(camera.fovy * DEG2RAD, aspect, FRUSTUM_NEAR, FRUSTUM_FAR);
+        Matrix m = MatrixMultiply(view, projection);
+
+        // Rows of the clip matrix combined (Gribb and Hartmann), raylib matrices are column major
+        Vector4 x = {m.m0, m.m4, m.m8, m.m12};
+        Vector4 y = {m.m1, m.m5, m.m9, m.m13};
+        Vector4 z = {m.m2, m.m6, m.m10, m.m14};
+        Vector4 w = {m.m3, m.m7, m.m11, m.m15};
+
+        Frustum frustum;
+        frustum.planes[0] = Plane(w, x, 1);
+        frustum.planes[1] = Plane(w, x, -1);
+        frustum.planes[2] = Plane(w, y, 1);
+        frustum.planes[3] = Plane(w, y, -1);
+        frustum.planes[4] = Plane(w, z, 1);
+        frustum.planes[5] = Plane(w, z, -1);
+        return frustum;
+    }
+
+    bool Contains(Vector3 point) const {
+        for(const Vector4 & plane : planes) {
+            if(plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w < 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Whether a sphere is at least partly inside
+    bool Contains(Vector3 center, float radius) const {
+        for(const Vector4 & plane : planes) {
+            if(plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    private:
+    // w + sign * row, normalised so plane distances are in world units
+    static Vector4 Plane(Vector4 w, Vector4 row, float sign) {
+        Vector4 plane = {w.x + sign * row.x, w.y + sign * row.y, w.z + sign * row.z, w.w + sign * row.w};
+        float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+        return {plane.x / length, plane.y / length, plane.z / length, plane.w / length};
+    }
+};
+
+class ChunkBounds {
+    public:
+    // Box corners, padded to a multiple of four with boxes that are always culled
+    vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+    unsigned int count = 0;
+
+    void Clear() {
+        for(vector<float> * axis : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+            axis->clear();
+        count = 0;
+    }
+
+    void Add(BoundingBox box) {
+        // Overwrite the padding if there is some
+        for(vector<float> * axis : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+            axis->resize(count);
+        min_x.push_back(box.min.x); min_y.push_back(box.min.y); min_z.push_back(box.min.z);
+        max_x.push_back(box.max.x); max_y.push_back(box.max.y); max_z.push_back(box.max.z);
+        ++count;
+
+        // Inverted boxes have every corner behind some plane
+        while(min_x.size() % 4) {
+            min_x.push_back(FLT_MAX); min_y.push_back(FLT_MAX); min_z.push_back(FLT_MAX);
+            max_x.push_back(-FLT_MAX); max_y.push_back(-FLT_MAX); max_z.push_back(-FLT_MAX);
+        }
+    }
+
+    BoundingBox Get(unsigned int index) const {
+        return {{min_x[index], min_y[index], min_z[index]}, {max_x[index], max_y[index], max_z[index]}};
+    }
+
+    // Sets visible[i] to whether box i is at least partly inside the frustum, returns how many are
+    unsigned int Cull(const Frustum & frustum, vector<unsigned char> * visible) const {
+        visible->resize(min_x.size());
+        unsigned int drawn = 0;
+
+#ifdef __SSE__
+        for(unsigned int i = 0; i < min_x.size(); i += 4) {
+            __m128 outside = _mm_setzero_ps();
+            for(const Vector4 & plane : frustum.planes) {
+                __m128 x = _mm_load_ps1(&plane.x), y = _mm_load_ps1(&plane.y), z = _mm_load_ps1(&plane.z);
+                __m128 px = _mm_loadu_ps(plane.x >= 0 ? &max_x[i] : &min_x[i]);
+                __m128 py = _mm_loadu_ps(plane.y >= 0 ? &max_y[i] : &min_y[i]);
+                __m128 pz = _mm_loadu_ps(plane.z >= 0 ? &max_z[i] : &min_z[i]);
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, px), _mm_mul_ps(y, py)), _mm_mul_ps(z, pz)), _mm_load_ps1(&plane.w));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for(unsigned int j = 0; j < 4; ++j) {
+                (*visible)[i + j] = !(mask & (1 << j));
+                drawn += (*visible)[i + j];
+            }
+        }
+#else
+        for(unsigned int i = 0; i < min_x.size(); ++i) {
+            bool inside = true;
+            for(const Vector4 & plane : frustum.planes) {
+                float px = plane.x >= 0 ? max_x[i] : min_x[i];
+                float py = plane.y >= 0 ? max_y[i] : min_y[i];
+                float pz = plane.z >= 0 ? max_z[i] : min_z[i];
+                if(plane.x * px + plane.y * py + plane.z * pz + plane.w < 0) {
+                    inside = false;
+                    break;
+                }
+            }
+            (*visible)[i] = inside;
+            drawn += inside;
+        }
+#endif
+        visible->resize(count);
+        return drawn;
+    }
+
+    // Reference for Cull, a box is culled when all eight of its corners are behind one plane
+    unsigned int CullBruteForce(const Frustum & frustum, vector<unsigned char> * visible) const {
+        visible->assign(count, 0);
+        unsigned int drawn = 0;
+        for(unsigned int i = 0; i < count; ++i) {
+            bool inside = true;
+            for(const Vector4 & plane : frustum.planes) {
+                bool all_behind = true;
+                for(int corner = 0; corner < 8 && all_behind; ++corner) {
+                    float x = corner & 1 ? max_x[i] : min_x[i];
+                    float y = corner & 2 ? max_y[i] : min_y[i];
+                    float z = corner & 4 ? max_z[i] : min_z[i];
+                    all_behind = plane.x * x + plane.y * y + plane.z * z + plane.w < 0;
+                }
+                if(all_behind) {
+                    inside = false;
+                    break;
+                }
+            }
+            (*visible)[i] = inside;
+            drawn += inside;
+        }
+        return drawn;
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+// Groups draws of the same mesh and material so each group goes to the GPU as one instanced draw
+// with its transforms in a per instance buffer. Meshes and materials are matched by address, so
+// copies of a cached model (which share both) batch together. Groups are only drawn instanced
+// when their shader has an instanced variant paired with it (base.vs with INSTANCED defined).
+#include <raylib.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class InstanceBatcher {
+    public:
+    // Off draws every instance on its own, for comparing against the instanced path
+    bool instancing = true;
+
+    // Draw calls and instances of the last Flush
+    unsigned int draw_calls = 0, instance_count = 0;
+
+    // Groups drawn with plain are drawn with instanced when there is more than one instance
+    void Pair(Shader plain, Shader instanced) {
+        instanced_shaders[plain.id] = instanced;
+    }
+
+    // A paired shader was recompiled, on either side of the pair
+    void Replace(Shader old, Shader loaded) {
+        auto pair = instanced_shaders.find(old.id);
+        if(pair != instanced_shaders.end()) {
+            Shader instanced = pair->second;
+            instanced_shaders.erase(pair);
+            instanced_shaders[loaded.id] = instanced;
+        }
+        for(auto & entry : instanced_shaders) {
+            if(entry.second.id == old.id)
+                entry.second = loaded;
+        }
+    }
+
+    void Add(const Mesh & mesh, const Material & material, Matrix transform) {
+        // Objects of a type come in runs, so the last group is checked before the lookup
+        if(last >= groups.size() || groups[last].mesh != &mesh || groups[last].material != &material) {
+            auto found = group_index.find({&mesh, &material});
+            if(found == group_index.end()) {
+                found = group_index.insert({{&mesh, &material}, (unsigned int)groups.size()}).first;
+                groups.push_back({&mesh, &material});
+            }
+            last = found->second;
+        }
+        groups[last].transforms.push_back(transform);
+    }
+
+    // Draw calls the queued instances will take
+    unsigned int DrawCalls() const {
+        unsigned int calls = 0;
+        for(const Group & group : groups)
+            calls += Instanced(group) ? 1 : group.transforms.size();
+        return calls;
+    }
+
+    // Draw and clear everything queued, inside BeginMode3D
+    void Flush() {
+        draw_calls = DrawCalls();
+        instance_count = 0;
+        for(Group & group : groups) {
+            instance_count += group.transforms.size();
+            if(Instanced(group)) {
+                Material material = *group.material;
+                material.shader = instanced_shaders.at(material.shader.id);
+                DrawMeshInstanced(*group.mesh, material, group.transforms.data(), group.transforms.size());
+            }
+            else {
+                for(const Matrix & transform : group.transforms)
+                    DrawMesh(*group.mesh, *group.material, transform);
+            }
+            group.transforms.clear();
+        }
+    }
+
+    // Drop the queued instances without drawing them
+    void Clear() {
+        for(Group & group : groups)
+            group.transforms.clear();
+    }
+
+    // Forget every group, the meshes and materials they point at are about to be unloaded
+    void Reset() {
+        groups.clear();
+        group_index.clear();
+    }
+
+    private:
+    // Groups are kept between frames so their transform buffers are reused
+    struct Group {
+        const Mesh * mesh;
+        const Material * material;
+        vector<Matrix> transforms;
+    };
+    vector<Group> groups;
+    map<pair<const Mesh *, const Material *>, unsigned int> group_index;
+    unsigned int last = 0;
+
+    // Instanced variant of each paired shader, by the plain shader's id
+    map<unsigned int, Shader> instanced_shaders;
+
+    bool Instanced(const Group & group) const {
+        return instancing && group.transforms.size() > 1 && instanced_shaders.count(group.material->shader.id);
+    }
+};
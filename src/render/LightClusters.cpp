@@ -0,0 +1,229 @@
+#pragma once
+
+// Clustered light culling. The view frustum is split into froxels (screen tiles by exponential
+// depth slices) and each light is added to the froxels its cutoff sphere reaches, so a fragment
+// only sums the lights listed for its froxel. The lists reach the shaders as an RGBA8 texture with
+// one row of CLUSTER_TEXELS texels per froxel, each byte a light index and CLUSTER_END ending the list.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+// The grid, world.fs and model.fs have to agree with these
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_TEXELS 8
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_MAX_LIGHTS (CLUSTER_TEXELS * 4)
+#define CLUSTER_END 255
+
+// The first slice ends at CLUSTER_NEAR, the rest split the depth up to CLUSTER_FAR exponentially
+// (anything further shares the last slice and only gets lights that reach CLUSTER_FAR)
+#define CLUSTER_NEAR 0.5f
+#define CLUSTER_FAR 1000.0f
+
+// Light (brightness / distance) below which a light is left out, half of one of the 30 shades the
+// shaders quantise to
+#define LIGHT_CUTOFF (1.0f / 60)
+
+using namespace std;
+
+class LightClusters {
+    public:
+    // Lights per cluster and their indices, filled between Begin and Finish
+    unsigned char counts[CLUSTER_COUNT];
+    unsigned char lists[CLUSTER_COUNT * CLUSTER_MAX_LIGHTS];
+    // Lights dropped from full clusters and sphere tests made by the last build
+    unsigned int overflow = 0;
+    unsigned int tests = 0;
+
+    // The view the clusters were built for
+    Vector3 eye, forward, right, up;
+    float tan_x, tan_y;
+
+    // Texture data, CLUSTER_X * CLUSTER_TEXELS by CLUSTER_Y * CLUSTER_Z texels
+    vector<unsigned char> pixels;
+    Texture2D texture = {0};
+
+    LightClusters() {
+        pixels.resize(CLUSTER_X * CLUSTER_TEXELS * CLUSTER_Y * CLUSTER_Z * 4, CLUSTER_END);
+        memset(counts, 0, sizeof(counts));
+    }
+
+    // Create the texture, needs a GL context
+    void Load() {
+        Image image = {
+            pixels.data(),
+            CLUSTER_X * CLUSTER_TEXELS,
+            CLUSTER_Y * CLUSTER_Z,
+            1,
+            PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+        };
+        texture = LoadTextureFromImage(image);
+        SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+    }
+
+    void Unload() {
+        if(texture.id != 0)
+            UnloadTexture(texture);
+        texture = {0};
+    }
+
+    // Start a build for a camera, aspect is the width over the height of the target drawn to
+    void Begin(Camera3D camera, float aspect) {
+        eye = camera.position;
+        forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+        right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+        up = Vector3CrossProduct(right, forward);
+        tan_y = tanf(camera.fovy * DEG2RAD / 2);
+        tan_x = tan_y * aspect;
+
+        // Cluster bounds only depend on the projection
+        if(camera.fovy != built_fovy || aspect != built_aspect) {
+            built_fovy = camera.fovy;
+            built_aspect = aspect;
+            BuildBounds();
+        }
+
+        memset(counts, 0, sizeof(counts));
+        overflow = 0;
+        tests = 0;
+    }
+
+    // Add a light reaching radius to every cluster it overlaps, lists keep the order lights are added in
+    void Add(unsigned char index, Vector3 position, float radius) {
+        Vector3 center = ToView(position);
+        if(center.z + radius < 0)
+            return;
+
+        // Ranges are widened by one so rounding at the edges is left to the exact test
+        int first_slice = max(0, Slice(center.z - radius) - 1);
+        int last_slice = min(CLUSTER_Z - 1, Slice(center.z + radius) + 1);
+        for(int z = first_slice; z <= last_slice; ++z) {
+            // Column and row bounds only grow across the screen, find the span the sphere covers
+            int x0 = 0, x1 = CLUSTER_X - 1, y0 = 0, y1 = CLUSTER_Y - 1;
+            while(x0 < CLUSTER_X && columns[z][x0].y < center.x - radius) ++x0;
+            while(x1 >= 0 && columns[z][x1].x > center.x + radius) --x1;
+            while(y0 < CLUSTER_Y && rows[z][y0].y < center.y - radius) ++y0;
+            while(y1 >= 0 && rows[z][y1].x > center.y + radius) --y1;
+            x0 = max(0, x0 - 1);
+            x1 = min(CLUSTER_X - 1, x1 + 1);
+            y0 = max(0, y0 - 1);
+            y1 = min(CLUSTER_Y - 1, y1 + 1);
+
+            for(int y = y0; y <= y1; ++y) {
+                for(int x = x0; x <= x1; ++x)
+                    Test(Index(x, y, z), index, center, radius);
+            }
+        }
+    }
+
+    // Reference for Add, tests the light against every cluster
+    void AddBruteForce(unsigned char index, Vector3 position, float radius) {
+        Vector3 center = ToView(position);
+        for(int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+            Test(cluster, index, center, radius);
+    }
+
+    // Write the lists into the texture data
+    void Finish() {
+        for(int z = 0; z < CLUSTER_Z; ++z) {
+            for(int y = 0; y < CLUSTER_Y; ++y) {
+                for(int x = 0; x < CLUSTER_X; ++x) {
+                    int cluster = Index(x, y, z);
+                    unsigned char * row = &pixels[((y + z * CLUSTER_Y) * CLUSTER_X * CLUSTER_TEXELS + x * CLUSTER_TEXELS) * 4];
+                    memcpy(row, &lists[cluster * CLUSTER_MAX_LIGHTS], counts[cluster]);
+                    memset(row + counts[cluster], CLUSTER_END, CLUSTER_MAX_LIGHTS - counts[cluster]);
+                }
+            }
+        }
+    }
+
+    void Upload() {
+        if(texture.id != 0)
+            UpdateTexture(texture, pixels.data());
+    }
+
+    static int Index(int x, int y, int z) {
+        return x + CLUSTER_X * (y + CLUSTER_Y * z);
+    }
+
+    // Slice of a view depth, the same formula the shaders use
+    static int Slice(float depth) {
+        if(depth <= CLUSTER_NEAR)
+            return 0;
+        return min(CLUSTER_Z - 1, 1 + (int)floorf(logf(depth / CLUSTER_NEAR) * SliceScale()));
+    }
+
+    // Slices per unit of log depth past CLUSTER_NEAR
+    static float SliceScale() {
+        return (CLUSTER_Z - 1) / logf(CLUSTER_FAR / CLUSTER_NEAR);
+    }
+
+    Vector3 ToView(Vector3 position) {
+        Vector3 relative = Vector3Subtract(position, eye);
+        return {Vector3DotProduct(relative, right), Vector3DotProduct(relative, up), Vector3DotProduct(relative, forward)};
+    }
+
+    private:
+    float built_fovy = 0, built_aspect = 0;
+    // View space bounds of every cluster, and their x and y extents per slice and column or row
+    BoundingBox bounds[CLUSTER_COUNT];
+    Vector2 columns[CLUSTER_Z][CLUSTER_X];
+    Vector2 rows[CLUSTER_Z][CLUSTER_Y];
+
+    static float SliceStart(int slice) {
+        if(slice == 0)
+            return 0;
+        return CLUSTER_NEAR * powf(CLUSTER_FAR / CLUSTER_NEAR, (slice - 1) / (float)(CLUSTER_Z - 1));
+    }
+
+    // Boxes around each froxel, corners at both ends of its slice
+    void BuildBounds() {
+        for(int z = 0; z < CLUSTER_Z; ++z) {
+            float depths[2] = {SliceStart(z), SliceStart(z + 1)};
+            for(int x = 0; x < CLUSTER_X; ++x)
+                columns[z][x] = Extent(-1 + 2.0f * x / CLUSTER_X, -1 + 2.0f * (x + 1) / CLUSTER_X, depths, tan_x);
+            for(int y = 0; y < CLUSTER_Y; ++y)
+                rows[z][y] = Extent(-1 + 2.0f * y / CLUSTER_Y, -1 + 2.0f * (y + 1) / CLUSTER_Y, depths, tan_y);
+
+            for(int y = 0; y < CLUSTER_Y; ++y) {
+                for(int x = 0; x < CLUSTER_X; ++x) {
+                    bounds[Index(x, y, z)] = {
+                        {columns[z][x].x, rows[z][y].x, depths[0]},
+                        {columns[z][x].y, rows[z][y].y, depths[1]}
+                    };
+                }
+            }
+        }
+    }
+
+    // Smallest and largest view space coordinate of a screen span over two depths
+    static Vector2 Extent(float ndc_min, float ndc_max, float * depths, float tan_half) {
+        float values[4] = {
+            ndc_min * depths[0] * tan_half, ndc_min * depths[1] * tan_half,
+            ndc_max * depths[0] * tan_half, ndc_max * depths[1] * tan_half
+        };
+        return {*min_element(values, values + 4), *max_element(values, values + 4)};
+    }
+
+    void Test(int cluster, unsigned char index, Vector3 center, float radius) {
+        ++tests;
+        const BoundingBox & box = bounds[cluster];
+        float dx = max(max(box.min.x - center.x, center.x - box.max.x), 0.0f);
+        float dy = max(max(box.min.y - center.y, center.y - box.max.y), 0.0f);
+        float dz = max(max(box.min.z - center.z, center.z - box.max.z), 0.0f);
+        if(dx * dx + dy * dy + dz * dz > radius * radius)
+            return;
+
+        if(counts[cluster] == CLUSTER_MAX_LIGHTS) {
+            ++overflow;
+            return;
+        }
+        lists[cluster * CLUSTER_MAX_LIGHTS + counts[cluster]++] = index;
+    }
+};
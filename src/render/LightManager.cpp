@@ -2,68 +2,177 @@
 
 // Simple lighting system
 #include <raylib.h>
+#include <math.h>
+#include <string.h>
+
+#include <bitset>
+
+#include "render/LightClusters.cpp"
+#include "render/Renderer.cpp"
+#include "world/Pvs.cpp"
+#include "system/Profiler.cpp"
+
+// Most lights the shaders hold, light indices have to fit in a cluster list byte below CLUSTER_END
+#define MAX_LIGHTS 255
+// Texels per row of the light texture, lights.glsl has to agree
+#define LIGHT_TEXTURE_WIDTH 256
+
+// Shader time wraps so mediump floats keep enough precision for the animations
+#define LIGHT_TIME_WRAP 256.0f
+
+// Animations run in the shaders from the light time, so animated lights are never re-sent
+enum LightAnimation {
+    LIGHT_STEADY,
+    // Smooth sine between full and (1 - amount) brightness, speed in radians per second
+    LIGHT_PULSE,
+    // A new random level between full and (1 - amount) brightness speed times per second
+    LIGHT_FLICKER
+};
 
 struct Light {
     char index;
 
     float active = 0;
-    Vector3 position;
-    float brightness;
+    Vector3 position = {0};
+    float brightness = 0;
+
+    LightAnimation animation = LIGHT_STEADY;
+    float speed = 0;
+    float amount = 0;
+
+    // Static lights baked into the world models, world.fs only adds their animation
+    bool baked = false;
 };
 
 class LightManager {
     public:
     int light_count = 0;
-    Light lights[255];
-    Renderer * renderer;
+    Light lights[MAX_LIGHTS];
+    Renderer * renderer = NULL;
+
+    // Lights per froxel of the current view, the shaders only sum the lights of their froxel
+    LightClusters clusters;
+    // The packed lights, a row of data and a row of animation with a texel per light
+    Texture2D texture = {0};
 
     LightManager(Renderer * renderer) {
         this->renderer = renderer;
+        if(renderer != NULL) {
+            clusters.Load();
+            Load();
+        }
     }
     LightManager(){}
+    LightManager(const LightManager &) = delete;
+    LightManager & operator=(const LightManager &) = delete;
+
+    // The textures need the GL context, unload them before the window closes
+    void Unload() {
+        clusters.Unload();
+        if(texture.id != 0)
+            UnloadTexture(texture);
+        texture = {0};
+    }
 
+    // Mark a light changed, it is packed and sent with the others on the next Flush
     void UpdateLight(int index) {
-        // Get the light from the buffer
-        Light light = lights[index];
-
-        // Pass all the light data to the shader
-        renderer->SetAllShaderVal(
-            TextFormat("lights[%i].active", light.index),
-            &light.active,
-            SHADER_UNIFORM_FLOAT
-        );
-        renderer->SetAllShaderVal(
-            TextFormat("lights[%i].brightness", light.index),
-            &light.brightness,
-            SHADER_UNIFORM_FLOAT
-        );
-        renderer->SetAllShaderVal(
-            TextFormat("lights[%i].position", light.index),
-            &light.position,
-            SHADER_UNIFORM_VEC3
-        );
+        dirty.set(index);
     }
 
-    int CreateLight(float brightness, Vector3 position) {
+    int CreateLight(float brightness, Vector3 position, bool baked = false) {
+        if(light_count == MAX_LIGHTS) {
+            cout << "WARNING: LIGHT: Light limit of " << MAX_LIGHTS << " reached\n";
+            return -1;
+        }
+
         // Define the light
         Light light;
         light.active = 1;
         light.brightness = brightness;
         light.position = position;
         light.index = light_count;
+        light.baked = baked;
 
-        // Assign the light and inform the shaders
+        // Assign the light, the shaders get it on the next flush
         lights[light_count] = light;
         ++light_count;
-        renderer->SetAllShaderVal("lightc", &light_count, SHADER_UNIFORM_INT);
-
-        // Initial update
         UpdateLight(light_count - 1);
 
         // Return light index
         return light_count - 1;
     }
 
+    // Animate a light's brightness between full and (1 - amount), LIGHT_STEADY stops it
+    void Animate(int index, LightAnimation animation, float speed, float amount) {
+        lights[index].animation = animation;
+        lights[index].speed = speed;
+        lights[index].amount = Clamp(amount, 0, 1);
+        UpdateLight(index);
+    }
+
+    // Assign the lights to the clusters of a camera's view and hand the lists to the shaders, screen
+    // is the size of the target drawn to. Each light reaches until it is dimmer than LIGHT_CUTOFF,
+    // animated lights are culled at their full brightness. Steady baked lights go after the rest
+    // so world.fs can stop at the first one (and full clusters drop them first). With a PVS, lights
+    // that reach no cell visible from its viewpoint are skipped.
+    void Cull(Camera3D camera, Vector2 screen, const Pvs * pvs = NULL) {
+        PROFILE_ZONE("LightManager::Cull");
+        clusters.Begin(camera, screen.x / screen.y);
+        for(int pass = 0; pass < 2; ++pass) {
+            for(int i = 0; i < light_count; ++i) {
+                bool last = lights[i].baked && lights[i].animation == LIGHT_STEADY;
+                if(last != (pass == 1) || lights[i].active <= 0 || lights[i].brightness == 0)
+                    continue;
+
+                float range = fabsf(lights[i].brightness) / LIGHT_CUTOFF;
+                Vector3 reach = {range, range, range};
+                if(pvs != NULL && !pvs->Visible({Vector3Subtract(lights[i].position, reach), Vector3Add(lights[i].position, reach)}))
+                    continue;
+                clusters.Add(i, lights[i].position, range);
+            }
+        }
+        clusters.Finish();
+
+        if(renderer == NULL)
+            return;
+
+        clusters.Upload();
+        renderer->BindTexture(SAMPLER_LIGHT_CLUSTERS, clusters.texture);
+        renderer->BindTexture(SAMPLER_LIGHT_DATA, texture);
+        Vector4 params = {screen.x, screen.y, CLUSTER_NEAR, LightClusters::SliceScale()};
+        renderer->SetAllShaderVal(UNIFORM_CLUSTER_EYE, &clusters.eye);
+        renderer->SetAllShaderVal(UNIFORM_CLUSTER_FORWARD, &clusters.forward);
+        renderer->SetAllShaderVal(UNIFORM_CLUSTER_PARAMS, &params);
+    }
+
+    // Upload the changed lights for the shaders, once per frame before drawing. The span from the
+    // first to the last changed light goes up as one texture update per row; the time is the only
+    // thing sent every frame.
+    void Flush(float time) {
+        PROFILE_ZONE("LightManager::Flush");
+        if(renderer == NULL) {
+            dirty.reset();
+            return;
+        }
+
+        float wrapped = fmodf(time, LIGHT_TIME_WRAP);
+        renderer->SetAllShaderVal(UNIFORM_LIGHT_TIME, &wrapped);
+        if(dirty.none())
+            return;
+
+        int first = 0, last = MAX_LIGHTS - 1;
+        while(!dirty.test(first)) ++first;
+        while(!dirty.test(last)) --last;
+        for(int i = first; i <= last; ++i)
+            Pack(i);
+
+        float count = last - first + 1;
+        UpdateTextureRec(texture, {(float)first, 0, count, 1}, &data[first]);
+        UpdateTextureRec(texture, {(float)first, 1, count, 1}, &animation[first]);
+        dirty.reset();
+    }
+
+    // Upload every light again on the next Flush
     void Update() {
         for(int i = 0;i<light_count;++i) {
             UpdateLight(i);
@@ -72,9 +181,33 @@ class LightManager {
 
     void Reset() {
         for(int i = 0;i<light_count;++i) {
-            lights[i].active = 0;
+            lights[i] = Light();
             UpdateLight(i);
         }
         light_count = 0;
     }
-};
\ No newline at end of file
+
+    private:
+    // Lights changed since the last flush
+    bitset<MAX_LIGHTS> dirty;
+
+    // Packed shader data, position and brightness (0 when off), then animation (plus 4 when baked),
+    // speed, amount and phase
+    Vector4 data[MAX_LIGHTS] = {0};
+    Vector4 animation[MAX_LIGHTS] = {0};
+
+    // Float texels sampled without filtering, so a light reads back exactly as packed
+    void Load() {
+        vector<Vector4> pixels(LIGHT_TEXTURE_WIDTH * 2, {0});
+        Image image = {pixels.data(), LIGHT_TEXTURE_WIDTH, 2, 1, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32};
+        texture = LoadTextureFromImage(image);
+        SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+    }
+
+    void Pack(int index) {
+        Light & light = lights[index];
+        data[index] = {light.position.x, light.position.y, light.position.z, light.brightness * light.active};
+        // Lights animated alike don't run in step
+        animation[index] = {(float)light.animation + (light.baked ? 4 : 0), light.speed, light.amount, index * 2.39996f};
+    }
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+// Splits world meshes into spatial chunks so parts of a model out of view can be skipped. Every
+// triangle goes to the grid cell its centroid is in; a chunk's bounds can reach a little past its
+// cell but always cover its triangles.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <string.h>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Edge length of a chunk cell in model units
+#define CHUNK_SIZE 16.0f
+
+using namespace std;
+
+namespace MeshChunks {
+    // Copies the triangles of an unindexed mesh into one mesh per occupied cell, in cell order.
+    // The source is left alone.
+    vector<Mesh> Split(const Mesh & mesh, float size = CHUNK_SIZE) {
+        map<tuple<int, int, int>, vector<int>> cells;
+        for(int tri = 0; tri + 2 < mesh.vertexCount; tri += 3) {
+            const float * v = &mesh.vertices[tri * 3];
+            tuple<int, int, int> cell = {
+                (int)floorf((v[0] + v[3] + v[6]) / 3 / size),
+                (int)floorf((v[1] + v[4] + v[7]) / 3 / size),
+                (int)floorf((v[2] + v[5] + v[8]) / 3 / size)
+            };
+            cells[cell].push_back(tri);
+        }
+
+        vector<Mesh> chunks;
+        for(auto & cell : cells) {
+            Mesh chunk = {0};
+            chunk.vertexCount = cell.second.size() * 3;
+            chunk.triangleCount = cell.second.size();
+            chunk.vertices = (float *)MemAlloc(chunk.vertexCount * 3 * sizeof(float));
+            if(mesh.texcoords)
+                chunk.texcoords = (float *)MemAlloc(chunk.vertexCount * 2 * sizeof(float));
+            if(mesh.normals)
+                chunk.normals = (float *)MemAlloc(chunk.vertexCount * 3 * sizeof(float));
+            if(mesh.colors)
+                chunk.colors = (unsigned char *)MemAlloc(chunk.vertexCount * 4);
+
+            for(unsigned int i = 0; i < cell.second.size(); ++i) {
+                int from = cell.second[i], to = i * 3;
+                memcpy(&chunk.vertices[to * 3], &mesh.vertices[from * 3], 9 * sizeof(float));
+                if(mesh.texcoords)
+                    memcpy(&chunk.texcoords[to * 2], &mesh.texcoords[from * 2], 6 * sizeof(float));
+                if(mesh.normals)
+                    memcpy(&chunk.normals[to * 3], &mesh.normals[from * 3], 9 * sizeof(float));
+                if(mesh.colors)
+                    memcpy(&chunk.colors[to * 4], &mesh.colors[from * 4], 12);
+            }
+            chunks.push_back(chunk);
+        }
+        return chunks;
+    }
+
+    // A model drawing the chunks with one default material, like LoadModelFromMesh does for one mesh
+    Model ToModel(const vector<Mesh> & chunks) {
+        Model model = {0};
+        model.transform = MatrixIdentity();
+        model.meshCount = chunks.size();
+        model.meshes = (Mesh *)MemAlloc(chunks.size() * sizeof(Mesh));
+        memcpy(model.meshes, chunks.data(), chunks.size() * sizeof(Mesh));
+        model.materialCount = 1;
+        model.materials = (Material *)MemAlloc(sizeof(Material));
+        model.materials[0] = LoadMaterialDefault();
+        model.meshMaterial = (int *)MemAlloc(chunks.size() * sizeof(int));
+        return model;
+    }
+};
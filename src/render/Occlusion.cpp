@@ -0,0 +1,281 @@
+#pragma once
+
+// Software occlusion culling. The world triangles covering the most of the view are rasterized on
+// the CPU into a small buffer of inverse depth (1 / w, larger is nearer, 0 is empty), then boxes
+// are tested against it before their draws are queued. Both sides are conservative: occluders
+// only write pixels they cover entirely, at the farthest depth they reach in the pixel, and a box
+// is only hidden when every pixel its corners span holds something nearer than its nearest corner.
+#include <raylib.h>
+#include <raymath.h>
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "physics/CollisionWorld.cpp"
+#include "render/Frustum.cpp"
+
+// Buffer size, the width has to be a multiple of four
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+// Triangles rasterized per frame, picked by area over squared distance
+#define OCCLUSION_OCCLUDERS 256
+// A box has to be this much (relatively) farther than the occluders to be hidden
+#define OCCLUSION_BIAS 1.001f
+
+using namespace std;
+
+class OcclusionBuffer {
+    public:
+    // Inverse depth, row major from the top left
+    vector<float> depth;
+
+    // Triangles rasterized by the last Build, indices into the triangles it was given
+    vector<unsigned int> occluders;
+
+    OcclusionBuffer() {
+        depth.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0);
+    }
+
+    // Clear the buffer for a camera's view on a target of the given aspect
+    void Begin(Camera3D camera, float aspect) {
+        Matrix view = MatrixLookAt(camera.position, camera.target, camera.up);
+        Matrix projection = MatrixPerspective(camera.fovy * DEG2RAD, aspect, FRUSTUM_NEAR, FRUSTUM_FAR);
+        clip = MatrixMultiply(view, projection);
+        eye = camera.position;
+        fill(depth.begin(), depth.end(), 0.0f);
+    }
+
+    // Begin, then rasterize the largest nearby triangles
+    void Build(Camera3D camera, float aspect, const vector<CollisionTriangle> & triangles) {
+        Begin(camera, aspect);
+        SelectOccluders(triangles, OCCLUSION_OCCLUDERS);
+        for(unsigned int index : occluders)
+            Rasterize(triangles[index]);
+    }
+
+    // The count triangles likely to cover the most of the view, by area over squared distance
+    void SelectOccluders(const vector<CollisionTriangle> & triangles, unsigned int count) {
+        scores.resize(triangles.size());
+        occluders.resize(triangles.size());
+        for(unsigned int i = 0; i < triangles.size(); ++i) {
+            const CollisionTriangle & triangle = triangles[i];
+            Vector3 center = Vector3Scale(Vector3Add(Vector3Add(triangle.a, triangle.b), triangle.c), 1 / 3.0f);
+            float area = Vector3Length(Vector3CrossProduct(Vector3Subtract(triangle.b, triangle.a), Vector3Subtract(triangle.c, triangle.a)));
+            scores[i] = area / (Vector3DistanceSqr(center, eye) + 1);
+            occluders[i] = i;
+        }
+
+        count = min<size_t>(count, occluders.size());
+        partial_sort(occluders.begin(), occluders.begin() + count, occluders.end(), [&](unsigned int a, unsigned int b) {
+            return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+        });
+        occluders.resize(count);
+    }
+
+    // Rasterize one occluder, SSE fills four pixels of a row at once
+    void Rasterize(const CollisionTriangle & triangle) {
+        Setup setup;
+        if(!Prepare(triangle, &setup))
+            return;
+
+        // Rows start on a multiple of four, pixels outside the triangle fail the edge tests anyway
+        int first = setup.left & ~3;
+        for(int y = setup.top; y <= setup.bottom; ++y) {
+            float center_y = y + 0.5f;
+            float row[4];
+            for(int i = 0; i < 4; ++i)
+                row[i] = setup.b[i] * center_y + setup.c[i];
+            float * line = &depth[y * OCCLUSION_WIDTH];
+
+#ifdef __SSE__
+            __m128 a0 = _mm_set1_ps(setup.a[0]), a1 = _mm_set1_ps(setup.a[1]), a2 = _mm_set1_ps(setup.a[2]), a3 = _mm_set1_ps(setup.a[3]);
+            __m128 r0 = _mm_set1_ps(row[0]), r1 = _mm_set1_ps(row[1]), r2 = _mm_set1_ps(row[2]), r3 = _mm_set1_ps(row[3]);
+            __m128 zero = _mm_setzero_ps();
+            for(int x = first; x <= setup.right; x += 4) {
+                __m128 center_x = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3, 2, 1, 0));
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, center_x), r0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, center_x), r1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, center_x), r2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if(_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 farthest = _mm_add_ps(_mm_mul_ps(a3, center_x), r3);
+                __m128 old = _mm_loadu_ps(&line[x]);
+                __m128 nearest = _mm_max_ps(old, farthest);
+                _mm_storeu_ps(&line[x], _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+#else
+            for(int x = first; x <= setup.right; ++x)
+                Pixel(setup, row, x, &line[x]);
+#endif
+        }
+    }
+
+    // Reference for Rasterize, tests every pixel of the buffer one at a time
+    void RasterizeReference(const CollisionTriangle & triangle) {
+        Setup setup;
+        if(!Prepare(triangle, &setup))
+            return;
+
+        for(int y = 0; y < OCCLUSION_HEIGHT; ++y) {
+            float center_y = y + 0.5f;
+            float row[4];
+            for(int i = 0; i < 4; ++i)
+                row[i] = setup.b[i] * center_y + setup.c[i];
+            for(int x = 0; x < OCCLUSION_WIDTH; ++x)
+                Pixel(setup, row, x, &depth[y * OCCLUSION_WIDTH + x]);
+        }
+    }
+
+    // Whether any part of a box could be in front of the occluders (off screen parts count as hidden,
+    // that is for the frustum to decide)
+    bool Visible(BoundingBox box) const {
+        Rect rect;
+        if(!Project(box, &rect))
+            return true;
+        if(rect.left > rect.right || rect.top > rect.bottom)
+            return false;
+
+        for(int y = rect.top; y <= rect.bottom; ++y) {
+            const float * line = &depth[y * OCCLUSION_WIDTH];
+            int x = rect.left;
+#ifdef __SSE__
+            __m128 nearest = _mm_set1_ps(rect.nearest);
+            for(; x + 3 <= rect.right; x += 4) {
+                if(_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(&line[x]), nearest)))
+                    return true;
+            }
+#endif
+            for(; x <= rect.right; ++x) {
+                if(line[x] <= rect.nearest)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // Reference for Visible, checks every pixel of the rectangle one at a time
+    bool VisibleReference(BoundingBox box) const {
+        Rect rect;
+        if(!Project(box, &rect))
+            return true;
+        for(int y = rect.top; y <= rect.bottom; ++y) {
+            for(int x = rect.left; x <= rect.right; ++x) {
+                if(depth[y * OCCLUSION_WIDTH + x] <= rect.nearest)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    private:
+    Matrix clip;
+    Vector3 eye;
+    vector<float> scores;
+
+    // Edge functions a * x + b * y + c (0 to 2, shrunk by half a pixel so they only pass pixels
+    // inside the triangle entirely) and the inverse depth plane (3, lowered to the farthest
+    // depth in each pixel), evaluated at pixel centres
+    struct Setup {
+        float a[4], b[4], c[4];
+        int left, right, top, bottom;
+    };
+
+    // Pixels a box's corners span, with its nearest inverse depth
+    struct Rect {
+        int left, right, top, bottom;
+        float nearest;
+    };
+
+    // Screen position and inverse depth of a point, false when it is behind the near plane
+    bool ToScreen(Vector3 point, Vector3 * screen) const {
+        float x = clip.m0 * point.x + clip.m4 * point.y + clip.m8 * point.z + clip.m12;
+        float y = clip.m1 * point.x + clip.m5 * point.y + clip.m9 * point.z + clip.m13;
+        float w = clip.m3 * point.x + clip.m7 * point.y + clip.m11 * point.z + clip.m15;
+        if(w < FRUSTUM_NEAR)
+            return false;
+        float inverse = 1 / w;
+        *screen = {(x * inverse * 0.5f + 0.5f) * OCCLUSION_WIDTH, (0.5f - y * inverse * 0.5f) * OCCLUSION_HEIGHT, inverse};
+        return true;
+    }
+
+    // Triangles crossing the near plane are skipped, which only ever hides less
+    bool Prepare(const CollisionTriangle & triangle, Setup * setup) const {
+        Vector3 p[3];
+        if(!ToScreen(triangle.a, &p[0]) || !ToScreen(triangle.b, &p[1]) || !ToScreen(triangle.c, &p[2]))
+            return false;
+
+        // Either winding, walls are seen from both sides
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if(fabsf(area) < 1e-6f)
+            return false;
+        if(area < 0) {
+            swap(p[1], p[2]);
+            area = -area;
+        }
+
+        for(int i = 0; i < 3; ++i) {
+            Vector3 from = p[(i + 1) % 3], to = p[(i + 2) % 3];
+            setup->a[i] = from.y - to.y;
+            setup->b[i] = to.x - from.x;
+            setup->c[i] = from.x * to.y - from.y * to.x - 0.5f * (fabsf(setup->a[i]) + fabsf(setup->b[i]));
+        }
+
+        // Inverse depth is linear in screen space
+        float a = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+        float b = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+        setup->a[3] = a;
+        setup->b[3] = b;
+        setup->c[3] = p[0].z - a * p[0].x - b * p[0].y - 0.5f * (fabsf(a) + fabsf(b));
+
+        setup->left = max(0, (int)floorf(min(p[0].x, min(p[1].x, p[2].x))));
+        setup->right = min(OCCLUSION_WIDTH - 1, (int)ceilf(max(p[0].x, max(p[1].x, p[2].x))));
+        setup->top = max(0, (int)floorf(min(p[0].y, min(p[1].y, p[2].y))));
+        setup->bottom = min(OCCLUSION_HEIGHT - 1, (int)ceilf(max(p[0].y, max(p[1].y, p[2].y))));
+        return setup->left <= setup->right && setup->top <= setup->bottom;
+    }
+
+    // One pixel of a row, the same arithmetic as a lane of the SSE loop
+    static void Pixel(const Setup & setup, const float * row, int x, float * pixel) {
+        float center_x = x + 0.5f;
+        for(int i = 0; i < 3; ++i) {
+            if(setup.a[i] * center_x + row[i] < 0)
+                return;
+        }
+        *pixel = max(*pixel, setup.a[3] * center_x + row[3]);
+    }
+
+    // False when a corner is behind the near plane, the box is then never hidden
+    bool Project(BoundingBox box, Rect * rect) const {
+        float left = FLT_MAX, right = -FLT_MAX, top = FLT_MAX, bottom = -FLT_MAX, nearest = 0;
+        for(int corner = 0; corner < 8; ++corner) {
+            Vector3 point = {
+                corner & 1 ? box.max.x : box.min.x,
+                corner & 2 ? box.max.y : box.min.y,
+                corner & 4 ? box.max.z : box.min.z
+            };
+            Vector3 screen;
+            if(!ToScreen(point, &screen))
+                return false;
+            left = min(left, screen.x);
+            right = max(right, screen.x);
+            top = min(top, screen.y);
+            bottom = max(bottom, screen.y);
+            nearest = max(nearest, screen.z);
+        }
+
+        rect->left = max(0, (int)floorf(left));
+        rect->right = min(OCCLUSION_WIDTH - 1, (int)floorf(right));
+        rect->top = max(0, (int)floorf(top));
+        rect->bottom = min(OCCLUSION_HEIGHT - 1, (int)floorf(bottom));
+        rect->nearest = nearest * OCCLUSION_BIAS;
+        return true;
+    }
+};
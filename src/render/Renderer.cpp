@@ -3,39 +3,114 @@
 #define GLSL_VERSION 100
 
 #include <raylib.h>
+#include <rlgl.h>
+#include <string.h>
+
+#include <algorithm>
 #include <iostream>
-#include <map>
+#include <string>
+#include <vector>
+
+#include "render/DynamicResolution.cpp"
+#include "render/Uniforms.cpp"
+#include "system/Profiler.cpp"
 
 using namespace std;
 
 class RShader {
     public:
     Shader shader;
-    map<string, int> locs;
 
-    int GetLoc(const char * key) {
-        // Create key if it doesnt exist yet
-        if(locs.find(key) == locs.end()) {
-            locs.insert({key, GetShaderLocation(shader, key)});
-            cout << "ShaderLoc [Cache] '" << key << "'=" << locs.at(key) << endl;
-        }
-
-        return locs.at(key);
+    // Stage a value for count elements of a uniform from element first, sent on the next Flush.
+    // Values the shader already has are skipped.
+    void Set(Uniform uniform, const void * value, int first = 0, int count = 1) {
+        if(locations.empty() || locations[location_start[uniform] + first] == -1)
+            return;
+
+        int components = UniformComponents(uniform);
+        float * staged = &values[value_start[uniform] + first * components];
+        size_t size = count * components * sizeof(float);
+        if(memcmp(staged, value, size) == 0)
+            return;
+        memcpy(staged, value, size);
+
+        if(dirty_first[uniform] == -1 || first < dirty_first[uniform])
+            dirty_first[uniform] = first;
+        dirty_last[uniform] = max(dirty_last[uniform], first + count - 1);
     }
 
-    // Operator [] can also be used to get shader locs
-    int operator [](const char * key) {
-        return GetLoc(key);
+    // Send every staged change, each uniform's changed elements go up in one call
+    void Flush() {
+        for(int i = 0; i < UNIFORM_COUNT; ++i) {
+            if(dirty_first[i] == -1)
+                continue;
+
+            Uniform uniform = (Uniform)i;
+            int first = dirty_first[i];
+            SetShaderValueV(
+                shader,
+                locations[location_start[i] + first],
+                &values[value_start[i] + first * UniformComponents(uniform)],
+                uniform_info[i].type,
+                dirty_last[i] - first + 1
+            );
+            dirty_first[i] = dirty_last[i] = -1;
+        }
     }
 
-    // When the class is called like RShader(...) it will be treated as a shader value set
-    void operator()(const char * key, const void * value, int uniform) {
-        SetShaderValue(shader, GetLoc(key), value, uniform);
+    // Look up the location of every uniform (and every element of arrays), values already staged
+    // are sent again on the next Flush
+    void Resolve() {
+        locations.clear();
+        int resolved = 0, value_count = 0;
+        for(int i = 0; i < UNIFORM_COUNT; ++i) {
+            const UniformInfo & info = uniform_info[i];
+            location_start[i] = locations.size();
+            value_start[i] = value_count;
+            value_count += info.count * UniformComponents((Uniform)i);
+
+            // Array elements are not guaranteed to have consecutive locations, each is looked up
+            locations.push_back(GetShaderLocation(shader, info.name));
+            for(int element = 1; element < info.count; ++element)
+                locations.push_back(locations[location_start[i]] == -1 ? -1 : GetShaderLocation(shader, TextFormat("%s[%i]", info.name, element)));
+            if(locations[location_start[i]] != -1) {
+                ++resolved;
+                dirty_first[i] = 0;
+                dirty_last[i] = info.count - 1;
+            }
+            else
+                dirty_first[i] = dirty_last[i] = -1;
+        }
+        values.resize(value_count, 0);
+
+        // Samplers read the same unit for the life of the program
+        for(int i = 0; i < SAMPLER_COUNT; ++i) {
+            int location = GetShaderLocation(shader, sampler_info[i].name);
+            if(location != -1)
+                SetShaderValue(shader, location, &sampler_info[i].unit, SHADER_UNIFORM_SAMPLER2D);
+        }
+        cout << "INFO: SHADER: [ID " << shader.id << "] Resolved " << resolved << " of " << UNIFORM_COUNT << " uniforms\n";
     }
 
     // Used to ensure the raylib shader values are still set
     void SetInbuiltLoc(int loc, const char * key) {
         shader.locs[loc] = GetShaderLocation(shader, key);
+        inbuilt.push_back({loc, key, false});
+    }
+
+    // Same for the raylib locations that are attributes, like the instance transforms
+    void SetInbuiltAttrib(int loc, const char * key) {
+        shader.locs[loc] = GetShaderLocationAttrib(shader, key);
+        inbuilt.push_back({loc, key, true});
+    }
+
+    // Swap in a recompiled program, its locations are looked up again and every staged value is
+    // sent to it on the next Flush. The old program is left for the caller to unload.
+    void Reload(Shader loaded) {
+        shader = loaded;
+        for(const InbuiltLoc & loc : inbuilt)
+            shader.locs[loc.loc] = loc.attribute ? GetShaderLocationAttrib(shader, loc.key.c_str()) : GetShaderLocation(shader, loc.key.c_str());
+        Resolve();
     }
 
     // Main constructor
@@ -44,9 +119,33 @@ class RShader {
             TextFormat(vertex, GLSL_VERSION),
             TextFormat(frag, GLSL_VERSION)
         );
+        Resolve();
+    }
+    // Wrap an already loaded shader
+    RShader(Shader shader) {
+        this->shader = shader;
+        Resolve();
     }
     // Null constructor
     RShader() {}
+
+    private:
+    // The raylib locations set by name, set again on Reload
+    struct InbuiltLoc {
+        int loc;
+        string key;
+        bool attribute;
+    };
+    vector<InbuiltLoc> inbuilt;
+
+    // Element locations of every uniform, -1 where the shader does not use it
+    vector<int> locations;
+    int location_start[UNIFORM_COUNT];
+
+    // The values last set, and the span of elements changed since the last Flush
+    vector<float> values;
+    int value_start[UNIFORM_COUNT];
+    int dirty_first[UNIFORM_COUNT], dirty_last[UNIFORM_COUNT];
 };
 
 class Renderer {
@@ -57,14 +156,19 @@ class Renderer {
     // The resolution scale
     float pixelization = 1;
 
+    // Scales the resolution further to hold the frame time, on top of pixelization
+    DynamicResolution dynamic;
+
     // The size of the window
     int width, height;
 
     // The renderer dimensions as a rectange
     Rectangle veiwport;
 
-    // The main render texture
+    // The main render texture, the target of the current dynamic resolution level
     RenderTexture2D render;
+    // A target per dynamic resolution level, allocated up front so changing level never stalls
+    vector<RenderTexture2D> targets;
 
     // The background color
     Color background;
@@ -94,7 +198,7 @@ class Renderer {
         this->width = resolution.x;
         this->height = resolution.y;
         
-        render = LoadRenderTexture(width / pixelization, height / pixelization);
+        LoadTargets();
 
         this->veiwport = {0, 0, resolution.x, resolution.y};
 
@@ -110,23 +214,55 @@ class Renderer {
         shaders[index] = RShader(vertex, frag);
     }
 
-    void SetAllShaderVal(const char * key, void * value, int uniform) {
+    void InitShader(char index, Shader shader) {
+        shaders[index] = RShader(shader);
+    }
+
+    // Stage a uniform in every shader that uses it
+    void SetAllShaderVal(Uniform uniform, const void * value, int first = 0, int count = 1) {
         for(int i = 0;i<shader_count;++i) {
-            shaders[i](key, value, uniform);
+            shaders[i].Set(uniform, value, first, count);
+        }
+    }
+
+    // Bind a texture to its sampler's unit for every shader that reads it, until it is bound again
+    void BindTexture(Sampler sampler, Texture2D texture) {
+        rlActiveTextureSlot(sampler_info[sampler].unit);
+        rlEnableTexture(texture.id);
+        rlActiveTextureSlot(0);
+    }
+
+    // Send the staged uniforms of every shader, once per frame before drawing
+    void FlushShaders() {
+        for(int i = 0;i<shader_count;++i) {
+            shaders[i].Flush();
         }
     }
     
+    // Resize the window, the render targets are made again at the new size
     void ChangeResolution(Vector2 resolution) {
-        this->veiwport = {0, 0, resolution.x, resolution.y};
-        this->resolution = resolution;
+        SetWindowSize(resolution.x, resolution.y);
+        Resize(resolution.x, resolution.y);
+    }
+
+    // Feed the dynamic resolution the last frame's time, once a frame before rendering
+    void AdaptResolution(float frame_ms) {
+        if(dynamic.Update(frame_ms) && !targets.empty())
+            render = targets[dynamic.level];
+        Profiler::Counter("Render scale", dynamic.Scale() / pixelization);
+    }
+
+    // The dynamic resolution bounds changed, the targets are made again at the new scales
+    void SetScaleBounds(float min_scale, float max_scale) {
+        dynamic.min_scale = Clamp(min(min_scale, max_scale), 0.1f, 1);
+        dynamic.max_scale = Clamp(max(min_scale, max_scale), 0.1f, 1);
+        LoadTargets();
     }
 
     void BeginRender() {
         // Update the window dimensions
-        if(IsWindowResized()) {
-            this->width = GetRenderWidth();
-            this->height = GetRenderHeight();
-        }
+        if(IsWindowResized())
+            Resize(GetRenderWidth(), GetRenderHeight());
         
         BeginTextureMode(render);
         ClearBackground(background);
@@ -137,13 +273,15 @@ class Renderer {
 
         BeginDrawing();
 
+        // The target holds the window at its own scale
+        float scale = render.texture.width / (float)width;
         DrawTexturePro(
             render.texture,
             {
-                veiwport.x / pixelization,
-                veiwport.y / pixelization,
-                veiwport.width / pixelization,
-                -veiwport.height / pixelization
+                veiwport.x * scale,
+                veiwport.y * scale,
+                veiwport.width * scale,
+                -veiwport.height * scale
             },
             {
                 0,
@@ -161,7 +299,31 @@ class Renderer {
 
     void Close() {
         EnableCursor();
-        UnloadRenderTexture(render);
+        UnloadTargets();
         CloseWindow();
     }
+
+    private:
+    void Resize(int width, int height) {
+        this->width = width;
+        this->height = height;
+        this->resolution = {(float)width, (float)height};
+        this->veiwport = {0, 0, resolution.x, resolution.y};
+        LoadTargets();
+    }
+
+    void LoadTargets() {
+        UnloadTargets();
+        for(int i = 0; i < DYNRES_LEVELS; ++i) {
+            float scale = dynamic.Scale(i) / pixelization;
+            targets.push_back(LoadRenderTexture(max(1, (int)(width * scale)), max(1, (int)(height * scale))));
+        }
+        render = targets[dynamic.level];
+    }
+
+    void UnloadTargets() {
+        for(RenderTexture2D & target : targets)
+            UnloadRenderTexture(target);
+        targets.clear();
+    }
 };
\ No newline at end of file
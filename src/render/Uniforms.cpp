@@ -0,0 +1,80 @@
+#pragma once
+
+// Every uniform the game sets, a handle is an index into the table below. Shaders resolve the
+// locations of all of them once when they are loaded, so setting one is an array index.
+#include <raylib.h>
+
+enum Uniform {
+    // Tiling, world shader only
+    UNIFORM_TEXSIZE,
+    UNIFORM_TEXSCALE,
+    UNIFORM_GRIDSIZE,
+    UNIFORM_PIXSCALE,
+
+    // Fog and color
+    UNIFORM_VIEW,
+    UNIFORM_FOG_COLOR,
+    UNIFORM_FOG_AMOUNT,
+    UNIFORM_TINT,
+
+    // Lights, see render/LightManager.cpp
+    UNIFORM_LIGHT_TIME,
+
+    // Clusters, see render/LightClusters.cpp
+    UNIFORM_CLUSTER_EYE,
+    UNIFORM_CLUSTER_FORWARD,
+    UNIFORM_CLUSTER_PARAMS,
+
+    UNIFORM_COUNT
+};
+
+struct UniformInfo {
+    const char * name;
+    // SHADER_UNIFORM_FLOAT to SHADER_UNIFORM_VEC4
+    int type;
+    // Elements, more than one for arrays
+    int count;
+};
+
+// In the order of the enum
+const UniformInfo uniform_info[UNIFORM_COUNT] = {
+    {"texsize", SHADER_UNIFORM_FLOAT, 1},
+    {"texscale", SHADER_UNIFORM_FLOAT, 1},
+    {"gridsize", SHADER_UNIFORM_FLOAT, 1},
+    {"pixscale", SHADER_UNIFORM_FLOAT, 1},
+
+    {"view", SHADER_UNIFORM_VEC3, 1},
+    {"fogColor", SHADER_UNIFORM_VEC3, 1},
+    {"fogAmount", SHADER_UNIFORM_FLOAT, 1},
+    {"tint", SHADER_UNIFORM_VEC3, 1},
+
+    {"lightTime", SHADER_UNIFORM_FLOAT, 1},
+
+    {"clusterEye", SHADER_UNIFORM_VEC3, 1},
+    {"clusterForward", SHADER_UNIFORM_VEC3, 1},
+    {"clusterParams", SHADER_UNIFORM_VEC4, 1}
+};
+
+// Textures the game binds itself rather than through a material. Each gets a texture unit of its
+// own, raylib binds material maps to the unit of their index and the models only use the first few.
+enum Sampler {
+    SAMPLER_LIGHT_CLUSTERS,
+    SAMPLER_LIGHT_DATA,
+
+    SAMPLER_COUNT
+};
+
+struct SamplerInfo {
+    const char * name;
+    int unit;
+};
+
+const SamplerInfo sampler_info[SAMPLER_COUNT] = {
+    {"lightClusters", 10},
+    {"lightTexture", 11}
+};
+
+// Floats in one element of a uniform
+inline int UniformComponents(Uniform uniform) {
+    return uniform_info[uniform].type - SHADER_UNIFORM_FLOAT + 1;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// Watches a directory tree for files that were written or moved into place, through inotify.
+// Editors write a file in several steps (or write a temporary copy and rename it), so a change is
+// only reported once the file has been quiet for FILE_WATCH_DEBOUNCE seconds.
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FILE_WATCH_DEBOUNCE 0.25
+
+using namespace std;
+
+class FileWatcher {
+    public:
+    FileWatcher() {}
+    // The inotify descriptor is owned, copies would close it twice
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher & operator=(const FileWatcher &) = delete;
+    ~FileWatcher() {
+        if(fd >= 0)
+            close(fd);
+    }
+
+    // Watch a directory and every directory below it, paths are reported under the given name
+    bool Watch(const string & directory) {
+        if(fd < 0)
+            fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(fd < 0) {
+            cout << "WARNING: WATCH: inotify is not available\n";
+            return false;
+        }
+
+        int watch = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if(watch < 0)
+            return false;
+        directories[watch] = directory;
+
+        DIR * dir = opendir(directory.c_str());
+        if(dir == NULL)
+            return true;
+        while(dirent * entry = readdir(dir)) {
+            if(entry->d_type == DT_DIR && entry->d_name[0] != '.')
+                Watch(directory + "/" + entry->d_name);
+        }
+        closedir(dir);
+        return true;
+    }
+
+    // Files changed since the last call that have been quiet long enough, now is in seconds
+    vector<string> Poll(double now) {
+        Read(now);
+
+        vector<string> ready;
+        for(auto entry = pending.begin(); entry != pending.end();) {
+            if(now - entry->second >= FILE_WATCH_DEBOUNCE) {
+                ready.push_back(entry->first);
+                entry = pending.erase(entry);
+            }
+            else
+                ++entry;
+        }
+        return ready;
+    }
+
+    private:
+    int fd = -1;
+    // Path of every watched directory by its watch descriptor
+    map<int, string> directories;
+    // Changed files and the time of their last event
+    map<string, double> pending;
+
+    void Read(double now) {
+        if(fd < 0)
+            return;
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for(char * at = buffer; at < buffer + length; at += sizeof(inotify_event) + ((inotify_event *)at)->len) {
+                const inotify_event * event = (const inotify_event *)at;
+                auto directory = directories.find(event->wd);
+                if(directory == directories.end() || event->len == 0)
+                    continue;
+
+                string path = directory->second + "/" + event->name;
+                if(event->mask & IN_ISDIR) {
+                    // New directories are watched from now on
+                    if(event->mask & (IN_CREATE | IN_MOVED_TO))
+                        Watch(path);
+                }
+                else if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    pending[path] = now;
+            }
+        }
+    }
+};
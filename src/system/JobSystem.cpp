@@ -0,0 +1,229 @@
+#pragma once
+
+// Work-stealing job system. Every thread owns a deque it pushes to and pops from at the back,
+// threads that run out of work steal from the front of the others. Counters track the unfinished
+// jobs of a group; a job can be held back until another counter reaches zero, and a thread waiting
+// on a counter runs queued jobs until it does.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "system/Profiler.cpp"
+
+using namespace std;
+
+struct JobCounter;
+
+struct Job {
+    function<void ()> run;
+    // Decremented once the job has run
+    JobCounter * counter = NULL;
+};
+
+struct JobCounter {
+    atomic<int> pending;
+    // Jobs queued once pending reaches zero
+    vector<Job> waiting;
+    mutex lock;
+
+    JobCounter() : pending(0) {}
+    JobCounter(const JobCounter &) = delete;
+    JobCounter & operator=(const JobCounter &) = delete;
+};
+
+class JobSystem {
+    public:
+    // Threads counts the calling thread, which runs jobs while it waits, 0 uses every core
+    JobSystem(unsigned int threads = 0) : queues(threads > 0 ? threads : max(1u, thread::hardware_concurrency())), queued(0) {
+        for(unsigned int i = 1; i < queues.size(); ++i)
+            workers.emplace_back([this, i]() {
+                Work(i);
+            });
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem & operator=(const JobSystem &) = delete;
+
+    // Queued jobs are finished before the workers exit
+    ~JobSystem() {
+        {
+            lock_guard<mutex> lock(sleep);
+            stop = true;
+        }
+        wake.notify_all();
+        for(thread & worker : workers)
+            worker.join();
+    }
+
+    unsigned int ThreadCount() {
+        return queues.size();
+    }
+
+    // Queue a job, counted by counter until it has run and held back until after reaches zero (both optional)
+    void Run(function<void ()> run, JobCounter * counter = NULL, JobCounter * after = NULL) {
+        if(counter != NULL)
+            ++counter->pending;
+
+        Job job = {move(run), counter};
+        if(after != NULL) {
+            lock_guard<mutex> lock(after->lock);
+            if(after->pending > 0) {
+                after->waiting.push_back(move(job));
+                return;
+            }
+        }
+        Push(move(job));
+    }
+
+    // Run queued jobs on this thread until every job counted by counter has finished
+    void Wait(JobCounter * counter) {
+        while(true) {
+            if(counter->pending == 0) {
+                // The last job may still be releasing the counter
+                lock_guard<mutex> lock(counter->lock);
+                return;
+            }
+
+            Job job;
+            if(Take(Index(), &job))
+                Execute(job);
+            else
+                this_thread::yield();
+        }
+    }
+
+    // Split [0, count) into chunks of at least min_chunk items and call body(begin, end) for each,
+    // returns once all of them are done. The calling thread takes the first chunk.
+    template<typename Body>
+    void ParallelFor(unsigned int count, unsigned int min_chunk, Body body) {
+        unsigned int chunks = min(count / max(1u, min_chunk), ThreadCount() * 4);
+        if(chunks <= 1) {
+            if(count > 0)
+                body(0u, count);
+            return;
+        }
+
+        JobCounter counter;
+        for(unsigned int chunk = 1; chunk < chunks; ++chunk) {
+            unsigned int begin = (unsigned long)count * chunk / chunks;
+            unsigned int end = (unsigned long)count * (chunk + 1) / chunks;
+            Run([&body, begin, end]() {
+                body(begin, end);
+            }, &counter);
+        }
+        body(0u, (unsigned int)((unsigned long)count / chunks));
+        Wait(&counter);
+    }
+
+    private:
+    struct Queue {
+        deque<Job> jobs;
+        mutex lock;
+    };
+
+    vector<Queue> queues;
+    vector<thread> workers;
+
+    // Jobs sitting in any queue, idle workers sleep while it is zero
+    atomic<int> queued;
+    mutex sleep;
+    condition_variable wake;
+    bool stop = false;
+
+    // Which system and queue the current thread works for, other threads share the first queue
+    static thread_local JobSystem * owner;
+    static thread_local unsigned int owner_index;
+
+    unsigned int Index() {
+        return owner == this ? owner_index : 0;
+    }
+
+    void Push(Job job) {
+        Queue & queue = queues[Index()];
+        {
+            lock_guard<mutex> lock(queue.lock);
+            queue.jobs.push_back(move(job));
+        }
+        ++queued;
+
+        // Taking the lock orders this against a worker about to sleep
+        {
+            lock_guard<mutex> lock(sleep);
+        }
+        wake.notify_one();
+    }
+
+    // Newest job from our own queue, otherwise the oldest from another
+    bool Take(unsigned int index, Job * job) {
+        {
+            Queue & own = queues[index];
+            lock_guard<mutex> lock(own.lock);
+            if(!own.jobs.empty()) {
+                *job = move(own.jobs.back());
+                own.jobs.pop_back();
+                --queued;
+                return true;
+            }
+        }
+
+        for(unsigned int i = 1; i < queues.size(); ++i) {
+            Queue & victim = queues[(index + i) % queues.size()];
+            lock_guard<mutex> lock(victim.lock);
+            if(!victim.jobs.empty()) {
+                *job = move(victim.jobs.front());
+                victim.jobs.pop_front();
+                --queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Execute(Job & job) {
+        {
+            PROFILE_ZONE("Job");
+            job.run();
+        }
+        if(job.counter == NULL)
+            return;
+
+        // The counter can be gone as soon as its lock is released at zero, so nothing touches it after
+        vector<Job> ready;
+        {
+            lock_guard<mutex> lock(job.counter->lock);
+            if(--job.counter->pending > 0)
+                return;
+            ready.swap(job.counter->waiting);
+        }
+        for(Job & next : ready)
+            Push(move(next));
+    }
+
+    void Work(unsigned int index) {
+        owner = this;
+        owner_index = index;
+
+        while(true) {
+            Job job;
+            if(Take(index, &job)) {
+                Execute(job);
+                continue;
+            }
+
+            unique_lock<mutex> lock(sleep);
+            wake.wait(lock, [this]() {
+                return stop || queued > 0;
+            });
+            if(stop && queued == 0)
+                return;
+        }
+    }
+};
+
+thread_local JobSystem * JobSystem::owner = NULL;
+thread_local unsigned int JobSystem::owner_index = 0;
@@ -0,0 +1,299 @@
+#pragma once
+
+// Frame profiler. PROFILE_ZONE("name") times the rest of the enclosing scope on any thread; zones
+// go into a ring per thread that only that thread writes, and the main thread collects them once a
+// frame in EndFrame. The last PROFILER_FRAMES frames are kept for the overlay and trace dumps
+// (Chrome's about:tracing or ui.perfetto.dev open them). Counters hold one value per frame set from
+// the main thread, like the render scale. Build with -DPROFILER=0 to compile every zone out.
+#include <raylib.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+// Zones a thread can record between two collections, a power of two
+#define PROFILER_RING_SIZE 16384
+// Frames kept for the overlay and trace dumps
+#define PROFILER_FRAMES 300
+// Frames the overlay averages the zone times over
+#define PROFILER_AVERAGE_FRAMES 60
+// Frame time the overlay's flame bar spans
+#define PROFILER_BAR_MS 33.3
+
+using namespace std;
+
+// A finished zone, times are nanoseconds from the profiler's start
+struct ProfileEvent {
+    const char * name;
+    int64_t start, end;
+    unsigned short thread;
+    unsigned short depth;
+};
+
+struct ProfileCounter {
+    const char * name;
+    double value;
+};
+
+struct ProfileFrame {
+    int64_t start, end;
+    vector<ProfileEvent> events;
+    vector<ProfileCounter> counters;
+};
+
+// Zones of one thread, written by it and read by the collector. The thread only writes slots the
+// collector is done with, a zone finished while the ring is full is dropped instead. Zone names
+// have to be string literals.
+struct ProfileRing {
+    ProfileEvent events[PROFILER_RING_SIZE];
+    // Published by the thread once an event is written
+    atomic<uint64_t> head;
+    // Next event the collector reads, published once the events before it were copied
+    atomic<uint64_t> tail;
+    // Zones dropped since the collector last looked
+    atomic<uint64_t> dropped;
+    unsigned short thread;
+    unsigned short depth = 0;
+
+    ProfileRing(unsigned short thread) : head(0), tail(0), dropped(0) {
+        this->thread = thread;
+    }
+};
+
+namespace Profiler {
+    // Zones are only recorded while enabled, the overlay is drawn while shown
+    atomic<bool> enabled(true);
+    bool overlay = false;
+
+    deque<ProfileFrame> frames;
+    // Zones lost because a ring filled up before it was collected
+    unsigned long dropped = 0;
+
+    const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+    mutex rings_lock;
+    vector<unique_ptr<ProfileRing>> rings;
+    // Rings of threads that exited, handed to the next new threads. Whatever a thread left in
+    // its ring is still collected, as every ring stays in rings.
+    vector<ProfileRing *> free_rings;
+    thread_local ProfileRing * ring = NULL;
+
+    // Puts the thread's ring on free_rings when the thread exits
+    struct RingOwner {
+        ProfileRing * ring = NULL;
+
+        ~RingOwner() {
+            if(ring == NULL)
+                return;
+            lock_guard<mutex> lock(rings_lock);
+            free_rings.push_back(ring);
+        }
+    };
+    thread_local RingOwner ring_owner;
+    // The thread that collects, drawn in the flame bar
+    unsigned short main_thread = 0;
+    int64_t frame_start = 0;
+    // Counters set during the current frame
+    vector<ProfileCounter> counters;
+
+    int64_t Now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    // The calling thread's ring, taken on its first zone from an exited thread or made. There are
+    // only ever as many rings as threads recording at once.
+    ProfileRing * Ring() {
+        if(ring == NULL) {
+            lock_guard<mutex> lock(rings_lock);
+            if(!free_rings.empty()) {
+                ring = free_rings.back();
+                free_rings.pop_back();
+            }
+            else {
+                rings.push_back(make_unique<ProfileRing>(rings.size()));
+                ring = rings.back().get();
+            }
+            ring_owner.ring = ring;
+        }
+        return ring;
+    }
+
+    // Set a counter for the current frame from the main thread, the name has to be a string literal
+    void Counter(const char * name, double value) {
+        if(!enabled.load(memory_order_relaxed))
+            return;
+        for(ProfileCounter & counter : counters) {
+            if(counter.name == name) {
+                counter.value = value;
+                return;
+            }
+        }
+        counters.push_back({name, value});
+    }
+
+    // Move the zones every thread finished since the last call into a new frame, once a frame on
+    // the main thread
+    void EndFrame() {
+        ProfileFrame frame;
+        frame.start = frame_start;
+        frame.end = frame_start = Now();
+        main_thread = Ring()->thread;
+        frame.counters.swap(counters);
+
+        lock_guard<mutex> lock(rings_lock);
+        for(auto & thread_ring : rings) {
+            uint64_t head = thread_ring->head.load(memory_order_acquire);
+            uint64_t tail = thread_ring->tail.load(memory_order_relaxed);
+            for(; tail < head; ++tail)
+                frame.events.push_back(thread_ring->events[tail & (PROFILER_RING_SIZE - 1)]);
+            // The slots can be written again
+            thread_ring->tail.store(tail, memory_order_release);
+            dropped += thread_ring->dropped.exchange(0, memory_order_relaxed);
+        }
+
+        frames.push_back(move(frame));
+        if(frames.size() > PROFILER_FRAMES)
+            frames.pop_front();
+    }
+
+    // Write the last count frames as Chrome trace events
+    bool WriteTrace(const char * path, unsigned int count) {
+        ofstream file(path);
+        if(!file.is_open())
+            return false;
+
+        count = min<size_t>(count, frames.size());
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << main_thread << ",\"args\":{\"name\":\"Main\"}}";
+        for(size_t i = frames.size() - count; i < frames.size(); ++i) {
+            const ProfileFrame & frame = frames[i];
+            file << ",\n{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":" << main_thread << ",\"ts\":" << frame.start / 1000.0
+                 << ",\"dur\":" << (frame.end - frame.start) / 1000.0 << "}";
+            for(const ProfileEvent & event : frame.events) {
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":"
+                     << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+            }
+            for(const ProfileCounter & counter : frame.counters) {
+                file << ",\n{\"name\":\"" << counter.name << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << frame.start / 1000.0
+                     << ",\"args\":{\"value\":" << counter.value << "}}";
+            }
+        }
+        file << "\n]}\n";
+        return file.good();
+    }
+
+    // Colour of a zone in the flame bar, the same every frame
+    Color ZoneColor(const char * name) {
+        unsigned int hash = 2166136261u;
+        for(const char * c = name; *c; ++c)
+            hash = (hash ^ (unsigned char)*c) * 16777619u;
+        return ColorFromHSV(hash % 360, 0.6f, 0.85f);
+    }
+
+    // Average milliseconds per frame of every zone and a flame bar of the main thread's last frame
+    void Render(int x, int y, int width, int font_size) {
+        if(frames.empty())
+            return;
+
+        // Time per zone summed over the recent frames, on any thread
+        map<string, double> totals;
+        size_t first = frames.size() > PROFILER_AVERAGE_FRAMES ? frames.size() - PROFILER_AVERAGE_FRAMES : 0;
+        double frame_ms = 0;
+        for(size_t i = first; i < frames.size(); ++i) {
+            frame_ms += (frames[i].end - frames[i].start) / 1e6;
+            for(const ProfileEvent & event : frames[i].events)
+                totals[event.name] += (event.end - event.start) / 1e6;
+        }
+        double average = frames.size() - first;
+        vector<pair<double, string>> zones;
+        for(auto & entry : totals)
+            zones.push_back({entry.second / average, entry.first});
+        sort(zones.rbegin(), zones.rend());
+
+        // The last frame's counters go under the frame time
+        const ProfileFrame & frame = frames.back();
+        int line = font_size + 2;
+        int bar_height = line * 3;
+        int rows = frame.counters.size() + 1;
+        DrawRectangle(x, y, width, line * (zones.size() + rows) + bar_height + 12, (Color){0, 0, 0, 160});
+        DrawText(TextFormat("Frame %.2f ms (%lu zones dropped)", frame_ms / average, dropped), x + 4, y + 4, font_size, WHITE);
+        for(unsigned int i = 0; i < frame.counters.size(); ++i)
+            DrawText(TextFormat("%s: %.3g", frame.counters[i].name, frame.counters[i].value), x + 4, y + 4 + line * (i + 1), font_size, LIGHTGRAY);
+        for(unsigned int i = 0; i < zones.size(); ++i) {
+            const char * name = zones[i].second.c_str();
+            DrawRectangle(x + 4, y + 4 + line * (i + rows), font_size / 2, font_size, ZoneColor(name));
+            DrawText(TextFormat("%.3f ms  %s", zones[i].first, name), x + 8 + font_size / 2, y + 4 + line * (i + rows), font_size, WHITE);
+        }
+
+        // Nested zones of the last frame stack below their parents
+        int bar_y = y + 8 + line * (zones.size() + rows);
+        int row = bar_height / 3;
+        float scale = (width - 8) / (PROFILER_BAR_MS * 1e6);
+        DrawRectangleLines(x + 4, bar_y, width - 8, bar_height, GRAY);
+        for(const ProfileEvent & event : frame.events) {
+            if(event.thread != main_thread || event.depth > 2)
+                continue;
+            float left = (event.start - frame.start) * scale;
+            float size = max(1.0f, (event.end - event.start) * scale);
+            if(left >= width - 8)
+                continue;
+            DrawRectangle(x + 4 + left, bar_y + event.depth * row, min(size, width - 8 - left), row - 1, ZoneColor(event.name));
+        }
+    }
+};
+
+// Times its scope as one zone
+class ProfileZone {
+    public:
+    ProfileZone(const char * name) {
+        if(!Profiler::enabled.load(memory_order_relaxed))
+            return;
+        this->name = name;
+        ring = Profiler::Ring();
+        depth = ring->depth++;
+        start = Profiler::Now();
+    }
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone & operator=(const ProfileZone &) = delete;
+
+    ~ProfileZone() {
+        if(ring == NULL)
+            return;
+        int64_t end = Profiler::Now();
+        --ring->depth;
+
+        // Only this thread writes the ring, the collector reads up to the published head
+        uint64_t head = ring->head.load(memory_order_relaxed);
+        if(head - ring->tail.load(memory_order_acquire) >= PROFILER_RING_SIZE) {
+            ring->dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        ring->events[head & (PROFILER_RING_SIZE - 1)] = {name, start, end, ring->thread, depth};
+        ring->head.store(head + 1, memory_order_release);
+    }
+
+    private:
+    const char * name;
+    ProfileRing * ring = NULL;
+    int64_t start;
+    unsigned short depth;
+};
+
+#if PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
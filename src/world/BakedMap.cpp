@@ -0,0 +1,414 @@
+#pragma once
+
+// Baked binary maps (.cmap): the parsed map, its triangulated geometry, the built collision BVH and
+// the potentially visible sets (not for edit maps) in one file that is mapped into memory and used in place instead of being parsed on every load.
+// It records the files it was made from, and is rebaked once any of them changes.
+// Usage: main --bake <map> [out]
+#include <raylib.h>
+#include <raymath.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+#include "world/MapFile.cpp"
+#include "world/ObjLoader.cpp"
+#include "world/Pvs.cpp"
+
+// Bump whenever a section layout or how it is built changes, older files are then rebaked from the text map
+#define BAKED_MAP_MAGIC "C3DM"
+#define BAKED_MAP_VERSION 4
+#define BAKED_MAP_ALIGN 16
+
+#define BAKED_FLAG_EDIT 1
+
+using namespace std;
+
+enum BakedSection {
+    BAKED_MODELS,
+    BAKED_VERTICES,
+    BAKED_TEXCOORDS,
+    BAKED_NORMALS,
+    BAKED_LIGHTS,
+    BAKED_SPAWNS,
+    BAKED_OBJECTS,
+    BAKED_BVH_NODES,
+    BAKED_BVH_TRIANGLES,
+    // One PvsGrid, empty when the map has no PVS
+    BAKED_PVS_GRID,
+    BAKED_PVS_OFFSETS,
+    BAKED_PVS_ROWS,
+    BAKED_DEPENDENCIES,
+    BAKED_SECTION_COUNT
+};
+
+struct BakedSectionEntry {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct BakedMapHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    // Modification time (nanoseconds) and size of the text map this file was baked from
+    int64_t source_mtime;
+    uint64_t source_size;
+    BakedSectionEntry sections[BAKED_SECTION_COUNT];
+};
+
+// Vertex ranges index the shared vertex, texcoord and normal sections (three floats per vertex, two for texcoords)
+struct BakedModel {
+    char path[128];
+    Vector3 position;
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+
+    // The path is only NUL terminated when shorter than the array, in a damaged file maybe never
+    string Path() const {
+        return string(path, strnlen(path, sizeof(path)));
+    }
+};
+
+// A file the map's models were read from (the models, their materials and textures). The baked
+// map is stale once any of them changed.
+struct BakedDependency {
+    char path[128];
+    // Modification time in nanoseconds, -1 when the file does not exist
+    int64_t mtime;
+    uint64_t size;
+
+    string Path() const {
+        return string(path, strnlen(path, sizeof(path)));
+    }
+};
+
+struct BakedLight {
+    float brightness;
+    Vector3 position;
+};
+
+struct BakedObject {
+    char type[64];
+    Vector3 position;
+
+    string Type() const {
+        return string(type, strnlen(type, sizeof(type)));
+    }
+};
+
+class BakedMap {
+    public:
+    const BakedMapHeader * header = NULL;
+
+    BakedMap() {}
+    // The mapping is owned, copies would unmap it twice
+    BakedMap(const BakedMap &) = delete;
+    BakedMap & operator=(const BakedMap &) = delete;
+    ~BakedMap() {
+        Close();
+    }
+
+    bool Open(const char * filename) {
+        Close();
+
+        int fd = open(filename, O_RDONLY);
+        if(fd < 0)
+            return false;
+
+        struct stat info;
+        if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(BakedMapHeader)) {
+            close(fd);
+            return false;
+        }
+
+        void * mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mapping == MAP_FAILED)
+            return false;
+
+        data = (const char *)mapping;
+        size = info.st_size;
+        header = (const BakedMapHeader *)data;
+
+        // Reject other formats, other versions, truncated files and sections that could not be used in place
+        bool valid = !memcmp(header->magic, BAKED_MAP_MAGIC, 4) && header->version == BAKED_MAP_VERSION;
+        for(int i = 0; valid && i < BAKED_SECTION_COUNT; ++i) {
+            const BakedSectionEntry & section = header->sections[i];
+            valid = section.offset <= size && section.size <= size - section.offset && section.offset % BAKED_MAP_ALIGN == 0;
+        }
+        if(!valid) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        if(data != NULL)
+            munmap((void *)data, size);
+        data = NULL;
+        header = NULL;
+        size = 0;
+    }
+
+    bool IsOpen() {
+        return data != NULL;
+    }
+
+    // Pointer to the first element of a section, count receives the number of elements
+    template<typename T>
+    const T * Section(BakedSection section, size_t * count) {
+        static_assert(alignof(T) <= BAKED_MAP_ALIGN, "sections are only aligned to BAKED_MAP_ALIGN");
+        *count = header->sections[section].size / sizeof(T);
+        return (const T *)(data + header->sections[section].offset);
+    }
+
+    // "resources/world/hub.map" bakes to "resources/world/hub.cmap"
+    static string PathFor(const char * map_path) {
+        string path = map_path;
+        size_t dot = path.find_last_of('.');
+        if(dot != string::npos && path.find('/', dot) == string::npos)
+            path = path.substr(0, dot);
+        return path + ".cmap";
+    }
+
+    // Modification time in nanoseconds and size of a file, so an edit within the second of a bake
+    // is still seen. The time is -1 when the file does not exist.
+    static void Stamp(const char * filename, int64_t * mtime, uint64_t * size) {
+        struct stat info;
+        if(stat(filename, &info) != 0) {
+            *mtime = -1;
+            *size = 0;
+            return;
+        }
+        *mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+        *size = info.st_size;
+    }
+
+    // The .mtl files an OBJ names and the textures they name, relative to the files naming them
+    static void MaterialFiles(const string & obj_path, vector<string> * files) {
+        char * text = LoadFileText(obj_path.c_str());
+        if(text == NULL)
+            return;
+        vector<string> libraries;
+        istringstream lines(text);
+        UnloadFileText(text);
+        string line, keyword;
+        string directory = obj_path.substr(0, obj_path.find_last_of('/') + 1);
+        while(getline(lines, line)) {
+            istringstream tokens(line);
+            string name;
+            if(tokens >> keyword && keyword == "mtllib" && tokens >> name)
+                libraries.push_back(directory + name);
+        }
+
+        for(const string & library : libraries) {
+            files->push_back(library);
+            text = LoadFileText(library.c_str());
+            if(text == NULL)
+                continue;
+            istringstream material(text);
+            UnloadFileText(text);
+            directory = library.substr(0, library.find_last_of('/') + 1);
+            while(getline(material, line)) {
+                // The file name is the last token, options may come before it
+                istringstream tokens(line);
+                if(!(tokens >> keyword) || (keyword.compare(0, 4, "map_") && keyword != "bump" && keyword != "disp" && keyword != "norm"))
+                    continue;
+                string name;
+                while(tokens >> keyword)
+                    name = keyword;
+                if(!name.empty())
+                    files->push_back(directory + name);
+            }
+        }
+    }
+
+    // A baked map is current if neither the text map nor any file its models were read from changed since baking
+    static bool IsCurrent(const char * map_path, const char * baked_path) {
+        BakedMap baked;
+        if(!baked.Open(baked_path))
+            return false;
+        int64_t mtime;
+        uint64_t size;
+        Stamp(map_path, &mtime, &size);
+        if(baked.header->source_mtime != mtime || baked.header->source_size != size)
+            return false;
+
+        size_t count;
+        const BakedDependency * dependencies = baked.Section<BakedDependency>(BAKED_DEPENDENCIES, &count);
+        for(size_t i = 0; i < count; ++i) {
+            Stamp(dependencies[i].Path().c_str(), &mtime, &size);
+            if(dependencies[i].mtime != mtime || dependencies[i].size != size)
+                return false;
+        }
+        return true;
+    }
+
+    static bool Bake(const char * map_path, const char * out_path) {
+        MapFile map;
+        if(!map.Load(map_path)) {
+            cout << "ERROR: BAKE: Map '" << map_path << "' does not exist\n";
+            return false;
+        }
+
+        vector<BakedModel> models;
+        vector<float> vertices, texcoords, normals;
+        vector<BakedLight> lights;
+        vector<Vector3> spawns;
+        vector<BakedObject> objects;
+        vector<BakedDependency> dependencies;
+        set<string> depended;
+        CollisionWorld collision;
+
+        // Record a file the models were read from, once
+        auto depend = [&](const string & path) {
+            if(!depended.insert(path).second)
+                return true;
+            BakedDependency dependency = {0};
+            if(path.size() >= sizeof(dependency.path)) {
+                cout << "ERROR: BAKE: Path '" << path << "' is too long\n";
+                return false;
+            }
+            strcpy(dependency.path, path.c_str());
+            Stamp(dependency.path, &dependency.mtime, &dependency.size);
+            dependencies.push_back(dependency);
+            return true;
+        };
+
+        for(MapEntry entry : map.entries) {
+            switch(entry.kind) {
+                case 'M': {
+                    BakedModel model = {0};
+                    if(entry.argument.size() >= sizeof(model.path)) {
+                        cout << "ERROR: BAKE: Model path '" << entry.argument << "' is too long\n";
+                        return false;
+                    }
+
+                    // The first use of a model also records its materials and textures
+                    if(!depended.count(entry.argument)) {
+                        vector<string> files = {entry.argument};
+                        MaterialFiles(entry.argument, &files);
+                        for(const string & file : files) {
+                            if(!depend(file))
+                                return false;
+                        }
+                    }
+
+                    Mesh mesh;
+                    if(!ObjLoader::Load(entry.argument.c_str(), &mesh)) {
+                        cout << "ERROR: BAKE: Could not load model '" << entry.argument << "'\n";
+                        return false;
+                    }
+
+                    strcpy(model.path, entry.argument.c_str());
+                    model.position = entry.position;
+                    model.first_vertex = vertices.size() / 3;
+                    model.vertex_count = mesh.vertexCount;
+                    models.push_back(model);
+
+                    vertices.insert(vertices.end(), mesh.vertices, mesh.vertices + mesh.vertexCount * 3);
+                    texcoords.insert(texcoords.end(), mesh.texcoords, mesh.texcoords + mesh.vertexCount * 2);
+                    normals.insert(normals.end(), mesh.normals, mesh.normals + mesh.vertexCount * 3);
+
+                    collision.AddMesh(mesh, MatrixTranslate(entry.position.x, entry.position.y, entry.position.z));
+                    ObjLoader::Unload(mesh);
+                    break;
+                }
+                case 'L':
+                    lights.push_back({strtof(entry.argument.c_str(), NULL), entry.position});
+                    break;
+                case 'O': {
+                    BakedObject object = {0};
+                    if(entry.argument.size() >= sizeof(object.type)) {
+                        cout << "ERROR: BAKE: Object type '" << entry.argument << "' is too long\n";
+                        return false;
+                    }
+                    strcpy(object.type, entry.argument.c_str());
+                    object.position = entry.position;
+                    objects.push_back(object);
+                    break;
+                }
+                case 'P':
+                    spawns.push_back(entry.position);
+                    break;
+            }
+        }
+        collision.Build();
+
+        // Edit maps draw everything
+        Pvs pvs;
+        if(!map.edit)
+            pvs.Build(collision);
+
+        BakedMapHeader header = {0};
+        memcpy(header.magic, BAKED_MAP_MAGIC, 4);
+        header.version = BAKED_MAP_VERSION;
+        header.flags = map.edit ? BAKED_FLAG_EDIT : 0;
+        Stamp(map_path, &header.source_mtime, &header.source_size);
+
+        const void * contents[BAKED_SECTION_COUNT] = {
+            models.data(), vertices.data(), texcoords.data(), normals.data(), lights.data(),
+            spawns.data(), objects.data(), collision.nodes.data(), collision.triangles.data(),
+            &pvs.grid, pvs.offsets.data(), pvs.rows.data(), dependencies.data()
+        };
+        size_t sizes[BAKED_SECTION_COUNT] = {
+            models.size() * sizeof(BakedModel), vertices.size() * sizeof(float),
+            texcoords.size() * sizeof(float), normals.size() * sizeof(float),
+            lights.size() * sizeof(BakedLight), spawns.size() * sizeof(Vector3),
+            objects.size() * sizeof(BakedObject), collision.nodes.size() * sizeof(BvhNode),
+            collision.triangles.size() * sizeof(CollisionTriangle),
+            pvs.Empty() ? 0 : sizeof(PvsGrid), pvs.offsets.size() * sizeof(uint32_t), pvs.rows.size(),
+            dependencies.size() * sizeof(BakedDependency)
+        };
+
+        // Sections follow the header, each aligned so it can be used in place once mapped
+        uint64_t offset = sizeof(BakedMapHeader);
+        for(int i = 0; i < BAKED_SECTION_COUNT; ++i) {
+            offset = (offset + BAKED_MAP_ALIGN - 1) / BAKED_MAP_ALIGN * BAKED_MAP_ALIGN;
+            header.sections[i] = {offset, sizes[i]};
+            offset += sizes[i];
+        }
+
+        FILE * file = fopen(out_path, "wb");
+        if(file == NULL) {
+            cout << "ERROR: BAKE: Could not write '" << out_path << "'\n";
+            return false;
+        }
+
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+        const char padding[BAKED_MAP_ALIGN] = {0};
+        for(int i = 0; written && i < BAKED_SECTION_COUNT; ++i) {
+            size_t pad = header.sections[i].offset - ftell(file);
+            written = fwrite(padding, 1, pad, file) == pad && fwrite(contents[i], 1, sizes[i], file) == sizes[i];
+        }
+        written &= fclose(file) == 0;
+
+        if(!written) {
+            cout << "ERROR: BAKE: Could not write '" << out_path << "'\n";
+            remove(out_path);
+            return false;
+        }
+
+        cout << "INFO: BAKE: Baked '" << map_path << "' to '" << out_path << "' (" << models.size() << " models, "
+             << collision.triangles.size() << " triangles, " << pvs.grid.cell_count << " PVS cells, " << offset / 1024 << " KiB)\n";
+        return true;
+    }
+
+    private:
+    const char * data = NULL;
+    size_t size = 0;
+};
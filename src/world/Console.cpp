@@ -1,10 +1,17 @@
 #include <raylib.h>
+#include <sys/stat.h>
 
 #include <iostream>
 #include <vector>
 #include <functional>
 
 #include "world/World.cpp"
+#include "world/Timestep.cpp"
+#include "render/AssetCache.cpp"
+#include "world/MapLoader.cpp"
+#include "world/Demo.cpp"
+#include "world/SimThread.cpp"
+#include "system/Profiler.cpp"
 
 using namespace std;
 
@@ -16,6 +23,15 @@ struct Command {
 // The console is used to control most larger game events like level switching, like the quake console.
 namespace Console {
     World * world;
+    Timestep * timestep;
+    AssetCache * assets;
+    MapLoader * loader;
+    Renderer * renderer;
+    // Held between ticks while a command or map swap changes the world, NULL when nothing ticks
+    SimThread * sim = NULL;
+
+    // Cache counters when the current map load began
+    unsigned long load_hits, load_misses;
 
     vector<string> history;
     string input = "";
@@ -44,17 +60,212 @@ namespace Console {
                 Out("Expected at least 1 argument");
                 return 1;
             }
+            if(loader->Busy()) {
+                Out("Already loading map '" + loader->filename + "'");
+                return 1;
+            }
 
-            world->Reset();
-            bool loaded = world->Load(args[0].c_str());
-            if(loaded) {
+            // Demos change maps on the tick they were recorded on, the load cannot run in the background
+            if(Demo::Active()) {
+                if(!world->Load(args[0].c_str())) {
+                    Out("Map '" + args[0] + "' doe's not exist.");
+                    return 1;
+                }
                 Out("Loaded map '" + args[0] + "'");
                 return 0;
             }
-            else {
+
+            // The current map keeps running until the new one is ready, see Update
+            load_hits = assets->hits;
+            load_misses = assets->misses;
+            if(!loader->Start(args[0].c_str())) {
                 Out("Map '" + args[0] + "' doe's not exist.");
                 return 1;
             }
+            Out(loader->Status());
+            return 0;
+        }},
+        {"bake", [](vector<string> args){
+            if(args.size() == 0) {
+                Out("Expected at least 1 argument");
+                return 1;
+            }
+
+            string out = BakedMap::PathFor(args[0].c_str());
+            if(!BakedMap::Bake(args[0].c_str(), out.c_str())) {
+                Out("Could not bake map '" + args[0] + "'");
+                return 1;
+            }
+            Out("Baked map '" + args[0] + "' to '" + out + "'");
+            return 0;
+        }},
+        {"assets", [](vector<string> args){
+            Out(to_string(assets->assets.size()) + " assets resident (" + to_string(assets->resident_bytes / 1024) + " KiB, "
+                + to_string(assets->hits) + " hits, " + to_string(assets->misses) + " misses, "
+                + to_string(assets->evictions) + " evictions)");
+            for(auto & entry : assets->assets)
+                Out("  " + entry.first + " (" + to_string(entry.second.refs) + " refs, " + to_string(entry.second.bytes / 1024) + " KiB)");
+            return 0;
+        }},
+        {"scripts", [](vector<string> args){
+            ScriptHost & host = world->object_manager.scripts;
+            if(host.scripts.empty()) {
+                Out("No scripts loaded");
+                return 0;
+            }
+
+            // Most expensive first, optionally only the first few
+            vector<const Script *> order = host.Expensive();
+            unsigned int count = args.size() > 0 ? atoi(args[0].c_str()) : order.size();
+            Out(to_string(host.scripts.size()) + " scripts loaded (" + to_string(host.cache_hits) + " from the bytecode cache)");
+            for(unsigned int i = 0; i < order.size() && i < count; ++i) {
+                const Script * script = order[i];
+                Out(TextFormat("  %s: %.1f us/tick, %.1f us worst, %u objects, %u over budget, %u errors%s",
+                    script->name.c_str(), script->average_us, script->worst_us, script->object_count,
+                    script->budget_aborts, script->errors, script->disabled ? " (disabled)" : ""));
+            }
+            return 0;
+        }},
+        {"light", [](vector<string> args){
+            LightManager & lights = world->light_manager;
+            if(args.size() < 2) {
+                Out("Usage: light <index> <steady|pulse|flicker> [speed] [amount]");
+                return 1;
+            }
+
+            int index = atoi(args[0].c_str());
+            if(index < 0 || index >= lights.light_count) {
+                Out("Light " + args[0] + " does not exist, the map has " + to_string(lights.light_count) + " lights");
+                return 1;
+            }
+
+            LightAnimation animation;
+            if(args[1] == "steady")
+                animation = LIGHT_STEADY;
+            else if(args[1] == "pulse")
+                animation = LIGHT_PULSE;
+            else if(args[1] == "flicker")
+                animation = LIGHT_FLICKER;
+            else {
+                Out("Unknown animation '" + args[1] + "'");
+                return 1;
+            }
+
+            float speed = args.size() > 2 ? atof(args[2].c_str()) : 8;
+            float amount = args.size() > 3 ? atof(args[3].c_str()) : 0.5f;
+            lights.Animate(index, animation, speed, amount);
+            Out("Light " + args[0] + " set to " + args[1]);
+            return 0;
+        }},
+        {"cull", [](vector<string> args){
+            Out(to_string(world->chunks_drawn) + " of " + to_string(world->chunks.size()) + " world chunks drawn, "
+                + to_string(world->chunks_culled) + " culled by the view frustum, " + to_string(world->chunks_hidden) + " by the PVS, "
+                + to_string(world->chunks_occluded) + " by occluders");
+            if(world->pvs.Empty())
+                Out("The map has no PVS, bake it to cull by visibility");
+            else if(world->pvs.cell < 0)
+                Out("The camera is outside the PVS grid, every cell is visible");
+            else
+                Out("Camera in cell " + to_string(world->pvs.cell) + ", which sees " + to_string(world->pvs.visible_count)
+                    + " of " + to_string(world->pvs.grid.cell_count) + " cells");
+            return 0;
+        }},
+        {"occlusion", [](vector<string> args){
+            world->occlusion_culling = !world->occlusion_culling;
+            Out(string("Occlusion culling ") + (world->occlusion_culling ? "enabled" : "disabled"));
+            return 0;
+        }},
+        {"draws", [](vector<string> args){
+            Out(to_string(world->batcher.draw_calls) + " draw calls for " + to_string(world->batcher.instance_count) + " meshes, "
+                + to_string(world->object_manager.objects_drawn) + " objects drawn and " + to_string(world->object_manager.objects_culled) + " culled");
+            return 0;
+        }},
+        {"instancing", [](vector<string> args){
+            world->batcher.instancing = !world->batcher.instancing;
+            Out(string("Instanced drawing ") + (world->batcher.instancing ? "enabled" : "disabled"));
+            return 0;
+        }},
+        {"resolution", [](vector<string> args){
+            DynamicResolution & dynamic = renderer->dynamic;
+            if(args.size() > 0 && (args[0] == "on" || args[0] == "off"))
+                dynamic.enabled = args[0] == "on";
+            else if(args.size() > 1 && args[0] == "budget")
+                dynamic.budget_ms = max(1.0, atof(args[1].c_str()));
+            else if(args.size() > 2 && args[0] == "bounds")
+                renderer->SetScaleBounds(atof(args[1].c_str()), atof(args[2].c_str()));
+            else if(args.size() > 0) {
+                Out("Usage: resolution [on|off|budget <ms>|bounds <min> <max>]");
+                return 1;
+            }
+
+            Out(TextFormat("Dynamic resolution %s: %ix%i at scale %.2f (%.2f to %.2f), %.2f ms average for a %.2f ms budget, %u changes",
+                dynamic.enabled ? "on" : "off", renderer->render.texture.width, renderer->render.texture.height, dynamic.Scale(),
+                dynamic.min_scale, dynamic.max_scale, dynamic.average_ms, dynamic.budget_ms, dynamic.changes));
+            return 0;
+        }},
+        {"profiler", [](vector<string> args){
+            Profiler::overlay = !Profiler::overlay;
+            Out(string("Profiler overlay ") + (Profiler::overlay ? "shown" : "hidden"));
+            return 0;
+        }},
+        {"trace", [](vector<string> args){
+            // The last frames as a Chrome trace, by default as many as are kept
+            unsigned int count = args.size() > 0 ? atoi(args[0].c_str()) : PROFILER_FRAMES;
+            string path = args.size() > 1 ? args[1] : RUN_DIR "trace.json";
+            mkdir(RUN_DIR, 0755);
+            if(!Profiler::WriteTrace(path.c_str(), count)) {
+                Out("Could not write trace '" + path + "'");
+                return 1;
+            }
+            Out("Wrote " + to_string(min<size_t>(count, Profiler::frames.size())) + " frames to '" + path + "'");
+            return 0;
+        }},
+        {"record", [](vector<string> args){
+            if(args.size() == 0) {
+                Out("Usage: record <name>");
+                return 1;
+            }
+            return Demo::Record(args[0]) ? 0 : 1;
+        }},
+        {"stop", [](vector<string> args){
+            if(!Demo::Active()) {
+                Out("No demo is recording or playing");
+                return 1;
+            }
+            Demo::Stop();
+            return 0;
+        }},
+        {"playdemo", [](vector<string> args){
+            if(args.size() == 0) {
+                Out("Usage: playdemo <name>");
+                return 1;
+            }
+            return Demo::Play(args[0], false) ? 0 : 1;
+        }},
+        {"timedemo", [](vector<string> args){
+            if(args.size() == 0) {
+                Out("Usage: timedemo <name>");
+                return 1;
+            }
+            return Demo::Play(args[0], true) ? 0 : 1;
+        }},
+        {"simthread", [](vector<string> args){
+            if(sim->Running())
+                sim->Stop();
+            else
+                sim->Start();
+            Out(string("Simulation ticking on ") + (sim->Running() ? "its own thread" : "the main thread"));
+            return 0;
+        }},
+        {"tickrate", [](vector<string> args){
+            if(args.size() == 0) {
+                Out("Simulation runs at " + to_string((int)timestep->rate) + " ticks per second");
+                return 0;
+            }
+
+            timestep->SetRate(atof(args[0].c_str()));
+            Out("Simulation rate set to " + to_string((int)timestep->rate) + " ticks per second");
+            return 0;
         }},
         {"help", [](vector<string> args){
             Out("Console is used to control all major game events");
@@ -75,6 +286,11 @@ namespace Console {
 
         for(int i = 0; true; ++i) {
             if(commands[i].command == comm) {
+                // Held first, the ticks record and replay commands too
+                SimPause pause(sim);
+                // Commands change the game on the next tick of a recording, except the ones running demos
+                if(comm != "record" && comm != "stop" && comm != "playdemo" && comm != "timedemo")
+                    Demo::Command(line);
                 commands[i].exec(args);
                 return true;
             }
@@ -86,13 +302,37 @@ namespace Console {
         return false;
     }
 
+    // Called once a frame, streams in a map started by the map command and swaps it in when ready
+    void Update() {
+        if(loader->state == LOAD_IDLE)
+            return;
+
+        int state = loader->Update(MAP_UPLOAD_BUDGET);
+        if(state == LOAD_READY) {
+            string filename = loader->filename;
+            SimPause pause(sim);
+            world->Apply(loader);
+            Out("Loaded map '" + filename + "' (" + to_string(assets->hits - load_hits) + " cached, "
+                + to_string(assets->misses - load_misses) + " loaded)");
+        }
+        else if(state == LOAD_FAILED) {
+            Out(loader->Status());
+            loader->Finish();
+        }
+    }
+
     void Render(Vector2 window) {
+        PROFILE_ZONE("Console::Render");
         DrawRectangle(10, 10, window.x - 20, window.y / 1.93f, (Color){30, 30, 30, 200});
         for(int i = 0; i < history.size(); ++i) {
             int line = history.size() - i - 1;
             DrawText(history[line].c_str(), 20, window.y / 2.0f - (i + 1) * (window.y / 40), window.y / 50, GRAY);
         }
 
+        // Progress of a map loading in the background
+        if(loader->Busy())
+            DrawText(loader->Status().c_str(), 20, window.y / 2.0f + window.y / 40, window.y / 50, YELLOW);
+
         DrawRectangle(15, window.y / 2.0f, window.x - 30, window.y / 50, (Color){0, 0, 0, 100});
         DrawText(input.c_str(), 20, window.y / 2.0f, window.y / 50, WHITE);
     }
@@ -0,0 +1,356 @@
+#pragma once
+
+// Demos record the player's input and console commands once per simulation tick and play them back
+// through the same ticks. Recording and playback both start from a freshly loaded map with the scripts
+// restarted, so a demo replays the same way every time. timedemo plays one back as fast as frames
+// can be drawn and reports the frame times, like the quake command.
+#include <raylib.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "player/Player.cpp"
+#include "world/MapLoader.cpp"
+#include "world/Timestep.cpp"
+#include "world/World.cpp"
+
+#ifndef RUN_DIR
+#define RUN_DIR "run/"
+#endif
+
+#define DEMO_DIR RUN_DIR "demos/"
+#define DEMO_MAGIC "C3DD"
+#define DEMO_VERSION 1
+
+// Tick record flags, the movement axes take the top four bits as 0 (-1) to 2 (+1)
+#define DEMO_JUMP 1
+#define DEMO_DESCEND 2
+#define DEMO_LOOK 4
+#define DEMO_COMMANDS 8
+#define DEMO_AXIS_X 4
+#define DEMO_AXIS_Y 6
+
+using namespace std;
+
+enum DemoMode {
+    DEMO_IDLE,
+    DEMO_RECORDING,
+    DEMO_PLAYING,
+    // Playing back one tick per frame without waiting for vsync
+    DEMO_TIMING
+};
+
+// Followed by one record per tick: a flags byte, the mouse movement (two floats) when DEMO_LOOK is
+// set and the commands (a count byte, then a 16 bit length and the text of each) when DEMO_COMMANDS is
+struct DemoHeader {
+    char magic[4];
+    uint32_t version;
+    float rate;
+    // Written when recording stops
+    uint32_t ticks;
+    Vector3 start;
+    char map[128];
+};
+
+// Simulation and render time of one frame in microseconds
+struct DemoFrame {
+    double sim_us;
+    double render_us;
+};
+
+namespace Demo {
+    World * world;
+    Player * player;
+    Timestep * timestep;
+    MapLoader * loader;
+
+    // Where messages go and how recorded commands are run, the console sets both
+    function<void (const string &)> print = [](const string & message) { cout << message << "\n"; };
+    function<bool (string)> exec;
+
+    DemoMode mode = DEMO_IDLE;
+    // Set by Tick once a demo ran out or could not be written, the owner of the loop Stops it (Tick
+    // can run on the simulation thread, while stopping has to happen on the main thread)
+    atomic<bool> ended(false);
+    string name;
+    DemoHeader header;
+    unsigned long tick = 0;
+
+    FILE * file = NULL;
+    // Commands run since the last recorded tick
+    vector<string> commands;
+    vector<DemoFrame> frames;
+    // Restored when playback stops
+    float rate = 60;
+    bool vsync = false;
+
+    string PathFor(const string & name) {
+        return DEMO_DIR + name + ".dem";
+    }
+
+    bool Active() {
+        return mode != DEMO_IDLE;
+    }
+
+    bool Playing() {
+        return mode == DEMO_PLAYING || mode == DEMO_TIMING;
+    }
+
+    // Reload the current map, restart the scripts and stand the player at start facing forward
+    bool Restart(const char * map, Vector3 start) {
+        world->Reset();
+        world->object_manager.scripts.Restart();
+        if(!world->Load(map)) {
+            print("Could not load map '" + string(map) + "'");
+            return false;
+        }
+        player->Reset(start);
+        return true;
+    }
+
+    // Summarise one column of the frame times as its average, the average of the slowest 1% and the slowest
+    void Summarise(const char * label, vector<double> times) {
+        sort(times.begin(), times.end(), greater<double>());
+        double total = 0;
+        for(double time : times)
+            total += time;
+        unsigned int slowest = max<size_t>(1, times.size() / 100);
+        double low = 0;
+        for(unsigned int i = 0; i < slowest; ++i)
+            low += times[i];
+        low /= slowest;
+        double average = total / times.size();
+        print(TextFormat("  %-7s %7.3f ms average (%.0f fps), %7.3f ms 1%% low (%.0f fps), %7.3f ms worst",
+            label, average / 1000, 1e6 / average, low / 1000, 1e6 / low, times[0] / 1000));
+    }
+
+    void Report() {
+        if(frames.empty())
+            return;
+
+        vector<double> total, sim, render;
+        double seconds = 0;
+        for(const DemoFrame & frame : frames) {
+            total.push_back(frame.sim_us + frame.render_us);
+            sim.push_back(frame.sim_us);
+            render.push_back(frame.render_us);
+            seconds += (frame.sim_us + frame.render_us) / 1e6;
+        }
+        print("timedemo '" + name + "': " + to_string(frames.size()) + " frames in " + TextFormat("%.2f", seconds) + " seconds");
+        Summarise("frame", total);
+        Summarise("sim", sim);
+        Summarise("render", render);
+    }
+
+    void Stop() {
+        if(mode == DEMO_RECORDING) {
+            // Patch the tick count into the header
+            long bytes = ftell(file);
+            header.ticks = tick;
+            fseek(file, 0, SEEK_SET);
+            fwrite(&header, sizeof(header), 1, file);
+            print("Recorded " + to_string(tick) + " ticks to '" + PathFor(name) + "' (" + to_string(bytes) + " bytes)");
+        }
+        if(file != NULL)
+            fclose(file);
+        file = NULL;
+
+        if(Playing()) {
+            timestep->SetRate(rate);
+            if(mode == DEMO_TIMING) {
+                Report();
+                if(vsync && IsWindowReady())
+                    SetWindowState(FLAG_VSYNC_HINT);
+            }
+            else
+                print("Finished demo '" + name + "'");
+        }
+        player->input = PlayerInput();
+        commands.clear();
+        frames.clear();
+        mode = DEMO_IDLE;
+        ended = false;
+    }
+
+    bool Record(const string & name) {
+        if(Active())
+            Stop();
+        if(loader->Busy()) {
+            print("Wait for map '" + loader->filename + "' to load");
+            return false;
+        }
+
+        string map = world->filename;
+        Vector3 start = player->position;
+        if(!Restart(map.c_str(), start))
+            return false;
+
+        mkdir(RUN_DIR, 0755);
+        mkdir(DEMO_DIR, 0755);
+        file = fopen(PathFor(name).c_str(), "wb");
+        if(file == NULL) {
+            print("Could not write '" + PathFor(name) + "'");
+            return false;
+        }
+
+        header = DemoHeader();
+        memcpy(header.magic, DEMO_MAGIC, 4);
+        header.version = DEMO_VERSION;
+        header.rate = timestep->rate;
+        header.ticks = 0;
+        header.start = start;
+        strncpy(header.map, map.c_str(), sizeof(header.map) - 1);
+        fwrite(&header, sizeof(header), 1, file);
+
+        Demo::name = name;
+        tick = 0;
+        mode = DEMO_RECORDING;
+        print("Recording demo '" + name + "' on '" + map + "'");
+        return true;
+    }
+
+    bool Play(const string & name, bool timing) {
+        if(Active())
+            Stop();
+        if(loader->Busy()) {
+            print("Wait for map '" + loader->filename + "' to load");
+            return false;
+        }
+
+        file = fopen(PathFor(name).c_str(), "rb");
+        if(file == NULL) {
+            print("Demo '" + name + "' does not exist");
+            return false;
+        }
+        if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DEMO_MAGIC, 4) || header.version != DEMO_VERSION) {
+            print("'" + PathFor(name) + "' is not a version " + to_string(DEMO_VERSION) + " demo");
+            fclose(file);
+            file = NULL;
+            return false;
+        }
+        header.map[sizeof(header.map) - 1] = 0;
+        if(!Restart(header.map, header.start)) {
+            fclose(file);
+            file = NULL;
+            return false;
+        }
+
+        // Ticks run at the rate they were recorded at
+        rate = timestep->rate;
+        timestep->SetRate(header.rate);
+
+        Demo::name = name;
+        tick = 0;
+        frames.clear();
+        mode = timing ? DEMO_TIMING : DEMO_PLAYING;
+        if(timing) {
+            // Frames are drawn as fast as they can be
+            vsync = IsWindowReady() && IsWindowState(FLAG_VSYNC_HINT);
+            if(vsync)
+                ClearWindowState(FLAG_VSYNC_HINT);
+            frames.reserve(header.ticks);
+        }
+        print((timing ? "Timing demo '" : "Playing demo '") + name + "', " + to_string(header.ticks) + " ticks on '" + header.map + "'");
+        return true;
+    }
+
+    // A console command was run, it is recorded with the next tick
+    void Command(const string & line) {
+        if(mode == DEMO_RECORDING)
+            commands.push_back(line);
+    }
+
+    bool WriteTick(const PlayerInput & input) {
+        int x = input.axis.x > 0.5f ? 2 : input.axis.x < -0.5f ? 0 : 1;
+        int y = input.axis.y > 0.5f ? 2 : input.axis.y < -0.5f ? 0 : 1;
+        bool look = input.look.x != 0 || input.look.y != 0;
+        uint8_t flags = (input.jump ? DEMO_JUMP : 0) | (input.descend ? DEMO_DESCEND : 0) | (look ? DEMO_LOOK : 0)
+            | (commands.empty() ? 0 : DEMO_COMMANDS) | x << DEMO_AXIS_X | y << DEMO_AXIS_Y;
+
+        bool written = fwrite(&flags, 1, 1, file) == 1;
+        if(look)
+            written &= fwrite(&input.look, sizeof(Vector2), 1, file) == 1;
+        if(!commands.empty()) {
+            uint8_t count = min<size_t>(commands.size(), 255);
+            written &= fwrite(&count, 1, 1, file) == 1;
+            for(unsigned int i = 0; i < count; ++i) {
+                uint16_t length = min<size_t>(commands[i].size(), 65535);
+                written &= fwrite(&length, 2, 1, file) == 1 && fwrite(commands[i].data(), 1, length, file) == length;
+            }
+            commands.clear();
+        }
+        return written;
+    }
+
+    bool ReadTick(PlayerInput * input) {
+        uint8_t flags;
+        if(tick >= header.ticks || fread(&flags, 1, 1, file) != 1)
+            return false;
+
+        *input = PlayerInput();
+        input->jump = flags & DEMO_JUMP;
+        input->descend = flags & DEMO_DESCEND;
+        input->axis = {(float)((flags >> DEMO_AXIS_X & 3) - 1), (float)((flags >> DEMO_AXIS_Y & 3) - 1)};
+        if(flags & DEMO_LOOK && fread(&input->look, sizeof(Vector2), 1, file) != 1)
+            return false;
+        if(flags & DEMO_COMMANDS) {
+            uint8_t count;
+            if(fread(&count, 1, 1, file) != 1)
+                return false;
+            for(unsigned int i = 0; i < count; ++i) {
+                uint16_t length;
+                if(fread(&length, 2, 1, file) != 1)
+                    return false;
+                string line(length, 0);
+                if(fread(&line[0], 1, length, file) != length)
+                    return false;
+                if(exec)
+                    exec(line);
+            }
+        }
+        return true;
+    }
+
+    // Called before every simulation tick. Records the tick's input, or replaces it with the
+    // recorded one; the axes are recorded as -1, 0 or 1 so the recording run moves as playback will.
+    void Tick(PlayerInput * input) {
+        if(ended) {
+            if(Playing())
+                *input = PlayerInput();
+            return;
+        }
+
+        if(mode == DEMO_RECORDING) {
+            input->axis = {roundf(Clamp(input->axis.x, -1, 1)), roundf(Clamp(input->axis.y, -1, 1))};
+            if(!WriteTick(*input)) {
+                print("Could not write demo '" + name + "'");
+                ended = true;
+                return;
+            }
+            ++tick;
+        }
+        else if(Playing()) {
+            if(!ReadTick(input)) {
+                *input = PlayerInput();
+                ended = true;
+                return;
+            }
+            ++tick;
+        }
+    }
+
+    // Called at the end of every frame with the time spent on its ticks and drawing it
+    void Frame(double sim_us, double render_us) {
+        if(mode == DEMO_TIMING)
+            frames.push_back({sim_us, render_us});
+    }
+};
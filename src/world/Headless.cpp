@@ -0,0 +1,201 @@
+#pragma once
+
+// Headless mode runs the world simulation without a window or GL context, as fast as possible.
+// Usage: main --headless <map> [--ticks N] [--rate HZ] [--objects N] [--threads N] [--input script]
+#include <raylib.h>
+#include <raymath.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "world/World.cpp"
+#include "world/Timestep.cpp"
+#include "render/AssetCache.cpp"
+#include "player/Player.cpp"
+#include "system/JobSystem.cpp"
+
+using namespace std;
+
+namespace Headless {
+    // One line of an input script, held for a number of ticks
+    struct ScriptStep {
+        int ticks;
+        PlayerInput input;
+    };
+
+    // Scripts are lines of "ticks axis_x axis_y look_x look_y jump descend", '#' starts a comment
+    bool LoadScript(const char * filename, vector<ScriptStep> * script) {
+        ifstream file(filename);
+        if(!file.is_open())
+            return false;
+
+        string line;
+        while(getline(file, line)) {
+            if(line.empty() || line[0] == '#')
+                continue;
+
+            ScriptStep step = {0};
+            int jump = 0, descend = 0;
+            int count = sscanf(line.c_str(), "%d %f %f %f %f %d %d",
+                &step.ticks, &step.input.axis.x, &step.input.axis.y,
+                &step.input.look.x, &step.input.look.y, &jump, &descend
+            );
+            if(count < 1)
+                continue;
+
+            step.input.jump = jump;
+            step.input.descend = descend;
+            script->push_back(step);
+        }
+        return true;
+    }
+
+    // Default script: walk forward, strafe while turning, jump, walk back
+    vector<ScriptStep> DefaultScript() {
+        vector<ScriptStep> script;
+        PlayerInput input;
+
+        input.axis = {0, 1};
+        script.push_back({120, input});
+
+        input.axis = {1, 0.5f};
+        input.look = {8, 0};
+        script.push_back({120, input});
+
+        input = PlayerInput();
+        input.jump = true;
+        script.push_back({30, input});
+
+        input = PlayerInput();
+        input.axis = {0, -1};
+        input.look = {-4, 1};
+        script.push_back({120, input});
+        return script;
+    }
+
+    // Accumulated time spent in one subsystem
+    struct Timing {
+        const char * name;
+        double total = 0;
+        double worst = 0;
+
+        void Add(chrono::steady_clock::time_point start) {
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+            total += us;
+            if(us > worst)
+                worst = us;
+        }
+    };
+
+    int Run(int argc, char ** argv) {
+        if(argc < 1) {
+            cout << "Usage: main --headless <map> [--ticks N] [--rate HZ] [--objects N] [--threads N] [--input script]\n";
+            return 1;
+        }
+
+        const char * map = argv[0];
+        long ticks = 10000;
+        int object_count = 0;
+        int threads = 0;
+        Timestep timestep = Timestep(60);
+        vector<ScriptStep> script = DefaultScript();
+
+        for(int i = 1; i + 1 < argc; i += 2) {
+            if(!strcmp(argv[i], "--ticks"))
+                ticks = atol(argv[i + 1]);
+            else if(!strcmp(argv[i], "--rate"))
+                timestep.SetRate(atof(argv[i + 1]));
+            else if(!strcmp(argv[i], "--objects"))
+                object_count = atoi(argv[i + 1]);
+            else if(!strcmp(argv[i], "--threads"))
+                threads = atoi(argv[i + 1]);
+            else if(!strcmp(argv[i], "--input")) {
+                script.clear();
+                if(!LoadScript(argv[i + 1], &script) || script.empty()) {
+                    cout << "ERROR: HEADLESS: Could not read input script '" << argv[i + 1] << "'\n";
+                    return 1;
+                }
+            }
+        }
+
+        // A world without a renderer loads CPU-side geometry only
+        Player player = Player({0, 10, 0.1});
+        AssetCache assets = AssetCache(true);
+        JobSystem jobs = JobSystem(threads);
+        World world = World(NULL, &player, &assets);
+        world.object_manager.jobs = &jobs;
+        world.object_manager.RegisterScripts("resources/scripts");
+
+        auto start = chrono::steady_clock::now();
+        if(!world.Load(map)) {
+            cout << "ERROR: HEADLESS: Map '" << map << "' does not exist\n";
+            return 1;
+        }
+        double load_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        // Scatter generic objects around the spawn to load the object manager
+        world.object_manager.RegisterType(GameObject());
+        world.object_manager.Reserve(object_count);
+        srand(1);
+        for(int i = 0; i < object_count; ++i) {
+            Vector3 position = {
+                player.position.x + (rand() % 2000) / 100.0f - 10,
+                player.position.y + (rand() % 400) / 100.0f - 2,
+                player.position.z + (rand() % 2000) / 100.0f - 10
+            };
+            world.object_manager.Create("GameObject", "object" + to_string(i), position, {0});
+            world.object_manager.local_bounds.back() = {{-0.25f, -0.25f, -0.25f}, {0.25f, 0.25f, 0.25f}};
+            world.object_manager.collision_levels.back() = i % 4;
+        }
+
+        Timing player_timing = {"player"}, object_timing = {"objects"}, tick_timing = {"tick"};
+        unsigned long queries = 0;
+        unsigned int step = 0;
+        int step_ticks = 0;
+
+        start = chrono::steady_clock::now();
+        for(long tick = 0; tick < ticks; ++tick) {
+            auto tick_start = chrono::steady_clock::now();
+
+            // Feed the scripted input, looping when it runs out
+            if(step_ticks >= script[step].ticks) {
+                step = (step + 1) % script.size();
+                step_ticks = 0;
+            }
+            player.input = script[step].input;
+            ++step_ticks;
+
+            auto subsystem = chrono::steady_clock::now();
+            player.Update(timestep.Step(), world.edit ? NULL : &world.collision);
+            player_timing.Add(subsystem);
+            queries += player.queries;
+
+            subsystem = chrono::steady_clock::now();
+            world.object_manager.Update(timestep.Step(), &player);
+            object_timing.Add(subsystem);
+
+            tick_timing.Add(tick_start);
+        }
+        double run_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "HEADLESS: '" << map << "' " << ticks << " ticks at " << timestep.rate << " Hz, "
+             << world.collision.triangles.size() << " triangles, " << world.object_manager.objects.size() << " objects, "
+             << jobs.ThreadCount() << " threads\n";
+        cout << "  load:          " << load_ms << " ms\n";
+        cout << "  ticks/sec:     " << ticks / run_s << " (" << ticks / run_s / timestep.rate << "x realtime)\n";
+        for(Timing timing : {tick_timing, player_timing, object_timing})
+            cout << "  " << timing.name << ":" << string(14 - strlen(timing.name), ' ')
+                 << timing.total / ticks << " us avg, " << timing.worst << " us worst\n";
+        cout << "  queries/tick:  " << (double)queries / ticks << "\n";
+        cout << "  final player:  " << player.position.x << ", " << player.position.y << ", " << player.position.z
+             << (player.grounded ? " (grounded)" : "") << "\n";
+
+        world.Reset();
+        assets.Clear();
+        return 0;
+    }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+// Reloads shaders, models, textures and maps under resources/ while the game runs, only the asset
+// that changed. Files are picked up through a FileWatcher once they have been quiet for a moment.
+#include <raylib.h>
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "render/AssetCache.cpp"
+#include "render/MeshChunks.cpp"
+#include "render/Renderer.cpp"
+#include "system/FileWatcher.cpp"
+#include "world/MapLoader.cpp"
+#include "world/ObjLoader.cpp"
+#include "world/SimThread.cpp"
+#include "world/World.cpp"
+
+using namespace std;
+
+// A renderer shader and the files and defines it was compiled from
+struct ShaderSource {
+    int index;
+    string vertex;
+    string fragment;
+    string defines;
+};
+
+namespace HotReload {
+    World * world;
+    Renderer * renderer;
+    AssetCache * assets;
+    MapLoader * loader;
+    // Held between ticks while assets the world uses are swapped, NULL when nothing ticks
+    SimThread * sim = NULL;
+
+    // Runs after a model or texture reloads with its path (and the replaced model), for state held
+    // outside the world like the tiling values of the texture map or the player's weapon
+    function<void (const string &, const Model *)> on_reload;
+
+    FileWatcher watcher;
+    vector<ShaderSource> shaders;
+    // Changes held back while a map loads, the loader is reading the cached meshes
+    vector<string> deferred;
+
+    bool Start(const char * directory) {
+        if(!watcher.Watch(directory))
+            return false;
+        cout << "INFO: RELOAD: Watching '" << directory << "' for changes\n";
+        return true;
+    }
+
+    // Recompile the renderer shader at index when either of its files or any include changes
+    void AddShader(int index, const char * vertex, const char * fragment, const char * defines = "") {
+        shaders.push_back({index, vertex, fragment, defines});
+    }
+
+    void ReloadShaders(const string & path) {
+        // Includes are not tracked per shader, there are only a few shaders
+        bool included = IsFileExtension(path.c_str(), ".glsl");
+        for(ShaderSource & source : shaders) {
+            if(!included && source.vertex != path && source.fragment != path)
+                continue;
+
+            Shader loaded, old;
+            if(!assets->ReloadShader(source.vertex, source.fragment, source.defines, &loaded, &old))
+                continue;
+            renderer->shaders[source.index].Reload(loaded);
+            world->batcher.Replace(old, loaded);
+        }
+    }
+
+    void ReloadModel(const string & path) {
+        // World models are drawn in chunks, they are split again the same way
+        bool chunked = world->UsesModel(path);
+        Model old;
+        bool reloaded = assets->ReloadModel(path, &old, !chunked ? function<bool (Model *)>(NULL) : [&](Model * model) {
+            Mesh mesh;
+            if(!ObjLoader::Load(path.c_str(), &mesh))
+                return false;
+            vector<Mesh> chunks = MeshChunks::Split(mesh);
+            ObjLoader::Unload(mesh);
+            for(Mesh & chunk : chunks)
+                UploadMesh(&chunk, false);
+            *model = MeshChunks::ToModel(chunks);
+            return true;
+        });
+        if(!reloaded)
+            return;
+
+        const Model & loaded = assets->assets.at(path).model;
+        world->object_manager.RefreshModel(old, loaded);
+        if(on_reload)
+            on_reload(path, &old);
+
+        // The collision scene and baked lighting were built from the old meshes, the map loads again
+        // in the background (from the reloaded model) and is swapped in by Console::Update
+        world->RefreshModel(old, loaded);
+        if(chunked)
+            loader->Start(world->filename.c_str());
+    }
+
+    void ReloadTexture(const string & path) {
+        Texture2D texture;
+        if(assets->ReloadTexture(path, &texture) && on_reload)
+            on_reload(path, NULL);
+    }
+
+    void ReloadMap(const string & path) {
+        if(world->filename != path)
+            return;
+        if(world->Patch(path.c_str()))
+            return;
+
+        cout << "INFO: RELOAD: '" << path << "' changed its models, loading it again\n";
+        loader->Start(path.c_str());
+    }
+
+    void Reload(const string & path) {
+        const char * file = path.c_str();
+        if(IsFileExtension(file, ".vs;.fs;.glsl"))
+            ReloadShaders(path);
+        else if(IsFileExtension(file, ".obj"))
+            ReloadModel(path);
+        else if(IsFileExtension(file, ".png"))
+            ReloadTexture(path);
+        else if(IsFileExtension(file, ".map"))
+            ReloadMap(path);
+    }
+
+    // Called once a frame, reloads the files that changed
+    void Update() {
+        vector<string> changed = watcher.Poll(GetTime());
+        if(loader->Busy()) {
+            deferred.insert(deferred.end(), changed.begin(), changed.end());
+            return;
+        }
+
+        changed.insert(changed.begin(), deferred.begin(), deferred.end());
+        deferred.clear();
+        if(changed.empty())
+            return;
+
+        SimPause pause(sim);
+        for(string & path : changed)
+            Reload(path);
+    }
+};
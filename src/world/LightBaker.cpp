@@ -0,0 +1,364 @@
+#pragma once
+
+// Static light baking. Map lights never move, so their light is worked out once per map instead of
+// every frame: each world model is subdivided until no edge is longer than LIGHT_BAKE_SPACING and
+// every vertex sums the lights it can see (a shadow ray through the collision BVH per light). The
+// result goes into the vertex colours, world.fs adds it to the dynamic lights. Bakes are cached in
+// RUN_DIR "lighting/" under a hash of everything they were made from.
+#include <raylib.h>
+#include <raymath.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+#include "system/JobSystem.cpp"
+
+#ifndef RUN_DIR
+#define RUN_DIR "run/"
+#endif
+
+// Bump whenever the baked result would change, older cache files are then baked again
+#define LIGHT_BAKE_VERSION 1
+#define LIGHT_BAKE_MAGIC "C3LB"
+#define LIGHT_BAKE_DIR RUN_DIR "lighting/"
+
+// Longest edge left after subdivision, and the most pieces one edge is cut into
+#define LIGHT_BAKE_SPACING 1.0f
+#define LIGHT_BAKE_MAX_CUTS 64
+// Baked light is stored as 16 bits in the red and green channels, covering -RANGE to RANGE.
+// world.fs decodes it with the same range.
+#define LIGHT_BAKE_RANGE 4.0f
+// Shadow rays start this far off the surface so they do not hit it
+#define LIGHT_BAKE_BIAS 0.01f
+// Fewest grid points lit per job
+#define LIGHT_BAKE_CHUNK 256
+
+using namespace std;
+
+struct BakeInstance {
+    // Source meshes in model space and where the model sits in the world
+    vector<Mesh> meshes;
+    Vector3 position;
+    // Subdivided copy of the meshes with the baked light in its colours, CPU-side until uploaded
+    Mesh lit = {0};
+};
+
+class LightBaker {
+    public:
+    vector<BakeInstance> instances;
+    // Static lights, position and brightness
+    vector<Vector4> lights;
+    const CollisionWorld * collision = NULL;
+    // Spreads the lighting over several threads. Map loads pass a long-lived one, NULL makes a job
+    // system for this bake only (for one-off bakes like the benchmarks).
+    JobSystem * jobs = NULL;
+    // Threads of the job system made without jobs, 0 uses every core
+    unsigned int threads = 0;
+    // Where bakes are cached, empty to always bake
+    string cache_dir = LIGHT_BAKE_DIR;
+
+    // What the last Bake did
+    uint64_t hash = 0;
+    bool cached = false;
+    size_t vertex_count = 0;
+    unsigned long rays = 0;
+    double ms = 0;
+
+    // Fill in the lit mesh of every instance, from the cache when it holds this exact bake
+    bool Bake() {
+        auto start = chrono::steady_clock::now();
+        hash = Hash();
+        rays = 0;
+        string path = cache_dir.empty() ? "" : cache_dir + Hex(hash) + ".clit";
+
+        cached = !path.empty() && Read(path);
+        if(!cached) {
+            for(BakeInstance & instance : instances) {
+                Free(instance.lit);
+                Subdivide(instance);
+            }
+            LightVertices();
+            if(!path.empty())
+                Write(path);
+        }
+
+        vertex_count = 0;
+        for(BakeInstance & instance : instances)
+            vertex_count += instance.lit.vertexCount;
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        if(cached)
+            cout << "INFO: BAKE: Read lighting " << Hex(hash) << " from the cache (" << vertex_count << " vertices)\n";
+        else
+            cout << "INFO: BAKE: Lit " << vertex_count << " vertices from " << lights.size() << " lights in "
+                 << (int)ms << " ms (" << rays << " shadow rays)\n";
+        return true;
+    }
+
+    // Free a lit mesh that was never uploaded
+    static void Free(Mesh & mesh) {
+        MemFree(mesh.vertices);
+        MemFree(mesh.texcoords);
+        MemFree(mesh.normals);
+        MemFree(mesh.colors);
+        mesh = {0};
+    }
+
+    // Baked light from a vertex colour, the inverse of what LightVertices writes
+    static float Decode(const unsigned char * color) {
+        return ((color[0] * 256 + color[1]) / 65535.0f * 2 - 1) * LIGHT_BAKE_RANGE;
+    }
+
+    private:
+    // FNV-1a over the bake settings, the geometry and the lights
+    uint64_t Hash() {
+        uint64_t value = 14695981039346656037ull;
+        auto add = [&](const void * data, size_t size) {
+            for(size_t i = 0; i < size; ++i)
+                value = (value ^ ((const unsigned char *)data)[i]) * 1099511628211ull;
+        };
+
+        int settings[2] = {LIGHT_BAKE_VERSION, LIGHT_BAKE_MAX_CUTS};
+        float constants[3] = {LIGHT_BAKE_SPACING, LIGHT_BAKE_RANGE, LIGHT_BAKE_BIAS};
+        add(settings, sizeof(settings));
+        add(constants, sizeof(constants));
+
+        for(BakeInstance & instance : instances) {
+            add(&instance.position, sizeof(Vector3));
+            for(Mesh & mesh : instance.meshes) {
+                add(&mesh.vertexCount, sizeof(int));
+                add(mesh.vertices, mesh.vertexCount * 3 * sizeof(float));
+                if(mesh.texcoords)
+                    add(mesh.texcoords, mesh.vertexCount * 2 * sizeof(float));
+                if(mesh.normals)
+                    add(mesh.normals, mesh.vertexCount * 3 * sizeof(float));
+            }
+        }
+
+        // Other world geometry casts shadows too
+        if(collision != NULL)
+            add(collision->triangles.data(), collision->triangles.size() * sizeof(CollisionTriangle));
+        add(lights.data(), lights.size() * sizeof(Vector4));
+        return value;
+    }
+
+    static string Hex(uint64_t value) {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+        return text;
+    }
+
+    // A grid point of the subdivision in world space, lit once for every vertex placed on it
+    struct BakePoint {
+        Vector3 position;
+        // Shadow rays leave along the face normal
+        Vector3 face;
+        float light;
+    };
+    vector<BakePoint> points;
+    // Point of every subdivided vertex, instances in order
+    vector<unsigned int> vertex_points;
+
+    // Cut every triangle of the instance into an n by n grid of smaller ones, keeping its winding
+    void Subdivide(BakeInstance & instance) {
+        vector<float> vertices, texcoords, normals;
+        for(Mesh & mesh : instance.meshes) {
+            // Meshes are unindexed triangle lists, as the OBJ loaders produce them
+            for(int tri = 0; tri + 2 < mesh.vertexCount; tri += 3) {
+                Vector3 p[3];
+                Vector2 uv[3] = {{0}};
+                Vector3 normal[3];
+                for(int k = 0; k < 3; ++k) {
+                    const float * v = &mesh.vertices[(tri + k) * 3];
+                    p[k] = {v[0], v[1], v[2]};
+                    if(mesh.texcoords)
+                        uv[k] = {mesh.texcoords[(tri + k) * 2], mesh.texcoords[(tri + k) * 2 + 1]};
+                }
+                Vector3 face = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(p[1], p[0]), Vector3Subtract(p[2], p[0])));
+                for(int k = 0; k < 3; ++k) {
+                    const float * n = mesh.normals ? &mesh.normals[(tri + k) * 3] : NULL;
+                    normal[k] = n ? (Vector3){n[0], n[1], n[2]} : face;
+                }
+
+                float longest = max(max(Vector3Distance(p[0], p[1]), Vector3Distance(p[1], p[2])), Vector3Distance(p[2], p[0]));
+                int cuts = Clamp(ceilf(longest / LIGHT_BAKE_SPACING), 1, LIGHT_BAKE_MAX_CUTS);
+
+                // Grid point (i, j) sits at p0 + (p1 - p0) * i / cuts + (p2 - p0) * j / cuts,
+                // row j holds cuts - j + 1 points
+                unsigned int first_point = points.size();
+                for(int j = 0; j <= cuts; ++j) {
+                    for(int i = 0; i + j <= cuts; ++i) {
+                        float u = i / (float)cuts, v = j / (float)cuts, w = 1 - u - v;
+                        Vector3 position = Vector3Add(Vector3Add(Vector3Scale(p[0], w), Vector3Scale(p[1], u)), Vector3Scale(p[2], v));
+                        points.push_back({Vector3Add(position, instance.position), face, 0});
+                    }
+                }
+
+                auto emit = [&](int i, int j) {
+                    float u = i / (float)cuts, v = j / (float)cuts, w = 1 - u - v;
+                    Vector3 position = Vector3Add(Vector3Add(Vector3Scale(p[0], w), Vector3Scale(p[1], u)), Vector3Scale(p[2], v));
+                    Vector3 n = Vector3Add(Vector3Add(Vector3Scale(normal[0], w), Vector3Scale(normal[1], u)), Vector3Scale(normal[2], v));
+                    vertices.insert(vertices.end(), {position.x, position.y, position.z});
+                    texcoords.insert(texcoords.end(), {uv[0].x * w + uv[1].x * u + uv[2].x * v, uv[0].y * w + uv[1].y * u + uv[2].y * v});
+                    normals.insert(normals.end(), {n.x, n.y, n.z});
+                    // Rows before j hold (cuts + 1) + cuts + ... + (cuts - j + 2) points
+                    vertex_points.push_back(first_point + j * (cuts + 1) - j * (j - 1) / 2 + i);
+                };
+                for(int j = 0; j < cuts; ++j) {
+                    for(int i = 0; i + j < cuts; ++i) {
+                        emit(i, j); emit(i + 1, j); emit(i, j + 1);
+                        if(i + j + 1 < cuts) {
+                            emit(i + 1, j); emit(i + 1, j + 1); emit(i, j + 1);
+                        }
+                    }
+                }
+            }
+        }
+
+        Mesh & lit = instance.lit;
+        lit.vertexCount = vertices.size() / 3;
+        lit.triangleCount = lit.vertexCount / 3;
+        lit.vertices = (float *)MemAlloc(vertices.size() * sizeof(float));
+        lit.texcoords = (float *)MemAlloc(texcoords.size() * sizeof(float));
+        lit.normals = (float *)MemAlloc(normals.size() * sizeof(float));
+        lit.colors = (unsigned char *)MemAlloc(lit.vertexCount * 4);
+        copy(vertices.begin(), vertices.end(), lit.vertices);
+        copy(texcoords.begin(), texcoords.end(), lit.texcoords);
+        copy(normals.begin(), normals.end(), lit.normals);
+    }
+
+    // Light every grid point in parallel chunks, then colour the vertices
+    void LightVertices() {
+        unique_ptr<JobSystem> own;
+        JobSystem * system = jobs;
+        if(system == NULL) {
+            own.reset(new JobSystem(threads));
+            system = own.get();
+        }
+
+        atomic<unsigned long> total_rays(0);
+        system->ParallelFor(points.size(), LIGHT_BAKE_CHUNK, [&](unsigned int begin, unsigned int end) {
+            unsigned long cast = 0;
+            for(unsigned int i = begin; i < end; ++i)
+                points[i].light = Gather(points[i].position, points[i].face, &cast);
+            total_rays += cast;
+        });
+        rays = total_rays;
+
+        size_t vertex = 0;
+        for(BakeInstance & instance : instances) {
+            for(int i = 0; i < instance.lit.vertexCount; ++i) {
+                float light = points[vertex_points[vertex++]].light;
+
+                // Rounded to 16 bits over the range, alpha 0 tells world.fs the colour holds baked light
+                unsigned int value = (unsigned int)((Clamp(light / LIGHT_BAKE_RANGE, -1, 1) * 0.5f + 0.5f) * 65535 + 0.5f);
+                unsigned char * color = &instance.lit.colors[i * 4];
+                color[0] = value >> 8;
+                color[1] = value & 255;
+                color[2] = 0;
+                color[3] = 0;
+            }
+        }
+
+        points = {};
+        vertex_points = {};
+    }
+
+    // Light at a point from every static light it can see, the same 1 / distance falloff the shaders use
+    float Gather(Vector3 position, Vector3 face, unsigned long * cast) {
+        Vector3 origin = Vector3Add(position, Vector3Scale(face, LIGHT_BAKE_BIAS));
+        float light = 0;
+        for(Vector4 & source : lights) {
+            Vector3 to = Vector3Subtract({source.x, source.y, source.z}, origin);
+            float distance = Vector3Length(to);
+            if(distance < LIGHT_BAKE_BIAS)
+                continue;
+
+            ++*cast;
+            if(collision != NULL && collision->Occluded({origin, Vector3Scale(to, 1 / distance)}, distance))
+                continue;
+            light += source.w / Vector3Distance(position, {source.x, source.y, source.z});
+        }
+        return light;
+    }
+
+    // Cache file: magic, hash, instance count, then per instance its vertex count and arrays
+    bool Read(const string & path) {
+        FILE * file = fopen(path.c_str(), "rb");
+        if(file == NULL)
+            return false;
+
+        char magic[4];
+        uint64_t file_hash;
+        uint32_t count;
+        bool valid = fread(magic, 1, 4, file) == 4 && !memcmp(magic, LIGHT_BAKE_MAGIC, 4)
+            && fread(&file_hash, sizeof(file_hash), 1, file) == 1 && file_hash == hash
+            && fread(&count, sizeof(count), 1, file) == 1 && count == instances.size();
+
+        for(unsigned int i = 0; valid && i < count; ++i) {
+            Mesh & lit = instances[i].lit;
+            Free(lit);
+            uint32_t vertices;
+            if(fread(&vertices, sizeof(vertices), 1, file) != 1) {
+                valid = false;
+                break;
+            }
+            lit.vertexCount = vertices;
+            lit.triangleCount = vertices / 3;
+            lit.vertices = (float *)MemAlloc(vertices * 3 * sizeof(float));
+            lit.texcoords = (float *)MemAlloc(vertices * 2 * sizeof(float));
+            lit.normals = (float *)MemAlloc(vertices * 3 * sizeof(float));
+            lit.colors = (unsigned char *)MemAlloc(vertices * 4);
+            valid = fread(lit.vertices, sizeof(float), vertices * 3, file) == vertices * 3
+                && fread(lit.texcoords, sizeof(float), vertices * 2, file) == vertices * 2
+                && fread(lit.normals, sizeof(float), vertices * 3, file) == vertices * 3
+                && fread(lit.colors, 1, vertices * 4, file) == vertices * 4;
+        }
+        fclose(file);
+
+        if(!valid) {
+            cout << "WARNING: BAKE: Ignoring unreadable cache file '" << path << "'\n";
+            for(BakeInstance & instance : instances)
+                Free(instance.lit);
+        }
+        return valid;
+    }
+
+    void Write(const string & path) {
+        mkdir(RUN_DIR, 0755);
+        mkdir(cache_dir.c_str(), 0755);
+        FILE * file = fopen(path.c_str(), "wb");
+        if(file == NULL) {
+            cout << "WARNING: BAKE: Could not write '" << path << "'\n";
+            return;
+        }
+
+        uint32_t count = instances.size();
+        bool written = fwrite(LIGHT_BAKE_MAGIC, 1, 4, file) == 4 && fwrite(&hash, sizeof(hash), 1, file) == 1
+            && fwrite(&count, sizeof(count), 1, file) == 1;
+        for(BakeInstance & instance : instances) {
+            Mesh & lit = instance.lit;
+            uint32_t vertices = lit.vertexCount;
+            written = written && fwrite(&vertices, sizeof(vertices), 1, file) == 1
+                && fwrite(lit.vertices, sizeof(float), vertices * 3, file) == vertices * 3
+                && fwrite(lit.texcoords, sizeof(float), vertices * 2, file) == vertices * 2
+                && fwrite(lit.normals, sizeof(float), vertices * 3, file) == vertices * 3
+                && fwrite(lit.colors, 1, vertices * 4, file) == vertices * 4;
+        }
+        if(fclose(file) != 0 || !written) {
+            cout << "WARNING: BAKE: Could not write '" << path << "'\n";
+            remove(path.c_str());
+        }
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+// Parser for the text .map format, one "<kind> <argument> <x,y,z>" entry per line
+#include <raylib.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "math/vec.hpp"
+
+using namespace std;
+
+// A single map line: M (model path), L (light brightness), O (object type) or P (player spawn)
+struct MapEntry {
+    char kind;
+    string argument;
+    Vector3 position;
+};
+
+struct MapFile {
+    // Maps marked EDIT open in the editor
+    bool edit = false;
+    vector<MapEntry> entries;
+
+    bool Load(const char * filename) {
+        ifstream file(filename);
+        if(!file.is_open())
+            return false;
+
+        string line;
+        while(getline(file, line)) {
+            if(!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            if(line == "EDIT") {
+                edit = true;
+                continue;
+            }
+
+            istringstream tokens(line);
+            string kind, argument, position, extra;
+            if(!(tokens >> kind >> argument >> position) || (tokens >> extra))
+                continue;
+
+            entries.push_back({kind[0], argument, Vec3FromString(position)});
+        }
+        return true;
+    }
+};
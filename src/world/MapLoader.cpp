@@ -0,0 +1,459 @@
+#pragma once
+
+// Maps load in two stages. A worker thread reads the map, parses its models (several at once),
+// builds the collision BVH and bakes the static lights, then the main thread uploads the models a
+// few at a time each frame.
+// The world keeps running the old map until World::Apply swaps the finished one in.
+#include <raylib.h>
+#include <raymath.h>
+#include <float.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+#include "render/AssetCache.cpp"
+#include "world/BakedMap.cpp"
+#include "world/LightBaker.cpp"
+#include "render/MeshChunks.cpp"
+#include "world/MapFile.cpp"
+#include "world/ObjLoader.cpp"
+#include "world/Pvs.cpp"
+
+// Milliseconds of model uploads allowed per frame while a map streams in
+#define MAP_UPLOAD_BUDGET 4.0
+
+using namespace std;
+
+enum MapFormat {
+    MAP_ANY,
+    MAP_TEXT,
+    MAP_BAKED
+};
+
+enum MapLoadState {
+    LOAD_IDLE,
+    LOAD_PARSING,
+    LOAD_UPLOADING,
+    LOAD_READY,
+    LOAD_FAILED
+};
+
+struct LoadedModel {
+    string path;
+    Vector3 position;
+    // First model in the map with the same path, only that one is parsed
+    unsigned int source;
+    // CPU-only mesh from the worker, empty when the cache already holds the model. It is split into
+    // chunks once the worker is done with it.
+    Mesh mesh;
+    vector<Mesh> chunks;
+    // Set by the upload stage, holds one cache reference until the world takes it
+    Model model;
+    bool loaded;
+    // Chunks of this instance subdivided with the static lights baked into their colours, owned by
+    // the loader until the world takes them
+    vector<Mesh> lit;
+};
+
+struct LoadedLight {
+    float brightness;
+    Vector3 position;
+};
+
+struct LoadedObject {
+    string type;
+    Vector3 position;
+};
+
+class MapLoader {
+    public:
+    // The parsed map, only read these once Update reports LOAD_READY
+    string filename;
+    bool edit = false;
+    vector<LoadedModel> models;
+    vector<LoadedLight> lights;
+    vector<LoadedObject> objects;
+    bool has_spawn = false;
+    Vector3 spawn = {0};
+    CollisionWorld collision;
+    // Cells visible from each cell, only baked maps have them
+    Pvs pvs;
+
+    // Bake the static lights into the models, on by default when uploading. Edit maps never are.
+    bool bake_lighting;
+    // Whether the last map had its lights baked
+    bool lit = false;
+    // Threads the lights are baked on, NULL starts some for every bake
+    JobSystem * jobs = NULL;
+
+    // Progress, safe to read from the main thread at any time
+    atomic<int> state;
+    atomic<int> model_count, models_parsed;
+    int models_uploaded = 0;
+
+    // Without upload the models stay CPU-side, for headless worlds
+    MapLoader(AssetCache * assets, bool upload) : state(LOAD_IDLE), model_count(0), models_parsed(0) {
+        this->assets = assets;
+        this->upload = upload;
+        bake_lighting = upload;
+    }
+    MapLoader(const MapLoader &) = delete;
+    MapLoader & operator=(const MapLoader &) = delete;
+    ~MapLoader() {
+        Finish();
+    }
+
+    bool Busy() {
+        return state == LOAD_PARSING || state == LOAD_UPLOADING;
+    }
+
+    // Begin loading on a worker thread, call Update every frame until it is ready
+    bool Start(const char * filename, MapFormat format = MAP_ANY) {
+        if(!Begin(filename))
+            return false;
+
+        worker = thread([this, format]() {
+            state = Parse(format) ? LOAD_UPLOADING : LOAD_FAILED;
+        });
+        return true;
+    }
+
+    // Load on the calling thread, blocking until ready
+    bool Load(const char * filename, MapFormat format = MAP_ANY) {
+        if(!Begin(filename))
+            return false;
+
+        state = Parse(format) ? LOAD_UPLOADING : LOAD_FAILED;
+        return Update(DBL_MAX) == LOAD_READY;
+    }
+
+    // Main thread, uploads parsed models until the budget is spent and returns the new state
+    int Update(double budget_ms) {
+        if(state != LOAD_UPLOADING)
+            return state;
+        if(worker.joinable())
+            worker.join();
+
+        auto start = chrono::steady_clock::now();
+        while(models_uploaded < (int)models.size()) {
+            LoadedModel & loaded = models[models_uploaded++];
+            vector<Mesh> * chunks = &models[loaded.source].chunks;
+
+            // Models already resident (or uploaded earlier in this map) come straight from the cache
+            loaded.loaded = assets->AcquireModel(loaded.path, &loaded.model, [&](Model * model) {
+                if(chunks->empty())
+                    return false;
+                if(upload) {
+                    for(Mesh & chunk : *chunks)
+                        UploadMesh(&chunk, false);
+                }
+                *model = MeshChunks::ToModel(*chunks);
+                chunks->clear();
+                return true;
+            });
+            if(!loaded.loaded)
+                cout << "WARNING: MAP: Could not load model '" << loaded.path << "'\n";
+            else if(upload) {
+                for(Mesh & chunk : loaded.lit)
+                    UploadMesh(&chunk, false);
+            }
+
+            if(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= budget_ms)
+                break;
+        }
+
+        if(models_uploaded == (int)models.size())
+            state = LOAD_READY;
+        return state;
+    }
+
+    // Release everything the world did not take and return to idle, waits for the worker if needed
+    void Finish() {
+        if(worker.joinable())
+            worker.join();
+
+        for(LoadedModel & loaded : models) {
+            if(loaded.loaded)
+                assets->Release(loaded.path);
+            if(loaded.mesh.vertices != NULL)
+                ObjLoader::Unload(loaded.mesh);
+            for(Mesh & chunk : loaded.chunks)
+                ObjLoader::Unload(chunk);
+            for(Mesh & chunk : loaded.lit) {
+                if(chunk.vaoId != 0 || chunk.vboId != NULL)
+                    UnloadMesh(chunk);
+                else
+                    LightBaker::Free(chunk);
+            }
+        }
+        for(auto & entry : resident)
+            assets->Release(entry.first);
+
+        models.clear();
+        lights.clear();
+        objects.clear();
+        resident.clear();
+        collision.Clear();
+        pvs.Clear();
+        has_spawn = false;
+        lit = false;
+        models_uploaded = 0;
+        model_count = 0;
+        models_parsed = 0;
+        state = LOAD_IDLE;
+    }
+
+    string Status() {
+        switch(state) {
+            case LOAD_PARSING:
+                return "Loading '" + filename + "': parsed " + to_string(models_parsed.load()) + "/" + to_string(model_count.load()) + " models";
+            case LOAD_UPLOADING:
+                return "Loading '" + filename + "': uploaded " + to_string(models_uploaded) + "/" + to_string(model_count.load()) + " models";
+            case LOAD_READY:
+                return "Loaded '" + filename + "'";
+            case LOAD_FAILED:
+                return "Could not load '" + filename + "'";
+        }
+        return "";
+    }
+
+    private:
+    AssetCache * assets;
+    bool upload;
+    thread worker;
+    // Models resident in the cache when the load began, pinned so the worker can read their meshes
+    map<string, Model> resident;
+
+    bool Begin(const char * filename) {
+        Finish();
+        if(!FileExists(filename))
+            return false;
+
+        this->filename = filename;
+        assets->PinModels(&resident);
+        state = LOAD_PARSING;
+        return true;
+    }
+
+    // Worker stage, touches nothing outside the loader
+    bool Parse(MapFormat format) {
+        if(!ParseMap(format))
+            return false;
+        if(bake_lighting && !edit)
+            BakeLighting();
+
+        // Models are drawn in chunks so the parts out of view can be culled
+        for(LoadedModel & loaded : models) {
+            if(loaded.mesh.vertexCount > 0) {
+                loaded.chunks = MeshChunks::Split(loaded.mesh);
+                ObjLoader::Unload(loaded.mesh);
+                loaded.mesh = {0};
+            }
+        }
+        return true;
+    }
+
+    bool ParseMap(MapFormat format) {
+        if(format == MAP_BAKED || (format == MAP_ANY && IsFileExtension(filename.c_str(), ".cmap")))
+            return ParseBaked(filename.c_str());
+
+        // Prefer the baked copy of a text map while it is up to date
+        if(format == MAP_ANY) {
+            string baked_path = BakedMap::PathFor(filename.c_str());
+            if(BakedMap::IsCurrent(filename.c_str(), baked_path.c_str()) && ParseBaked(baked_path.c_str()))
+                return true;
+        }
+        return ParseText();
+    }
+
+    // The meshes of a model, parsed by this load or already in the cache
+    vector<Mesh> MeshesOf(LoadedModel & loaded) {
+        auto cached = resident.find(loaded.path);
+        if(cached != resident.end())
+            return vector<Mesh>(cached->second.meshes, cached->second.meshes + cached->second.meshCount);
+        if(models[loaded.source].mesh.vertexCount == 0)
+            return {};
+        return {models[loaded.source].mesh};
+    }
+
+    // Light every model instance with the map lights, shadowed by the collision scene
+    void BakeLighting() {
+        LightBaker baker;
+        baker.collision = &collision;
+        baker.jobs = jobs;
+        for(LoadedLight & light : lights)
+            baker.lights.push_back({light.position.x, light.position.y, light.position.z, light.brightness});
+        for(LoadedModel & loaded : models)
+            baker.instances.push_back({MeshesOf(loaded), loaded.position});
+
+        lit = baker.Bake();
+        for(unsigned int i = 0; i < models.size(); ++i) {
+            Mesh & baked = baker.instances[i].lit;
+            if(baked.vertexCount > 0)
+                models[i].lit = MeshChunks::Split(baked);
+            LightBaker::Free(baked);
+        }
+    }
+
+    // Point every model at the first one sharing its path
+    void FindSources() {
+        map<string, unsigned int> first;
+        for(unsigned int i = 0; i < models.size(); ++i)
+            models[i].source = first.insert({models[i].path, i}).first->second;
+        model_count = models.size();
+    }
+
+    bool NeedsParse(unsigned int index) {
+        return models[index].source == index && resident.find(models[index].path) == resident.end();
+    }
+
+    bool ParseText() {
+        MapFile map;
+        if(!map.Load(filename.c_str()))
+            return false;
+
+        edit = map.edit;
+        for(MapEntry entry : map.entries) {
+            switch(entry.kind) {
+                case 'M':
+                    models.push_back({entry.argument, entry.position});
+                    break;
+                case 'L':
+                    lights.push_back({strtof(entry.argument.c_str(), NULL), entry.position});
+                    break;
+                case 'O':
+                    objects.push_back({entry.argument, entry.position});
+                    break;
+                case 'P':
+                    has_spawn = true;
+                    spawn = entry.position;
+                    break;
+            }
+        }
+        FindSources();
+
+        // Parse the model files in parallel, each thread takes the next unparsed model
+        atomic<unsigned int> next(0);
+        auto parse = [&]() {
+            for(unsigned int i = next++; i < models.size(); i = next++) {
+                if(NeedsParse(i))
+                    ObjLoader::Load(models[i].path.c_str(), &models[i].mesh);
+                ++models_parsed;
+            }
+        };
+        unsigned int thread_count = min<unsigned int>(max(1u, thread::hardware_concurrency()), models.size());
+        vector<thread> threads;
+        for(unsigned int i = 1; i < thread_count; ++i)
+            threads.emplace_back(parse);
+        parse();
+        for(thread & parser : threads)
+            parser.join();
+
+        // Build the collision scene from the parsed meshes and the resident models
+        collision.Clear();
+        for(LoadedModel & loaded : models) {
+            Matrix transform = MatrixTranslate(loaded.position.x, loaded.position.y, loaded.position.z);
+            auto cached = resident.find(loaded.path);
+            if(cached == resident.end())
+                collision.AddMesh(models[loaded.source].mesh, transform);
+            else {
+                for(int i = 0; i < cached->second.meshCount; ++i)
+                    collision.AddMesh(cached->second.meshes[i], transform);
+            }
+        }
+        collision.Build();
+        return true;
+    }
+
+    bool ParseBaked(const char * path) {
+        BakedMap baked;
+        if(!baked.Open(path))
+            return false;
+
+        edit = baked.header->flags & BAKED_FLAG_EDIT;
+
+        size_t model_total, vertex_count, texcoord_count, normal_count;
+        const BakedModel * baked_models = baked.Section<BakedModel>(BAKED_MODELS, &model_total);
+        const float * vertices = baked.Section<float>(BAKED_VERTICES, &vertex_count);
+        const float * texcoords = baked.Section<float>(BAKED_TEXCOORDS, &texcoord_count);
+        const float * normals = baked.Section<float>(BAKED_NORMALS, &normal_count);
+
+        // Nothing is taken from a damaged file, the text map is read instead. Its vertex ranges and
+        // PVS rows could point anywhere.
+        for(size_t i = 0; i < model_total; ++i) {
+            uint64_t end = (uint64_t)baked_models[i].first_vertex + baked_models[i].vertex_count;
+            if(end * 3 > vertex_count || end * 2 > texcoord_count || end * 3 > normal_count) {
+                cout << "WARNING: MAP: Baked map '" << path << "' has a model outside its vertices\n";
+                return false;
+            }
+        }
+
+        size_t count;
+        const PvsGrid * grid = baked.Section<PvsGrid>(BAKED_PVS_GRID, &count);
+        if(count > 0) {
+            pvs.grid = *grid;
+            const uint32_t * offsets = baked.Section<uint32_t>(BAKED_PVS_OFFSETS, &count);
+            pvs.offsets.assign(offsets, offsets + count);
+            const unsigned char * rows = baked.Section<unsigned char>(BAKED_PVS_ROWS, &count);
+            pvs.rows.assign(rows, rows + count);
+            if(!pvs.Valid()) {
+                cout << "WARNING: MAP: Baked map '" << path << "' has a damaged PVS\n";
+                pvs.Clear();
+                return false;
+            }
+        }
+
+        for(size_t i = 0; i < model_total; ++i)
+            models.push_back({baked_models[i].Path(), baked_models[i].position});
+        FindSources();
+
+        // Meshes are copied out of the mapping so the cache can keep them after it closes
+        for(unsigned int i = 0; i < models.size(); ++i) {
+            if(NeedsParse(i)) {
+                const BakedModel & baked_model = baked_models[i];
+                Mesh & mesh = models[i].mesh;
+                mesh.vertexCount = baked_model.vertex_count;
+                mesh.triangleCount = mesh.vertexCount / 3;
+                mesh.vertices = (float *)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+                mesh.texcoords = (float *)MemAlloc(mesh.vertexCount * 2 * sizeof(float));
+                mesh.normals = (float *)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+                memcpy(mesh.vertices, vertices + baked_model.first_vertex * 3, mesh.vertexCount * 3 * sizeof(float));
+                memcpy(mesh.texcoords, texcoords + baked_model.first_vertex * 2, mesh.vertexCount * 2 * sizeof(float));
+                memcpy(mesh.normals, normals + baked_model.first_vertex * 3, mesh.vertexCount * 3 * sizeof(float));
+            }
+            ++models_parsed;
+        }
+
+        const BakedLight * baked_lights = baked.Section<BakedLight>(BAKED_LIGHTS, &count);
+        for(size_t i = 0; i < count; ++i)
+            lights.push_back({baked_lights[i].brightness, baked_lights[i].position});
+
+        const BakedObject * baked_objects = baked.Section<BakedObject>(BAKED_OBJECTS, &count);
+        for(size_t i = 0; i < count; ++i)
+            objects.push_back({baked_objects[i].Type(), baked_objects[i].position});
+
+        // The last spawn wins, like in text maps
+        const Vector3 * spawns = baked.Section<Vector3>(BAKED_SPAWNS, &count);
+        if(count > 0) {
+            has_spawn = true;
+            spawn = spawns[count - 1];
+        }
+
+        // The BVH was built at bake time
+        const BvhNode * nodes = baked.Section<BvhNode>(BAKED_BVH_NODES, &count);
+        collision.nodes.assign(nodes, nodes + count);
+        const CollisionTriangle * triangles = baked.Section<CollisionTriangle>(BAKED_BVH_TRIANGLES, &count);
+        collision.triangles.assign(triangles, triangles + count);
+
+        cout << "INFO: MAP: Read baked map '" << path << "' (" << model_total << " models, "
+             << collision.triangles.size() << " triangles)\n";
+        return true;
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+// CPU-side OBJ loader, used where raylib's LoadModel cannot run (no GL context) or where only geometry is needed
+#include <raylib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace ObjLoader {
+    // Resolve a 1-based (or negative, relative) OBJ index into a 0-based one
+    int ResolveIndex(int index, int count) {
+        if(index < 0)
+            return count + index;
+        return index - 1;
+    }
+
+    // Parse a single face corner ("v", "v/vt", "v//vn" or "v/vt/vn")
+    void ParseCorner(const char * token, int * v, int * vt, int * vn) {
+        *v = 0; *vt = 0; *vn = 0;
+        *v = strtol(token, (char **)&token, 10);
+        if(*token != '/') return;
+        ++token;
+        if(*token != '/')
+            *vt = strtol(token, (char **)&token, 10);
+        if(*token != '/') return;
+        ++token;
+        *vn = strtol(token, (char **)&token, 10);
+    }
+
+    // Loads every object in the file into one non-indexed, triangulated mesh without uploading it
+    bool Load(const char * filename, Mesh * mesh) {
+        *mesh = {0};
+
+        char * text = LoadFileText(filename);
+        if(text == NULL)
+            return false;
+
+        vector<Vector3> positions, normals;
+        vector<Vector2> texcoords;
+        vector<float> out_vertices, out_texcoords, out_normals;
+
+        char * line = text;
+        while(*line) {
+            char * end = line;
+            while(*end && *end != '\n') ++end;
+            char next = *end;
+            *end = '\0';
+
+            if(line[0] == 'v' && line[1] == ' ') {
+                Vector3 v;
+                sscanf(line + 2, "%f %f %f", &v.x, &v.y, &v.z);
+                positions.push_back(v);
+            }
+            else if(line[0] == 'v' && line[1] == 't') {
+                Vector2 vt = {0, 0};
+                sscanf(line + 3, "%f %f", &vt.x, &vt.y);
+                texcoords.push_back(vt);
+            }
+            else if(line[0] == 'v' && line[1] == 'n') {
+                Vector3 vn;
+                sscanf(line + 3, "%f %f %f", &vn.x, &vn.y, &vn.z);
+                normals.push_back(vn);
+            }
+            else if(line[0] == 'f' && line[1] == ' ') {
+                // Collect the polygon corners
+                int corners[64][3];
+                int corner_count = 0;
+                char * token = line + 2;
+                while(*token && corner_count < 64) {
+                    while(*token == ' ' || *token == '\t' || *token == '\r') ++token;
+                    if(!*token) break;
+                    ParseCorner(token, &corners[corner_count][0], &corners[corner_count][1], &corners[corner_count][2]);
+                    ++corner_count;
+                    while(*token && *token != ' ' && *token != '\t') ++token;
+                }
+
+                // Triangulate as a fan
+                for(int i = 1; i + 1 < corner_count; ++i) {
+                    int tri[3] = {0, i, i + 1};
+                    for(int c : tri) {
+                        int v = ResolveIndex(corners[c][0], positions.size());
+                        int vt = ResolveIndex(corners[c][1], texcoords.size());
+                        int vn = ResolveIndex(corners[c][2], normals.size());
+
+                        Vector3 p = (v >= 0 && v < (int)positions.size()) ? positions[v] : (Vector3){0};
+                        out_vertices.insert(out_vertices.end(), {p.x, p.y, p.z});
+
+                        Vector2 t = (corners[c][1] && vt < (int)texcoords.size()) ? texcoords[vt] : (Vector2){0};
+                        out_texcoords.insert(out_texcoords.end(), {t.x, 1 - t.y});
+
+                        Vector3 n = (corners[c][2] && vn < (int)normals.size()) ? normals[vn] : (Vector3){0};
+                        out_normals.insert(out_normals.end(), {n.x, n.y, n.z});
+                    }
+                }
+            }
+
+            *end = next;
+            line = next ? end + 1 : end;
+        }
+        UnloadFileText(text);
+
+        mesh->vertexCount = out_vertices.size() / 3;
+        mesh->triangleCount = mesh->vertexCount / 3;
+        if(mesh->vertexCount == 0)
+            return false;
+
+        mesh->vertices = (float *)MemAlloc(out_vertices.size() * sizeof(float));
+        mesh->texcoords = (float *)MemAlloc(out_texcoords.size() * sizeof(float));
+        mesh->normals = (float *)MemAlloc(out_normals.size() * sizeof(float));
+        copy(out_vertices.begin(), out_vertices.end(), mesh->vertices);
+        copy(out_texcoords.begin(), out_texcoords.end(), mesh->texcoords);
+        copy(out_normals.begin(), out_normals.end(), mesh->normals);
+
+        cout << "INFO: OBJ: Parsed '" << filename << "' (" << mesh->triangleCount << " triangles)\n";
+        return true;
+    }
+
+    // Free a mesh returned by Load that was never uploaded to the GPU
+    void Unload(Mesh mesh) {
+        MemFree(mesh.vertices);
+        MemFree(mesh.texcoords);
+        MemFree(mesh.normals);
+        MemFree(mesh.colors);
+        MemFree(mesh.indices);
+    }
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+// Potentially visible sets. The map's bounds are split into a grid of cells and when the map is
+// baked every pair of cells is tested for a clear line between sample points in each, so at runtime
+// only what overlaps the cells visible from the camera's cell is drawn or lit. The samples can miss
+// a line through a gap between them, so every set is then grown by one cell: a cell also sees every
+// cell next to one a sample line reached. What is culled wrongly has to be more than a cell away
+// from the end of every clear line between the two cells' samples.
+// Each cell's row of visibility bits is run length encoded like Quake's, extended to full bytes as
+// open maps have dense rows: a 0x00 or 0xff byte is followed by the number of such bytes it stands
+// for, every other byte is stored as is. Rows that would only grow are stored raw.
+#include <raylib.h>
+#include <raymath.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "physics/CollisionWorld.cpp"
+
+// Smallest cell edge, cells grow until the grid has at most PVS_MAX_CELLS
+#define PVS_CELL_SIZE 2.0f
+#define PVS_MAX_CELLS 1024
+// Sample points per cell, one at the centre of each octant
+#define PVS_SAMPLES 8
+// Rows a build thread takes at a time
+#define PVS_CHUNK 8
+
+// First byte of every encoded row
+#define PVS_ROW_RLE 0
+#define PVS_ROW_RAW 1
+
+using namespace std;
+
+// Grid placement, stored as is in baked maps
+struct PvsGrid {
+    Vector3 origin;
+    float cell_size;
+    int32_t size[3];
+    uint32_t cell_count;
+};
+
+class Pvs {
+    public:
+    PvsGrid grid = {0};
+    // Start of each cell's encoded row in rows
+    vector<uint32_t> offsets;
+    vector<unsigned char> rows;
+
+    // Cell of the last viewpoint (-1 outside the grid, where everything is visible) and how many
+    // cells it sees
+    int cell = -1;
+    unsigned int visible_count = 0;
+
+    // Build statistics and threads to build with, 0 uses every core
+    unsigned long rays = 0;
+    double ms = 0;
+    unsigned int threads = 0;
+
+    // Maps without a PVS (and edit maps) draw everything
+    bool Empty() const {
+        return grid.cell_count == 0;
+    }
+
+    void Clear() {
+        grid = {0};
+        offsets.clear();
+        rows.clear();
+        visible.clear();
+        cell = -1;
+        visible_count = 0;
+    }
+
+    int CellAt(Vector3 point) const {
+        int coords[3];
+        if(!Coords(point, coords, false))
+            return -1;
+        return (coords[2] * grid.size[1] + coords[1]) * grid.size[0] + coords[0];
+    }
+
+    // Decode the row of the cell holding point, Visible then answers for that cell
+    void SetViewpoint(Vector3 point) {
+        int current = Empty() ? -1 : CellAt(point);
+        if(current == cell)
+            return;
+
+        cell = current;
+        visible_count = grid.cell_count;
+        if(cell < 0)
+            return;
+        Decode(cell, &visible);
+        visible_count = 0;
+        for(unsigned int i = 0; i < grid.cell_count; ++i)
+            visible_count += Test(visible, i);
+    }
+
+    // Whether a box overlaps any cell visible from the viewpoint
+    bool Visible(BoundingBox box) const {
+        if(cell < 0)
+            return true;
+
+        int low[3], high[3];
+        Coords(box.min, low, true);
+        Coords(box.max, high, true);
+        for(int z = low[2]; z <= high[2]; ++z) {
+            for(int y = low[1]; y <= high[1]; ++y) {
+                for(int x = low[0]; x <= high[0]; ++x) {
+                    if(Test(visible, (z * grid.size[1] + y) * grid.size[0] + x))
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Whether the grid and every row hold together, for a PVS read from a file. Decode trusts them.
+    bool Valid() const {
+        if(Empty())
+            return offsets.empty() && rows.empty();
+        for(int axis = 0; axis < 3; ++axis) {
+            if(grid.size[axis] <= 0)
+                return false;
+        }
+        if((uint64_t)grid.size[0] * grid.size[1] * grid.size[2] != grid.cell_count || grid.cell_count > PVS_MAX_CELLS
+                || !(grid.cell_size > 0) || offsets.size() != grid.cell_count)
+            return false;
+
+        // Every row has to decode to row_bytes without reading past rows
+        size_t row_bytes = (grid.cell_count + 7) / 8;
+        for(uint32_t offset : offsets) {
+            if(offset >= rows.size())
+                return false;
+            size_t in = offset + 1;
+            if(rows[offset] == PVS_ROW_RAW) {
+                if(rows.size() - in < row_bytes)
+                    return false;
+                continue;
+            }
+            for(size_t out = 0; out < row_bytes; ++in) {
+                if(in >= rows.size())
+                    return false;
+                if(rows[in] == 0x00 || rows[in] == 0xff) {
+                    if(++in >= rows.size() || rows[in] > row_bytes - out)
+                        return false;
+                    out += rows[in];
+                }
+                else
+                    ++out;
+            }
+        }
+        return true;
+    }
+
+    // Visibility bits of one cell, one bit per cell
+    void Decode(int from, vector<unsigned char> * bits) const {
+        size_t row_bytes = (grid.cell_count + 7) / 8;
+        const unsigned char * in = &rows[offsets[from]];
+        if(*in++ == PVS_ROW_RAW) {
+            bits->assign(in, in + row_bytes);
+            return;
+        }
+
+        bits->assign(row_bytes, 0);
+        for(size_t out = 0; out < row_bytes; ++in) {
+            if(*in == 0x00 || *in == 0xff) {
+                unsigned char value = *in;
+                for(int run = *++in; run > 0; --run)
+                    (*bits)[out++] = value;
+            }
+            else
+                (*bits)[out++] = *in;
+        }
+    }
+
+    // Rows that would grow (mixed bytes with short runs) are stored raw behind a marker byte
+    static void Encode(const vector<unsigned char> & bits, vector<unsigned char> * out) {
+        size_t start = out->size();
+        out->push_back(PVS_ROW_RLE);
+        for(size_t i = 0; i < bits.size(); ++i) {
+            out->push_back(bits[i]);
+            if(bits[i] != 0x00 && bits[i] != 0xff)
+                continue;
+            size_t run = 1;
+            while(i + run < bits.size() && bits[i + run] == bits[i] && run < 255)
+                ++run;
+            out->push_back(run);
+            i += run - 1;
+        }
+
+        if(out->size() - start > bits.size() + 1) {
+            out->resize(start);
+            out->push_back(PVS_ROW_RAW);
+            out->insert(out->end(), bits.begin(), bits.end());
+        }
+    }
+
+    // Split the collision scene's bounds into cells and find which see each other. A cell always
+    // sees itself and its neighbours, otherwise two cells see each other if any line between their
+    // sample points is clear.
+    bool Build(const CollisionWorld & collision) {
+        Clear();
+        if(collision.nodes.empty())
+            return false;
+        auto start = chrono::steady_clock::now();
+
+        Vector3 extent = Vector3Subtract(collision.nodes[0].max, collision.nodes[0].min);
+        grid.origin = collision.nodes[0].min;
+        grid.cell_size = PVS_CELL_SIZE;
+        do {
+            grid.size[0] = extent.x / grid.cell_size + 1;
+            grid.size[1] = extent.y / grid.cell_size + 1;
+            grid.size[2] = extent.z / grid.cell_size + 1;
+            grid.cell_count = grid.size[0] * grid.size[1] * grid.size[2];
+            if(grid.cell_count > PVS_MAX_CELLS)
+                grid.cell_size *= 1.25f;
+        } while(grid.cell_count > PVS_MAX_CELLS);
+
+        unsigned int count = grid.cell_count;
+        vector<Vector3> samples(count * PVS_SAMPLES);
+        for(unsigned int i = 0; i < count; ++i) {
+            Vector3 corner = CellMin(i);
+            for(int s = 0; s < PVS_SAMPLES; ++s) {
+                samples[i * PVS_SAMPLES + s] = {
+                    corner.x + grid.cell_size * (s & 1 ? 0.75f : 0.25f),
+                    corner.y + grid.cell_size * (s & 2 ? 0.75f : 0.25f),
+                    corner.z + grid.cell_size * (s & 4 ? 0.75f : 0.25f)
+                };
+            }
+        }
+
+        // Each pair is tested once by the row of its lower cell, every thread writes its own rows
+        vector<unsigned char> sees(count * count, 0);
+        atomic<unsigned int> next(0);
+        atomic<unsigned long> total_rays(0);
+        unsigned int chunks = (count + PVS_CHUNK - 1) / PVS_CHUNK;
+        auto work = [&]() {
+            unsigned long cast = 0;
+            for(unsigned int chunk = next++; chunk < chunks; chunk = next++) {
+                unsigned int last = min(count, (chunk + 1) * PVS_CHUNK);
+                for(unsigned int a = chunk * PVS_CHUNK; a < last; ++a) {
+                    for(unsigned int b = a; b < count; ++b)
+                        sees[a * count + b] = Neighbours(a, b) || LineOfSight(collision, &samples[a * PVS_SAMPLES], &samples[b * PVS_SAMPLES], &cast);
+                }
+            }
+            total_rays += cast;
+        };
+
+        unsigned int thread_count = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+        thread_count = min(thread_count, chunks);
+        vector<thread> workers;
+        for(unsigned int i = 1; i < thread_count; ++i)
+            workers.emplace_back(work);
+        work();
+        for(thread & worker : workers)
+            worker.join();
+        rays = total_rays;
+
+        vector<unsigned char> bits;
+        for(unsigned int a = 0; a < count; ++a) {
+            bits.assign((count + 7) / 8, 0);
+            for(unsigned int b = 0; b < count; ++b) {
+                if(!sees[a < b ? a * count + b : b * count + a])
+                    continue;
+                // Grown by a cell, for lines that pass between the samples
+                ForNeighbourhood(b, [&](unsigned int near) {
+                    bits[near >> 3] |= 1 << (near & 7);
+                });
+            }
+            offsets.push_back(rows.size());
+            Encode(bits, &rows);
+        }
+
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "INFO: PVS: " << count << " cells of " << grid.cell_size << " units, " << rows.size() / 1024.0f
+             << " KiB encoded (" << rays << " rays, " << ms << " ms)\n";
+        return true;
+    }
+
+    private:
+    // Row of the viewpoint's cell
+    vector<unsigned char> visible;
+
+    static bool Test(const vector<unsigned char> & bits, unsigned int index) {
+        return bits[index >> 3] & (1 << (index & 7));
+    }
+
+    // Cell coordinates of a point, clamped into the grid or rejected when outside it
+    bool Coords(Vector3 point, int * coords, bool clamp) const {
+        float position[3] = {point.x - grid.origin.x, point.y - grid.origin.y, point.z - grid.origin.z};
+        for(int axis = 0; axis < 3; ++axis) {
+            coords[axis] = floorf(position[axis] / grid.cell_size);
+            if(coords[axis] < 0 || coords[axis] >= grid.size[axis]) {
+                if(!clamp)
+                    return false;
+                coords[axis] = Clamp(coords[axis], 0, grid.size[axis] - 1);
+            }
+        }
+        return true;
+    }
+
+    Vector3 CellMin(unsigned int index) const {
+        int x = index % grid.size[0], y = index / grid.size[0] % grid.size[1], z = index / (grid.size[0] * grid.size[1]);
+        return Vector3Add(grid.origin, {x * grid.cell_size, y * grid.cell_size, z * grid.cell_size});
+    }
+
+    // Run visit on a cell and every cell around it in the grid
+    template<typename Visit>
+    void ForNeighbourhood(unsigned int index, Visit visit) const {
+        int x = index % grid.size[0], y = index / grid.size[0] % grid.size[1], z = index / (grid.size[0] * grid.size[1]);
+        for(int nz = max(z - 1, 0); nz <= min(z + 1, grid.size[2] - 1); ++nz) {
+            for(int ny = max(y - 1, 0); ny <= min(y + 1, grid.size[1] - 1); ++ny) {
+                for(int nx = max(x - 1, 0); nx <= min(x + 1, grid.size[0] - 1); ++nx)
+                    visit((nz * grid.size[1] + ny) * grid.size[0] + nx);
+            }
+        }
+    }
+
+    bool Neighbours(unsigned int a, unsigned int b) const {
+        Vector3 offset = Vector3Subtract(CellMin(a), CellMin(b));
+        float reach = grid.cell_size * 1.5f;
+        return fabsf(offset.x) < reach && fabsf(offset.y) < reach && fabsf(offset.z) < reach;
+    }
+
+    static bool LineOfSight(const CollisionWorld & collision, const Vector3 * from, const Vector3 * to, unsigned long * cast) {
+        for(int i = 0; i < PVS_SAMPLES; ++i) {
+            for(int j = 0; j < PVS_SAMPLES; ++j) {
+                Vector3 direction = Vector3Subtract(to[j], from[i]);
+                float distance = Vector3Length(direction);
+                ++*cast;
+                if(!collision.Occluded({from[i], Vector3Scale(direction, 1 / distance)}, distance))
+                    return true;
+            }
+        }
+        return false;
+    }
+};
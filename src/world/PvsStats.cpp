@@ -0,0 +1,87 @@
+#pragma once
+
+// Prints the PVS of a map's baked copy, baking it first when it is missing or out of date.
+// Usage: main --pvs <map or .cmap>
+#include <raylib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "world/BakedMap.cpp"
+#include "world/Pvs.cpp"
+
+using namespace std;
+
+namespace PvsStats {
+    int Run(const char * map_path) {
+        // Baked maps are read as they are
+        string baked_path = map_path;
+        if(!IsFileExtension(map_path, ".cmap")) {
+            baked_path = BakedMap::PathFor(map_path);
+            if(!BakedMap::IsCurrent(map_path, baked_path.c_str()) && !BakedMap::Bake(map_path, baked_path.c_str()))
+                return 1;
+        }
+
+        BakedMap baked;
+        if(!baked.Open(baked_path.c_str())) {
+            cout << "ERROR: PVS: Could not open '" << baked_path << "'\n";
+            return 1;
+        }
+
+        Pvs pvs;
+        size_t count;
+        const PvsGrid * grid = baked.Section<PvsGrid>(BAKED_PVS_GRID, &count);
+        if(count == 0) {
+            cout << "PVS: '" << map_path << "' has no PVS (edit maps draw everything)\n";
+            return 1;
+        }
+        pvs.grid = *grid;
+        const uint32_t * offsets = baked.Section<uint32_t>(BAKED_PVS_OFFSETS, &count);
+        pvs.offsets.assign(offsets, offsets + count);
+        const unsigned char * rows = baked.Section<unsigned char>(BAKED_PVS_ROWS, &count);
+        pvs.rows.assign(rows, rows + count);
+
+        // Visible cells per cell, and whether every row encodes back to the same bytes
+        unsigned int cells = pvs.grid.cell_count, least = cells, most = 0, sees_all = 0;
+        unsigned long total = 0;
+        bool round_trip = true;
+        vector<unsigned char> bits, encoded;
+        for(unsigned int cell = 0; cell < cells; ++cell) {
+            pvs.Decode(cell, &bits);
+            encoded.clear();
+            Pvs::Encode(bits, &encoded);
+            size_t end = cell + 1 < cells ? pvs.offsets[cell + 1] : pvs.rows.size();
+            round_trip &= encoded.size() == end - pvs.offsets[cell] && equal(encoded.begin(), encoded.end(), &pvs.rows[pvs.offsets[cell]]);
+
+            unsigned int visible = 0;
+            for(unsigned int other = 0; other < cells; ++other)
+                visible += (bits[other >> 3] >> (other & 7)) & 1;
+            least = min(least, visible);
+            most = max(most, visible);
+            sees_all += visible == cells;
+            total += visible;
+        }
+        size_t raw = (size_t)cells * ((cells + 7) / 8);
+
+        cout << "PVS: '" << map_path << "'\n";
+        cout << "  grid:      " << pvs.grid.size[0] << " x " << pvs.grid.size[1] << " x " << pvs.grid.size[2] << " cells of "
+             << pvs.grid.cell_size << " units (" << cells << " cells)\n";
+        cout << "  visible:   " << total / (double)cells << " cells avg (" << 100.0 * total / ((double)cells * cells) << "%), "
+             << least << " least, " << most << " most, " << sees_all << " cells see everything\n";
+        cout << "  size:      " << pvs.rows.size() << " bytes encoded, " << raw << " raw ("
+             << 100.0 * pvs.rows.size() / raw << "%)\n";
+        cout << "  encoding:  " << (round_trip ? "round trips" : "does not round trip (bad)") << "\n";
+
+        // What the player sees from the spawn
+        const Vector3 * spawns = baked.Section<Vector3>(BAKED_SPAWNS, &count);
+        if(count > 0) {
+            pvs.SetViewpoint(spawns[count - 1]);
+            if(pvs.cell >= 0)
+                cout << "  spawn:     cell " << pvs.cell << ", sees " << pvs.visible_count << " cells\n";
+            else
+                cout << "  spawn:     outside the grid\n";
+        }
+        return round_trip ? 0 : 1;
+    }
+};
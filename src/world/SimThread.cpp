@@ -0,0 +1,391 @@
+#pragma once
+
+// Runs the simulation ticks (player, objects and scripts, demo input) on their own thread, so a
+// frame takes about as long as the slower of ticking and drawing rather than both. After its ticks
+// the simulation publishes a snapshot of what the renderer draws, and the main thread draws the
+// newest one while the next ticks run. Everything else that changes the world (console commands,
+// map swaps, reloads) stays on the main thread and holds the simulation between ticks with a
+// SimPause while it does. Without Start the ticks run on the calling thread in Advance.
+#include <raylib.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "object/ObjectManager.cpp"
+#include "player/Player.cpp"
+#include "system/Profiler.cpp"
+#include "world/Demo.cpp"
+#include "world/Timestep.cpp"
+#include "world/World.cpp"
+
+// Marks the middle snapshot as published since the renderer last took it
+#define SNAPSHOT_FRESH 4
+
+using namespace std;
+
+// What the renderer needs of one tick
+struct RenderSnapshot {
+    unsigned long tick = 0;
+    // Steady clock seconds at which the tick was due and its length, the view interpolates from
+    // the previous tick to this one over the following step
+    double time = 0;
+    float step = 1 / 60.0f;
+    // ObjectManager::revision when it was taken, the objects are stale once it changed
+    unsigned int revision = 0;
+    Player player;
+    vector<ObjectInstance> objects;
+};
+
+// Three snapshots passed from one writer to one reader without locking or waiting. The writer fills
+// the back one and swaps it with the middle one, the reader swaps the middle one with its front one
+// when it was published since. The vectors are reused, so they stop allocating once warm.
+class SnapshotBuffer {
+    public:
+    SnapshotBuffer() : middle(2) {}
+    SnapshotBuffer(const SnapshotBuffer &) = delete;
+    SnapshotBuffer & operator=(const SnapshotBuffer &) = delete;
+
+    RenderSnapshot & Back() {
+        return snapshots[back];
+    }
+
+    void Publish() {
+        back = middle.exchange(back | SNAPSHOT_FRESH, memory_order_acq_rel) & 3;
+    }
+
+    // Take the newest snapshot as the front one, false when the front one still is
+    bool Acquire() {
+        if(!(middle.load(memory_order_relaxed) & SNAPSHOT_FRESH))
+            return false;
+        front = middle.exchange(front, memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const RenderSnapshot & Front() {
+        return snapshots[front];
+    }
+
+    private:
+    RenderSnapshot snapshots[3];
+    int back = 0, front = 1;
+    atomic<int> middle;
+};
+
+class SimThread {
+    public:
+    World * world;
+    Player * player;
+    Timestep * timestep;
+
+    SnapshotBuffer snapshots;
+
+    SimThread(World * world, Player * player, Timestep * timestep) : lockstep(false), sim_ns(0) {
+        this->world = world;
+        this->player = player;
+        this->timestep = timestep;
+    }
+    SimThread(const SimThread &) = delete;
+    SimThread & operator=(const SimThread &) = delete;
+
+    ~SimThread() {
+        Stop();
+    }
+
+    static double Now() {
+        return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Start() {
+        if(running)
+            return;
+        // The frames have something to draw before the first tick
+        Publish();
+        running = true;
+        // A SimPause the thread was started in ends without holding it
+        pauses = 0;
+        worker = thread([this]() {
+            Run();
+        });
+        cout << "INFO: SIM: Ticking on its own thread\n";
+    }
+
+    // A tick waiting on the main thread in Call is abandoned
+    void Stop() {
+        if(!running)
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            running = false;
+        }
+        changed.notify_all();
+        worker.join();
+        cout << "INFO: SIM: Ticking on the main thread\n";
+    }
+
+    bool Running() {
+        return running;
+    }
+
+    // Hand over the input sampled this frame, mouse movement adds up until a tick takes it
+    void Input(const PlayerInput & input) {
+        lock_guard<mutex> guard(input_lock);
+        Vector2 look = Vector2Add(pending.look, input.look);
+        pending = input;
+        pending.look = look;
+    }
+
+    void ClearInput() {
+        lock_guard<mutex> guard(input_lock);
+        pending = PlayerInput();
+    }
+
+    // Run the ticks due after frame_time on the calling thread, when not started
+    void Advance(float frame_time) {
+        if(running || lockstep)
+            return;
+        int ticks = timestep->Advance(frame_time);
+        RunTicks(ticks);
+        if(ticks > 0)
+            Publish();
+    }
+
+    // In lockstep run one tick, on the thread when started. WaitStep waits for it to finish.
+    void Step() {
+        if(!running) {
+            ++timestep->tick;
+            RunTicks(1);
+            Publish();
+            return;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            ++steps_requested;
+        }
+        changed.notify_all();
+    }
+
+    void WaitStep() {
+        unique_lock<mutex> guard(lock);
+        while(running && steps_done != steps_requested) {
+            if(calling)
+                RunCall(guard);
+            else
+                changed.wait(guard);
+        }
+    }
+
+    // Hold the simulation between ticks, from the main thread. Nests, and inside a Call the
+    // simulation is already waiting.
+    void Pause() {
+        if(!running)
+            return;
+
+        unique_lock<mutex> guard(lock);
+        ++pauses;
+        changed.notify_all();
+        while(!parked && !servicing) {
+            if(calling)
+                RunCall(guard);
+            else
+                changed.wait(guard);
+        }
+    }
+
+    void Resume() {
+        if(!running)
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            pauses = max(0, pauses - 1);
+        }
+        changed.notify_all();
+    }
+
+    // Run a function on the main thread from a tick, which waits until it ran in Service (like
+    // console commands replayed by a demo). Off the simulation thread it just runs.
+    void Call(function<void ()> function) {
+        if(this_thread::get_id() != worker.get_id()) {
+            function();
+            return;
+        }
+        unique_lock<mutex> guard(lock);
+        if(!running)
+            return;
+        call = move(function);
+        calling = true;
+        changed.notify_all();
+        changed.wait(guard, [this]() {
+            return !calling || !running;
+        });
+    }
+
+    // Run what the ticks are waiting on, once a frame from the main thread
+    void Service() {
+        if(!running)
+            return;
+        unique_lock<mutex> guard(lock);
+        RunCall(guard);
+    }
+
+    // Microseconds spent ticking since the last call
+    double TakeSimTime() {
+        return sim_ns.exchange(0) / 1000.0;
+    }
+
+    // Ticks run one per Step rather than by the clock, for timed demos
+    void SetLockstep(bool lockstep) {
+        if(lockstep == this->lockstep)
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            this->lockstep = lockstep;
+            steps_done = steps_requested;
+        }
+        changed.notify_all();
+    }
+
+    private:
+    thread worker;
+    mutex lock;
+    condition_variable changed;
+    bool running = false;
+    bool lockstep;
+    int pauses = 0;
+    // The simulation waits in Run for the pauses to end
+    bool parked = false;
+
+    // A tick waits in Call for the main thread to run call, which it is doing while servicing
+    function<void ()> call;
+    bool calling = false;
+    bool servicing = false;
+
+    unsigned long steps_requested = 0, steps_done = 0;
+
+    atomic<uint64_t> sim_ns;
+
+    mutex input_lock;
+    PlayerInput pending;
+
+    void Run() {
+        double last = Now();
+        unique_lock<mutex> guard(lock);
+        while(running) {
+            if(pauses > 0) {
+                parked = true;
+                changed.notify_all();
+                changed.wait(guard, [this]() {
+                    return pauses == 0 || !running;
+                });
+                parked = false;
+                last = Now();
+                continue;
+            }
+
+            if(lockstep) {
+                if(steps_done == steps_requested) {
+                    changed.wait(guard);
+                    last = Now();
+                    continue;
+                }
+                guard.unlock();
+                ++timestep->tick;
+                RunTicks(1);
+                Publish();
+                guard.lock();
+                ++steps_done;
+                changed.notify_all();
+                continue;
+            }
+
+            guard.unlock();
+            double now = Now();
+            int ticks = timestep->Advance(now - last);
+            last = now;
+            RunTicks(ticks);
+            if(ticks > 0)
+                Publish();
+            guard.lock();
+
+            // Sleep until the next tick is due, or something needs the simulation
+            double wait = (1 - timestep->Alpha()) * timestep->Step();
+            changed.wait_for(guard, chrono::duration<double>(wait), [this]() {
+                return pauses > 0 || !running || lockstep;
+            });
+        }
+        parked = false;
+    }
+
+    void RunCall(unique_lock<mutex> & guard) {
+        if(!calling || servicing)
+            return;
+        function<void ()> function = move(call);
+        servicing = true;
+        guard.unlock();
+        function();
+        guard.lock();
+        servicing = false;
+        calling = false;
+        changed.notify_all();
+    }
+
+    void RunTicks(int ticks) {
+        if(ticks == 0)
+            return;
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < ticks; ++i) {
+            PROFILE_ZONE("Tick");
+            {
+                lock_guard<mutex> guard(input_lock);
+                player->input = pending;
+                pending.look = {0, 0};
+            }
+            Demo::Tick(&player->input);
+
+            // Edit mode flies through the world
+            if(world->edit)
+                player->grounded = true;
+
+            player->Update(timestep->Step(), world->edit ? NULL : &world->collision);
+            world->object_manager.Update(timestep->Step(), player);
+        }
+        sim_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    void Publish() {
+        PROFILE_ZONE("SimThread::Publish");
+        RenderSnapshot & snapshot = snapshots.Back();
+        snapshot.tick = timestep->tick;
+        snapshot.step = timestep->Step();
+        snapshot.time = Now() - timestep->Alpha() * snapshot.step;
+        snapshot.revision = world->object_manager.revision;
+        snapshot.player = *player;
+        world->object_manager.Snapshot(&snapshot.objects);
+        snapshots.Publish();
+    }
+};
+
+// Holds the simulation between ticks for its scope, for changes to what the ticks read. NULL holds nothing.
+class SimPause {
+    public:
+    SimPause(SimThread * sim) {
+        this->sim = sim;
+        if(sim != NULL)
+            sim->Pause();
+    }
+    SimPause(const SimPause &) = delete;
+    SimPause & operator=(const SimPause &) = delete;
+
+    ~SimPause() {
+        if(sim != NULL)
+            sim->Resume();
+    }
+
+    private:
+    SimThread * sim;
+};
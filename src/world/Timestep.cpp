@@ -0,0 +1,57 @@
+#pragma once
+
+// Fixed rate simulation clock, the render loop feeds it frame times and runs the ticks it returns
+
+class Timestep {
+    public:
+    // Simulation ticks per second
+    float rate = 60;
+
+    // Spiral of death clamp, frames longer than this are slowed down rather than caught up
+    int max_ticks = 8;
+    float max_frame = 0.25f;
+
+    // Total ticks run since start
+    unsigned long tick = 0;
+
+    Timestep(float rate) {
+        SetRate(rate);
+    }
+    Timestep() {}
+
+    void SetRate(float rate) {
+        this->rate = rate < 1 ? 1 : rate;
+        accumulator = 0;
+    }
+
+    // Length of one tick in seconds
+    float Step() {
+        return 1 / rate;
+    }
+
+    // Add a frame's time and return how many ticks to run this frame
+    int Advance(float frame_time) {
+        if(frame_time > max_frame)
+            frame_time = max_frame;
+        accumulator += frame_time;
+
+        int ticks = (int)(accumulator * rate);
+        if(ticks > max_ticks) {
+            // Drop the time we cannot catch up on
+            ticks = max_ticks;
+            accumulator = ticks / (double)rate;
+        }
+
+        accumulator -= ticks / (double)rate;
+        tick += ticks;
+        return ticks;
+    }
+
+    // How far the render frame is between the last tick and the next one, from 0 to 1
+    float Alpha() {
+        return accumulator * rate;
+    }
+
+    private:
+    double accumulator = 0;
+};
@@ -8,107 +8,346 @@
 #include "math/vec.hpp"
 #include "render/Renderer.cpp"
 #include "player/Player.cpp"
+#include "physics/CollisionWorld.cpp"
+#include "world/MapFile.cpp"
+#include "world/MapLoader.cpp"
+#include "render/AssetCache.cpp"
+#include "render/Frustum.cpp"
+#include "render/InstanceBatcher.cpp"
+#include "render/Occlusion.cpp"
+#include "world/Pvs.cpp"
+#include "system/Profiler.cpp"
 
 #include <raylib.h>
 #include <raymath.h>
 
+#include <algorithm>
+#include <iostream>
+#include <string>
 #include <vector>
 
 using namespace std;
 
+// A mesh of one of the world models, models are split into these at load (see render/MeshChunks.cpp)
+struct WorldChunk {
+    unsigned int model;
+    unsigned int mesh;
+};
 
 class World {
     public:
+    // The map last applied, as it was loaded
+    string filename;
     bool edit = false;
     ObjectManager object_manager;
     LightManager light_manager;
     vector<Model> models;
+    CollisionWorld collision;
+
+    // Every mesh of every model with its world space bounds, in the same order
+    vector<WorldChunk> chunks;
+    ChunkBounds chunk_bounds;
+    // Chunks drawn and culled by the last Render, by the view frustum, the PVS and occluders
+    unsigned int chunks_drawn = 0, chunks_culled = 0, chunks_hidden = 0, chunks_occluded = 0;
+    // Cells visible from each cell of baked maps, empty for the rest, which draw everything. Set
+    // its viewpoint before culling lights and drawing.
+    Pvs pvs;
+
+    // The nearest large world triangles, rasterized on the CPU every Render to hide what is behind them
+    OcclusionBuffer occlusion;
+    bool occlusion_culling = true;
     int world_shader;
     Texture2D texmap;
 
-    World(Renderer * renderer, Player * player);
+    // World chunks and object models drawn by Render, models placed more than once are instanced
+    InstanceBatcher batcher;
+    // Threads Load bakes the map lights on, see MapLoader::jobs
+    JobSystem * bake_jobs = NULL;
+
+    // A NULL renderer makes a headless world that only loads CPU-side geometry (pair it with a headless cache)
+    World(Renderer * renderer, Player * player, AssetCache * assets);
+
+    // Loads a text .map, a baked .cmap, or the current baked copy of a text map, blocking until done
+    bool Load(const char * filename, MapFormat format = MAP_ANY);
+    // Swap in a map finished by a MapLoader, replacing the current one
+    void Apply(MapLoader * loader);
+    // Apply the lights and objects of an edited text map to the running one, without reloading the
+    // models. False when the models (or the lights of a baked map) changed, which need a full load.
+    bool Patch(const char * filename);
+    // A cached model was reloaded, copies of old draw the new meshes (baked copies keep theirs)
+    void RefreshModel(const Model & old, const Model & loaded);
+    bool UsesModel(const string & path) {
+        return find(model_keys.begin(), model_keys.end(), path) != model_keys.end();
+    }
+    // Draw the chunks and objects inside the camera's view, aspect is the width over the height of the
+    // target. Objects are drawn from instances when given (see ObjectManager::Snapshot), else as they are.
+    void Render(Camera3D camera, float aspect, const vector<ObjectInstance> * instances = NULL) {
+        PROFILE_ZONE("World::Render");
+        Frustum frustum = Frustum::FromCamera(camera, aspect);
+        chunks_drawn = chunk_bounds.Cull(frustum, &visible);
+        chunks_culled = chunks.size() - chunks_drawn;
+        if(occlusion_culling) {
+            PROFILE_ZONE("Occlusion");
+            occlusion.Build(camera, aspect, collision.triangles);
+        }
+
+        chunks_hidden = chunks_occluded = 0;
+        for(unsigned int i = 0; i < chunks.size(); ++i) {
+            if(!visible[i])
+                continue;
+            BoundingBox box = chunk_bounds.Get(i);
+            if(!pvs.Visible(box))
+                ++chunks_hidden;
+            else if(occlusion_culling && !occlusion.Visible(box))
+                ++chunks_occluded;
+            else {
+                const Model & model = models[chunks[i].model];
+                batcher.Add(model.meshes[chunks[i].mesh], model.materials[model.meshMaterial[chunks[i].mesh]], model.transform);
+            }
+        }
+        chunks_drawn -= chunks_hidden + chunks_occluded;
 
-    bool Load(const char * filename);
-    void Render() {
-        for(Model model : models)
-            DrawModel(model, {0}, 1, WHITE);
+        // Objects pass the same PVS and occlusion tests as the chunks
+        auto in_view = [&](BoundingBox box) {
+            return pvs.Visible(box) && (!occlusion_culling || occlusion.Visible(box));
+        };
+        if(instances != NULL)
+            object_manager.Render(*instances, frustum, &batcher, in_view);
+        else
+            object_manager.Render(frustum, &batcher, in_view);
+        PROFILE_ZONE("Draw");
+        batcher.Flush();
     }
     void Reset();
 
     private:
     Player * player;
     Renderer * renderer;
+    AssetCache * assets;
+    // Cache keys of the loaded models, released on Reset
+    vector<string> model_keys;
+    // Models with baked lighting, the world owns their meshes rather than the cache
+    vector<Model> lit_models;
+    vector<unsigned char> visible;
+
+    // The map as applied, Patch diffs an edited copy against it
+    bool lit = false;
+    vector<pair<string, Vector3>> placements;
+    vector<LoadedLight> lights;
+    vector<LoadedObject> objects;
+    // The object created for each map object, invalid for unknown types
+    vector<ObjectHandle> object_handles;
+
+    void AddChunks(unsigned int index);
+    ObjectHandle CreateObject(unsigned int index);
 };
 
-World::World(Renderer * renderer, Player * player) {
+World::World(Renderer * renderer, Player * player, AssetCache * assets) : light_manager(renderer) {
     this->renderer = renderer;
     this->player = player;
-    light_manager = LightManager(renderer);
+    this->assets = assets;
 }
 
-bool World::Load(const char * filename) {
-    if(!FileExists(filename))
+bool World::Load(const char * filename, MapFormat format) {
+    MapLoader loader = MapLoader(assets, renderer != NULL);
+    loader.jobs = bake_jobs;
+    if(!loader.Load(filename, format))
         return false;
 
-    int line_count = 0;
-    const char ** lines_c = TextSplit(LoadFileText(filename), '\n', &line_count);
-    string * lines = new string[line_count];
-
-    // Move to string arrow to de-allocate char ptr
-    for(int i = 0; i < line_count; ++i)
-        lines[i] = lines_c[i];
-    
-    for(int i = 0; i < line_count; ++i) {
-        int count = 0;
-        const char ** tokens_c = TextSplit(lines[i].c_str(), ' ', &count);
-        
-        if(lines[i] == "EDIT") edit = true;
-
-        if(count != 3) continue;
-
-        string * tokens = new string[count];
-        for(int token_i = 0; token_i < count; ++token_i)
-            tokens[token_i] = tokens_c[token_i];
-
-        Vector3 position = Vec3FromString(tokens[2]);
-
-        switch(lines[i][0]) {
-            // Load model
-            case 'M':
-                models.push_back(LoadModel(tokens[1].c_str()));
-                models[models.size() - 1].transform = MatrixTranslate(position.x, position.y, position.z);
-                models[models.size() - 1].materials[0].shader = renderer->shaders[world_shader].shader; // Set shader effect to 3d model
-                models[models.size() - 1].materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = texmap;
-                break;
-            // Create light
-            case 'L':
-                light_manager.CreateLight(
-                    stof(tokens[1].c_str()),
-                    position
-                );
-                break;
-            // Create object
-            case 'O':
-                break;
-            // Spawn the player
-            case 'P':
-                player->position = position;
-                break;
-            default:
-                continue;
+    Apply(&loader);
+    return true;
+}
+
+void World::Apply(MapLoader * loader) {
+    Reset();
+
+    filename = loader->filename;
+    edit = loader->edit;
+    lit = loader->lit;
+    for(LoadedModel & loaded : loader->models)
+        placements.push_back({loaded.path, loaded.position});
+
+    // The world takes over the cache reference each loaded model holds
+    for(LoadedModel & loaded : loader->models) {
+        if(!loaded.loaded)
+            continue;
+        loaded.loaded = false;
+        model_keys.push_back(loaded.path);
+
+        // Copies share the cached meshes and materials, only the transform is per instance
+        Model model = loaded.model;
+
+        // Baked models draw their own lit copy of the meshes with the cached materials
+        if(!loaded.lit.empty()) {
+            model.meshCount = loaded.lit.size();
+            model.meshes = (Mesh *)MemAlloc(model.meshCount * sizeof(Mesh));
+            model.meshMaterial = (int *)MemAlloc(model.meshCount * sizeof(int));
+            copy(loaded.lit.begin(), loaded.lit.end(), model.meshes);
+            loaded.lit.clear();
+            lit_models.push_back(model);
+        }
+        model.transform = MatrixTranslate(loaded.position.x, loaded.position.y, loaded.position.z);
+        if(renderer != NULL) {
+            model.materials[0].shader = renderer->shaders[world_shader].shader; // Set shader effect to 3d model
+            model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = texmap;
+        }
+        models.push_back(model);
+        AddChunks(models.size() - 1);
+    }
+
+    // Baked lights are already in the world models' colours, the shaders skip them there
+    lights = loader->lights;
+    for(LoadedLight light : lights)
+        light_manager.CreateLight(light.brightness, light.position, lit);
+
+    objects = loader->objects;
+    for(unsigned int i = 0; i < objects.size(); ++i)
+        object_handles.push_back(CreateObject(i));
+
+    if(loader->has_spawn)
+        player->position = loader->spawn;
+
+    collision.triangles.swap(loader->collision.triangles);
+    collision.nodes.swap(loader->collision.nodes);
+    if(!edit)
+        swap(pvs, loader->pvs);
+
+    loader->Finish();
+}
+
+bool World::Patch(const char * filename) {
+    MapFile map;
+    if(this->filename != filename || !map.Load(filename) || map.edit != edit)
+        return false;
+
+    vector<pair<string, Vector3>> edited_placements;
+    vector<LoadedLight> edited_lights;
+    vector<LoadedObject> edited_objects;
+    for(MapEntry entry : map.entries) {
+        if(entry.kind == 'M')
+            edited_placements.push_back({entry.argument, entry.position});
+        else if(entry.kind == 'L')
+            edited_lights.push_back({strtof(entry.argument.c_str(), NULL), entry.position});
+        else if(entry.kind == 'O')
+            edited_objects.push_back({entry.argument, entry.position});
+    }
+
+    auto same_position = [](Vector3 a, Vector3 b) {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    };
+    if(edited_placements.size() != placements.size())
+        return false;
+    for(unsigned int i = 0; i < placements.size(); ++i) {
+        if(edited_placements[i].first != placements[i].first || !same_position(edited_placements[i].second, placements[i].second))
+            return false;
+    }
+
+    // Baked lights are in the model colours, moving one means baking again
+    bool lights_changed = edited_lights.size() != lights.size();
+    for(unsigned int i = 0; i < lights.size() && !lights_changed; ++i)
+        lights_changed = edited_lights[i].brightness != lights[i].brightness || !same_position(edited_lights[i].position, lights[i].position);
+    if(lights_changed && lit)
+        return false;
+
+    if(lights_changed) {
+        light_manager.Reset();
+        lights = edited_lights;
+        for(LoadedLight light : lights)
+            light_manager.CreateLight(light.brightness, light.position);
+    }
+
+    // Objects are matched by their place in the map, only the changed ones are created again
+    unsigned int changed = 0, count = max(objects.size(), edited_objects.size());
+    objects.resize(count);
+    object_handles.resize(count);
+    for(unsigned int i = 0; i < count; ++i) {
+        if(i < edited_objects.size() && objects[i].type == edited_objects[i].type && same_position(objects[i].position, edited_objects[i].position))
+            continue;
+
+        // Deleting a default handle (a new map object) does nothing
+        ++changed;
+        object_manager.Delete(object_handles[i]);
+        if(i < edited_objects.size()) {
+            objects[i] = edited_objects[i];
+            object_handles[i] = CreateObject(i);
         }
     }
+    objects.resize(edited_objects.size());
+    object_handles.resize(edited_objects.size());
+
+    cout << "INFO: WORLD: Patched '" << filename << "' (" << (lights_changed ? lights.size() : 0) << " lights, "
+         << changed << " objects changed)\n";
     return true;
 }
 
+void World::RefreshModel(const Model & old, const Model & loaded) {
+    bool used = false;
+    for(Model & model : models) {
+        if(model.meshes != old.meshes)
+            continue;
+        model.meshCount = loaded.meshCount;
+        model.meshes = loaded.meshes;
+        model.meshMaterial = loaded.meshMaterial;
+        used = true;
+    }
+    if(!used)
+        return;
+
+    // The batcher points at the old meshes, the chunks are listed again from the new ones
+    batcher.Reset();
+    chunks.clear();
+    chunk_bounds.Clear();
+    for(unsigned int i = 0; i < models.size(); ++i)
+        AddChunks(i);
+}
+
+void World::AddChunks(unsigned int index) {
+    const Model & model = models[index];
+    Vector3 position = {model.transform.m12, model.transform.m13, model.transform.m14};
+    for(int i = 0; i < model.meshCount; ++i) {
+        BoundingBox box = GetMeshBoundingBox(model.meshes[i]);
+        chunks.push_back({index, (unsigned int)i});
+        chunk_bounds.Add({Vector3Add(box.min, position), Vector3Add(box.max, position)});
+    }
+}
+
+// Objects are named after their type and place in the map
+ObjectHandle World::CreateObject(unsigned int index) {
+    const LoadedObject & object = objects[index];
+    if(!object_manager.HasType(object.type)) {
+        cout << "WARNING: WORLD: Unknown object type '" << object.type << "'\n";
+        return {};
+    }
+    return object_manager.Create(object.type, object.type + to_string(index), object.position, {0});
+}
+
 void World::Reset() {
     // Light manager has a built in reset method
     light_manager.Reset();
 
     // Object manager can be reset by just deleting all the objects
-    object_manager.object_count = 0;
-    object_manager.objects = {};
+    object_manager.Clear();
 
-    // Delete world models
+    // Hand the world models back to the cache, they stay resident for the next map within its budget
+    for(string key : model_keys)
+        assets->Release(key);
+    model_keys.clear();
+    for(Model & model : lit_models) {
+        for(int i = 0; i < model.meshCount; ++i)
+            UnloadMesh(model.meshes[i]);
+        MemFree(model.meshes);
+        MemFree(model.meshMaterial);
+    }
+    lit_models.clear();
     models.clear();
+    batcher.Reset();
+    chunks.clear();
+    chunk_bounds.Clear();
+    collision.Clear();
+    pvs.Clear();
+    lit = false;
+    placements.clear();
+    lights.clear();
+    objects.clear();
+    object_handles.clear();
 }
\ No newline at end of file